@@ -0,0 +1,125 @@
+/*
+ * (C) 2026 see Authors.txt
+ *
+ * This file is part of MPC-HC.
+ *
+ * MPC-HC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MPC-HC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "stdafx.h"
+#include <atomic>
+#include <memory>
+#include "ThreadPool.h"
+
+CThreadPool::CThreadPool(size_t nThreads /*= 0*/)
+{
+    if (!nThreads) {
+        nThreads = GetDefaultThreadCount();
+    }
+
+    m_threads.reserve(nThreads);
+    for (size_t i = 0; i < nThreads; i++) {
+        m_threads.emplace_back([this] { WorkerProc(); });
+    }
+}
+
+CThreadPool::~CThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bExit = true;
+    }
+    m_condTask.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+size_t CThreadPool::GetDefaultThreadCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void CThreadPool::WorkerProc()
+{
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condTask.wait(lock, [this] { return m_bExit || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return; // m_bExit is set and nothing is left to do
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+void CThreadPool::Submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.emplace_back(std::move(task));
+    }
+    m_condTask.notify_one();
+}
+
+void CThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+    if (count == 0) {
+        return;
+    } else if (count == 1 || m_threads.empty()) {
+        for (size_t i = 0; i < count; i++) {
+            func(i);
+        }
+        return;
+    }
+
+    // The state is shared with the helper tasks since some of them
+    // might only get to run after this function has returned.
+    struct State {
+        std::atomic<size_t> next { 0 };
+        std::atomic<size_t> done { 0 };
+        std::mutex mutex;
+        std::condition_variable condDone;
+    };
+    auto pState = std::make_shared<State>();
+    const size_t nCount = count;
+    const auto* pFunc = &func;
+
+    // The helpers can only get a valid index while the calling thread
+    // is still waiting for the last call to finish so pFunc is valid.
+    auto work = [pState, nCount, pFunc] {
+        for (size_t i; (i = pState->next++) < nCount;) {
+            (*pFunc)(i);
+            if (++pState->done == nCount) {
+                std::lock_guard<std::mutex> lock(pState->mutex);
+                pState->condDone.notify_all();
+            }
+        }
+    };
+
+    for (size_t i = 0, nHelpers = std::min(count - 1, m_threads.size()); i < nHelpers; i++) {
+        Submit(work);
+    }
+    work();
+
+    std::unique_lock<std::mutex> lock(pState->mutex);
+    pState->condDone.wait(lock, [&] { return pState->done == nCount; });
+}
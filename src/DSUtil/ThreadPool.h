@@ -0,0 +1,61 @@
+/*
+ * (C) 2026 see Authors.txt
+ *
+ * This file is part of MPC-HC.
+ *
+ * MPC-HC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MPC-HC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads executing queued tasks in FIFO order
+class CThreadPool
+{
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+
+    std::mutex m_mutex; // to protect m_tasks and m_bExit
+    std::condition_variable m_condTask;
+    bool m_bExit = false;
+
+    void WorkerProc();
+
+public:
+    // nThreads == 0 means one thread per logical processor
+    explicit CThreadPool(size_t nThreads = 0);
+    ~CThreadPool();
+
+    CThreadPool(const CThreadPool&) = delete;
+    CThreadPool& operator=(const CThreadPool&) = delete;
+
+    size_t GetThreadCount() const {
+        return m_threads.size();
+    }
+
+    void Submit(std::function<void()> task);
+
+    // Calls func(i) for every i in [0, count) and returns once all calls are done.
+    // The calling thread takes part in the work so it is safe to call it from a worker.
+    void ParallelFor(size_t count, const std::function<void(size_t)>& func);
+
+    static size_t GetDefaultThreadCount();
+};
@@ -148,6 +148,15 @@ public IUnknown {
     STDMETHOD(GetRelativeTo)(POSITION pos, RelativeTo & relativeTo) PURE;
 };
 
+interface __declspec(uuid("3477DD7C-5179-472D-B9FD-39BCBFB80F7C"))
+ISubPicProviderEx :
+public ISubPicProvider {
+    // spd must still hold the last picture rendered by this provider. It is updated to
+    // what Render would produce at rt, only clearing with clearColor and redrawing the
+    // parts that changed, which are returned in rcUpdate. Fails when it can't be done.
+    STDMETHOD(RenderUpdate)(SubPicDesc & spd, REFERENCE_TIME rt, double fps, DWORD clearColor, RECT & bbox, RECT & rcUpdate) PURE;
+};
+
 //
 // ISubPicQueue
 //
@@ -168,6 +177,9 @@ public IUnknown {
     STDMETHOD(GetStats)(int nSubPic /*[in]*/, REFERENCE_TIME & rtStart, REFERENCE_TIME& rtStop /*[out]*/) PURE;
 
     STDMETHOD_(bool, LookupSubPic)(REFERENCE_TIME rtNow /*[in]*/, bool bAdviseBlocking, CComPtr<ISubPic>& pSubPic /*[out]*/) PURE;
+
+    // Time spent in the last call to LookupSubPic and the longest one so far
+    STDMETHOD(GetLookupStats)(REFERENCE_TIME & rtLastLookup, REFERENCE_TIME& rtMaxLookup /*[out]*/) PURE;
 };
 
 //
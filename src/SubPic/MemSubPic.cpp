@@ -24,7 +24,7 @@
 
 // For CPUID usage
 #include "../DSUtil/vd.h"
-#include <emmintrin.h>
+#include <intrin.h>
 
 // color conv
 
@@ -80,6 +80,107 @@ void ColorConvInit()
     bColorConvInitOK = true;
 }
 
+//
+// CMemSubPicRunMap
+//
+
+void CMemSubPicRunMap::Reset()
+{
+    m_rect.SetRectEmpty();
+    m_rowGroups.clear();
+    m_runs.clear();
+}
+
+void CMemSubPicRunMap::Build(const SubPicDesc& spd, const CRect& rect)
+{
+    Reset();
+
+    if (rect.IsRectEmpty()) {
+        return;
+    }
+
+    // The RGB16/RGB15 conversions only keep 5 bits of alpha
+    const DWORD transparent = (spd.type == MSP_RGB16 || spd.type == MSP_RGB15) ? 0x1f000000 : 0xff000000;
+    // YUY2 is blended by pairs of pixels and the YV12/IYUV chroma by 2x2 blocks
+    const int align = (spd.type == MSP_YUY2 || spd.type == MSP_YV12 || spd.type == MSP_IYUV) ? 2 : 1;
+    m_nGroupRows = (spd.type == MSP_YV12 || spd.type == MSP_IYUV) ? 2 : 1;
+    // Shorter gaps are not worth a separate run, the kernels skip transparent pixels anyway
+    const int minGap = 16;
+
+    m_rect = rect;
+    m_rowGroups.reserve((rect.Height() + m_nGroupRows - 1) / m_nGroupRows + 1);
+
+    const __m128i alphaMask = _mm_set1_epi32(int(0xff000000));
+    const __m128i transparentAlpha = _mm_set1_epi32(int(transparent));
+
+    for (int y = rect.top; y < rect.bottom; y += m_nGroupRows) {
+        m_rowGroups.push_back(m_runs.size());
+
+        const int nRows = std::min(m_nGroupRows, int(rect.bottom - y));
+        const DWORD* rows[2] = { (const DWORD*)(spd.bits + spd.pitch * y), nullptr };
+        if (nRows > 1) {
+            rows[1] = rows[0] + spd.pitch / 4;
+        }
+
+        int runLeft = 0, runRight = 0;
+        auto addRun = [&]() {
+            if (runLeft < runRight) {
+                m_runs.emplace_back(std::max(int(rect.left), runLeft & ~(align - 1)),
+                                    std::min(int(rect.right), (runRight + align - 1) & ~(align - 1)));
+            }
+        };
+        auto addPixel = [&](int x) {
+            if (x >= runRight + minGap || runLeft == runRight) {
+                addRun();
+                runLeft = x;
+            }
+            runRight = x + 1;
+        };
+
+        int x = rect.left;
+        for (; x + 4 <= rect.right; x += 4) {
+            int visible = 0;
+            for (int i = 0; i < nRows; i++) {
+                __m128i alpha = _mm_and_si128(_mm_loadu_si128((const __m128i*)(rows[i] + x)), alphaMask);
+                visible |= ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(alpha, transparentAlpha))) & 0xf;
+            }
+            for (int i = 0; visible; i++, visible >>= 1) {
+                if (visible & 1) {
+                    addPixel(x + i);
+                }
+            }
+        }
+        for (; x < rect.right; x++) {
+            for (int i = 0; i < nRows; i++) {
+                if ((rows[i][x] & 0xff000000) != transparent) {
+                    addPixel(x);
+                    break;
+                }
+            }
+        }
+        addRun();
+    }
+
+    m_rowGroups.push_back(m_runs.size());
+}
+
+bool CMemSubPicRunMap::Covers(const CRect& r) const
+{
+    return !m_rowGroups.empty()
+           && r.left >= m_rect.left && r.right <= m_rect.right
+           && r.top >= m_rect.top && r.bottom <= m_rect.bottom
+           && (r.top - m_rect.top) % m_nGroupRows == 0;
+}
+
+const std::pair<int, int>* CMemSubPicRunMap::GetRuns(int y, size_t& nRuns) const
+{
+    ASSERT(y >= m_rect.top && y < m_rect.bottom);
+
+    size_t i = size_t(y - m_rect.top) / m_nGroupRows;
+    nRuns = m_rowGroups[i + 1] - m_rowGroups[i];
+    return m_runs.data() + m_rowGroups[i];
+}
+
 //
 // CMemSubPic
 //
@@ -95,7 +196,7 @@ CMemSubPic::CMemSubPic(const SubPicDesc& spd, CMemSubPicAllocator* pAllocator)
 CMemSubPic::~CMemSubPic()
 {
     m_pAllocator->FreeSpdBits(m_spd);
-    if (m_resizedSpd) {
+    if (m_resizedSpd && m_resizedSpd->bits) {
         m_pAllocator->FreeSpdBits(*m_resizedSpd);
     }
 }
@@ -139,6 +240,7 @@ STDMETHODIMP CMemSubPic::CopyTo(ISubPic* pSubPic)
         ASSERT(subPic->m_resizedSpd == nullptr);
         // Move because we are not going to reuse it.
         subPic->m_resizedSpd = std::move(m_resizedSpd);
+        subPic->m_runMap = m_runMap;
     }
 
     int w = m_rcDirty.Width(), h = m_rcDirty.Height();
@@ -175,6 +277,7 @@ STDMETHODIMP CMemSubPic::ClearDirtyRect(DWORD color)
     }
 
     m_rcDirty.SetRectEmpty();
+    m_runMap.Reset();
 
     return S_OK;
 }
@@ -187,6 +290,7 @@ STDMETHODIMP CMemSubPic::Lock(SubPicDesc& spd)
 STDMETHODIMP CMemSubPic::Unlock(RECT* pDirtyRect)
 {
     m_rcDirty = pDirtyRect ? *pDirtyRect : CRect(0, 0, m_spd.w, m_spd.h);
+    m_runMap.Reset();
 
     if (m_rcDirty.IsRectEmpty()) {
         return S_OK;
@@ -199,14 +303,20 @@ STDMETHODIMP CMemSubPic::Unlock(RECT* pDirtyRect)
             m_resizedSpd = std::unique_ptr<SubPicDesc>(DEBUG_NEW SubPicDesc);
         }
 
+        if (m_resizedSpd->bits && (m_resizedSpd->w != r.Width() || m_resizedSpd->h != r.Height())) {
+            // The pooled surface was sized for the previous video rectangle
+            m_pAllocator->FreeSpdBits(*m_resizedSpd);
+        }
+
         m_resizedSpd->type = m_spd.type;
         m_resizedSpd->w = r.Width();
         m_resizedSpd->h = r.Height();
-        m_resizedSpd->pitch = r.Width() * 4;
+        m_resizedSpd->pitch = CMemSubPicAllocator::GetAlignedPitch(r.Width(), m_spd.bpp);
         m_resizedSpd->bpp = m_spd.bpp;
 
-        if (!m_resizedSpd->bits) {
-            m_pAllocator->AllocSpdBits(*m_resizedSpd);
+        if (!m_resizedSpd->bits && !m_pAllocator->AllocSpdBits(*m_resizedSpd)) {
+            m_resizedSpd = nullptr;
+            return E_OUTOFMEMORY;
         }
 
         BitBltFromRGBToRGBStretch(m_resizedSpd->w, m_resizedSpd->h, m_resizedSpd->bits, m_resizedSpd->pitch, m_resizedSpd->bpp
@@ -217,7 +327,9 @@ STDMETHODIMP CMemSubPic::Unlock(RECT* pDirtyRect)
         rcDirty.SetRect(0, 0, m_resizedSpd->w, m_resizedSpd->h);
     } else if (m_resizedSpd) {
         // Resize is not needed so release m_resizedSpd.
-        m_pAllocator->FreeSpdBits(*m_resizedSpd);
+        if (m_resizedSpd->bits) {
+            m_pAllocator->FreeSpdBits(*m_resizedSpd);
+        }
         m_resizedSpd = nullptr;
     }
 
@@ -302,6 +414,8 @@ STDMETHODIMP CMemSubPic::Unlock(RECT* pDirtyRect)
         }
     }
 
+    m_runMap.Build(subPic, rcDirty);
+
     return S_OK;
 }
 
@@ -411,6 +525,470 @@ void AlphaBlt_YUY2_C(int w, int h, BYTE* d, int dstpitch, BYTE* s, int srcpitch)
     }
 }
 
+// AlphaBlt row kernels, w being the number of source pixels
+
+typedef void (*AlphaBltRowFunc)(BYTE* d, BYTE* s, int w);
+// Blends the chroma of two source rows into one row of the U and V planes, w being the number of chroma samples
+typedef void (*AlphaBltChromaFunc)(BYTE* du, BYTE* dv, BYTE* s, int srcpitch, int w);
+
+static void AlphaBltRow_RGBA_C(BYTE* d, BYTE* s, int w)
+{
+    BYTE* s2end = s + w * 4;
+    DWORD* d2 = (DWORD*)d;
+    for (BYTE* s2 = s; s2 < s2end; s2 += 4, d2++) {
+        if (s2[3] < 0xff) {
+            DWORD bd = 0x00000100 - ((DWORD) s2[3]);
+            DWORD B = ((*((DWORD*)s2) & 0x000000ff) << 8) / bd;
+            DWORD V = ((*((DWORD*)s2) & 0x0000ff00) / bd) << 8;
+            DWORD R = (((*((DWORD*)s2) & 0x00ff0000) >> 8) / bd) << 16;
+            *d2 = B | V | R
+                  | (0xff000000 - (*((DWORD*)s2) & 0xff000000)) & 0xff000000;
+        }
+    }
+}
+
+static void AlphaBltRow_RGB32_C(BYTE* d, BYTE* s, int w)
+{
+    BYTE* s2end = s + w * 4;
+    DWORD* d2 = (DWORD*)d;
+    for (BYTE* s2 = s; s2 < s2end; s2 += 4, d2++) {
+#ifdef _WIN64
+        DWORD ia = 256 - s2[3];
+        if (s2[3] < 0xff) {
+            *d2 = ((((*d2 & 0x00ff00ff) * s2[3]) >> 8) + (((*((DWORD*)s2) & 0x00ff00ff) * ia) >> 8) & 0x00ff00ff)
+                  | ((((*d2 & 0x0000ff00) * s2[3]) >> 8) + (((*((DWORD*)s2) & 0x0000ff00) * ia) >> 8) & 0x0000ff00);
+        }
+#else
+        if (s2[3] < 0xff) {
+            *d2 = ((((*d2 & 0x00ff00ff) * s2[3]) >> 8) + (*((DWORD*)s2) & 0x00ff00ff) & 0x00ff00ff)
+                  | ((((*d2 & 0x0000ff00) * s2[3]) >> 8) + (*((DWORD*)s2) & 0x0000ff00) & 0x0000ff00);
+        }
+#endif
+    }
+}
+
+static void AlphaBltRow_RGB24_C(BYTE* d, BYTE* s, int w)
+{
+    BYTE* s2end = s + w * 4;
+    BYTE* d2 = d;
+    for (BYTE* s2 = s; s2 < s2end; s2 += 4, d2 += 3) {
+        if (s2[3] < 0xff) {
+            d2[0] = ((d2[0] * s2[3]) >> 8) + s2[0];
+            d2[1] = ((d2[1] * s2[3]) >> 8) + s2[1];
+            d2[2] = ((d2[2] * s2[3]) >> 8) + s2[2];
+        }
+    }
+}
+
+static void AlphaBltRow_RGB16_C(BYTE* d, BYTE* s, int w)
+{
+    BYTE* s2end = s + w * 4;
+    WORD* d2 = (WORD*)d;
+    for (BYTE* s2 = s; s2 < s2end; s2 += 4, d2++) {
+        if (s2[3] < 0x1f) {
+            *d2 = (WORD)((((((*d2 & 0xf81f) * s2[3]) >> 5) + (*(DWORD*)s2 & 0xf81f)) & 0xf81f)
+                         | (((((*d2 & 0x07e0) * s2[3]) >> 5) + (*(DWORD*)s2 & 0x07e0)) & 0x07e0));
+        }
+    }
+}
+
+static void AlphaBltRow_RGB15_C(BYTE* d, BYTE* s, int w)
+{
+    BYTE* s2end = s + w * 4;
+    WORD* d2 = (WORD*)d;
+    for (BYTE* s2 = s; s2 < s2end; s2 += 4, d2++) {
+        if (s2[3] < 0x1f) {
+            *d2 = (WORD)((((((*d2 & 0x7c1f) * s2[3]) >> 5) + (*(DWORD*)s2 & 0x7c1f)) & 0x7c1f)
+                         | (((((*d2 & 0x03e0) * s2[3]) >> 5) + (*(DWORD*)s2 & 0x03e0)) & 0x03e0));
+        }
+    }
+}
+
+static void AlphaBltRow_YUY2_C(BYTE* d, BYTE* s, int w)
+{
+    AlphaBlt_YUY2_C(w, 1, d, 0, s, 0);
+}
+
+static void AlphaBltRow_YUY2_SSE2(BYTE* d, BYTE* s, int w)
+{
+#ifdef _WIN64
+    AlphaBlt_YUY2_SSE2(w, 1, d, 0, s, 0);
+#else
+    AlphaBlt_YUY2_MMX(w, 1, d, 0, s, 0);
+#endif
+}
+
+static void AlphaBltRow_YV12_C(BYTE* d, BYTE* s, int w)
+{
+    BYTE* s2end = s + w * 4;
+    BYTE* d2 = d;
+    for (BYTE* s2 = s; s2 < s2end; s2 += 4, d2++) {
+        if (s2[3] < 0xff) {
+            d2[0] = (((d2[0] - 0x10) * s2[3]) >> 8) + s2[1];
+        }
+    }
+}
+
+static void AlphaBltChroma_YV12_C(BYTE* du, BYTE* dv, BYTE* s, int srcpitch, int w)
+{
+    // The converted source holds U in the even pixels and V in the odd ones
+    for (int i = 0; i < w; i++, s += 8) {
+        unsigned int ia = (s[3] + s[3 + srcpitch] + s[7] + s[7 + srcpitch]) >> 2;
+        if (ia < 0xff) {
+            du[i] = BYTE((((du[i] - 0x80) * ia) >> 8) + ((s[0] + s[srcpitch]) >> 1));
+            dv[i] = BYTE((((dv[i] - 0x80) * ia) >> 8) + ((s[4] + s[4 + srcpitch]) >> 1));
+        }
+    }
+}
+
+#ifdef _WIN64
+// The SIMD kernels give the same results as the x64 scalar code above
+// and leave the pixels whose source is fully transparent untouched.
+
+static __forceinline __m128i AlphaBlt_RGB32_SSE41(__m128i d16, __m128i s16)
+{
+    const __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128i pd = _mm_mullo_epi16(d16, alpha);
+    const __m128i ps = _mm_mullo_epi16(s16, _mm_sub_epi16(_mm_set1_epi16(256), alpha));
+    // Blue rounds both products down separately, green and red their sum, alpha ends up cleared
+    const __m128i sum = _mm_srli_epi16(_mm_add_epi16(pd, ps), 8);
+    const __m128i sep = _mm_add_epi16(_mm_srli_epi16(pd, 8), _mm_srli_epi16(ps, 8));
+    __m128i r = _mm_and_si128(_mm_blend_epi16(sum, sep, 0x11), _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1));
+    return _mm_blendv_epi8(r, d16, _mm_cmpeq_epi16(alpha, _mm_set1_epi16(0xff)));
+}
+
+static void AlphaBltRow_RGB32_SSE41(BYTE* d, BYTE* s, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 4 <= w; i += 4) {
+        __m128i src = _mm_loadu_si128((__m128i*)(s + i * 4));
+        __m128i dst = _mm_loadu_si128((__m128i*)(d + i * 4));
+        __m128i lo = AlphaBlt_RGB32_SSE41(_mm_unpacklo_epi8(dst, zero), _mm_unpacklo_epi8(src, zero));
+        __m128i hi = AlphaBlt_RGB32_SSE41(_mm_unpackhi_epi8(dst, zero), _mm_unpackhi_epi8(src, zero));
+        _mm_storeu_si128((__m128i*)(d + i * 4), _mm_packus_epi16(lo, hi));
+    }
+    AlphaBltRow_RGB32_C(d + i * 4, s + i * 4, w - i);
+}
+
+static __forceinline __m256i AlphaBlt_RGB32_AVX2(__m256i d16, __m256i s16)
+{
+    const __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    const __m256i pd = _mm256_mullo_epi16(d16, alpha);
+    const __m256i ps = _mm256_mullo_epi16(s16, _mm256_sub_epi16(_mm256_set1_epi16(256), alpha));
+    const __m256i sum = _mm256_srli_epi16(_mm256_add_epi16(pd, ps), 8);
+    const __m256i sep = _mm256_add_epi16(_mm256_srli_epi16(pd, 8), _mm256_srli_epi16(ps, 8));
+    __m256i r = _mm256_and_si256(_mm256_blend_epi16(sum, sep, 0x11),
+                                 _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1));
+    return _mm256_blendv_epi8(r, d16, _mm256_cmpeq_epi16(alpha, _mm256_set1_epi16(0xff)));
+}
+
+static void AlphaBltRow_RGB32_AVX2(BYTE* d, BYTE* s, int w)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    int i = 0;
+    for (; i + 8 <= w; i += 8) {
+        __m256i src = _mm256_loadu_si256((__m256i*)(s + i * 4));
+        __m256i dst = _mm256_loadu_si256((__m256i*)(d + i * 4));
+        __m256i lo = AlphaBlt_RGB32_AVX2(_mm256_unpacklo_epi8(dst, zero), _mm256_unpacklo_epi8(src, zero));
+        __m256i hi = AlphaBlt_RGB32_AVX2(_mm256_unpackhi_epi8(dst, zero), _mm256_unpackhi_epi8(src, zero));
+        _mm256_storeu_si256((__m256i*)(d + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+    AlphaBltRow_RGB32_SSE41(d + i * 4, s + i * 4, w - i);
+}
+
+// Two AxYU AxYV source pixel pairs against two YUYV macropixels
+static __forceinline __m128i AlphaBlt_YUY2_SSE41(__m128i d16, __m128i s)
+{
+    const __m128i c = _mm_shuffle_epi8(s, _mm_setr_epi8(1, -1, 0, -1, 5, -1, 4, -1, 9, -1, 8, -1, 13, -1, 12, -1));
+    // (a1, (a1 + a2) / 2, a2, (a1 + a2) / 2) for each macropixel
+    const __m128i a = _mm_srli_epi16(_mm_add_epi16(
+                                         _mm_shuffle_epi8(s, _mm_setr_epi8(3, -1, 3, -1, 7, -1, 3, -1, 11, -1, 11, -1, 15, -1, 11, -1)),
+                                         _mm_shuffle_epi8(s, _mm_setr_epi8(3, -1, 7, -1, 7, -1, 7, -1, 11, -1, 15, -1, 15, -1, 15, -1))), 1);
+    const __m128i ia = _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, _MM_SHUFFLE(1, 1, 1, 1)), _MM_SHUFFLE(1, 1, 1, 1));
+    __m128i r = _mm_sub_epi16(d16, _mm_setr_epi16(0x10, 0x80, 0x10, 0x80, 0x10, 0x80, 0x10, 0x80));
+    r = _mm_adds_epi16(_mm_srai_epi16(_mm_mullo_epi16(r, _mm_srli_epi16(a, 1)), 7), c);
+    return _mm_blendv_epi8(r, d16, _mm_cmpeq_epi16(ia, _mm_set1_epi16(0xff)));
+}
+
+static void AlphaBltRow_YUY2_SSE41(BYTE* d, BYTE* s, int w)
+{
+    int i = 0;
+    for (; i + 8 <= w; i += 8) {
+        __m128i dst = _mm_loadu_si128((__m128i*)(d + i * 2));
+        __m128i lo = AlphaBlt_YUY2_SSE41(_mm_cvtepu8_epi16(dst), _mm_loadu_si128((__m128i*)(s + i * 4)));
+        __m128i hi = AlphaBlt_YUY2_SSE41(_mm_unpackhi_epi8(dst, _mm_setzero_si128()), _mm_loadu_si128((__m128i*)(s + i * 4 + 16)));
+        _mm_storeu_si128((__m128i*)(d + i * 2), _mm_packus_epi16(lo, hi));
+    }
+    if (i < w) {
+        AlphaBlt_YUY2_SSE2(w - i, 1, d + i * 2, 0, s + i * 4, 0);
+    }
+}
+
+static __forceinline __m256i AlphaBlt_YUY2_AVX2(__m256i d16, __m256i s)
+{
+    const __m256i c = _mm256_shuffle_epi8(s, _mm256_setr_epi8(1, -1, 0, -1, 5, -1, 4, -1, 9, -1, 8, -1, 13, -1, 12, -1,
+                                                              1, -1, 0, -1, 5, -1, 4, -1, 9, -1, 8, -1, 13, -1, 12, -1));
+    const __m256i a = _mm256_srli_epi16(_mm256_add_epi16(
+                                            _mm256_shuffle_epi8(s, _mm256_setr_epi8(3, -1, 3, -1, 7, -1, 3, -1, 11, -1, 11, -1, 15, -1, 11, -1,
+                                                                                    3, -1, 3, -1, 7, -1, 3, -1, 11, -1, 11, -1, 15, -1, 11, -1)),
+                                            _mm256_shuffle_epi8(s, _mm256_setr_epi8(3, -1, 7, -1, 7, -1, 7, -1, 11, -1, 15, -1, 15, -1, 15, -1,
+                                                                                    3, -1, 7, -1, 7, -1, 7, -1, 11, -1, 15, -1, 15, -1, 15, -1))), 1);
+    const __m256i ia = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(a, _MM_SHUFFLE(1, 1, 1, 1)), _MM_SHUFFLE(1, 1, 1, 1));
+    __m256i r = _mm256_sub_epi16(d16, _mm256_setr_epi16(0x10, 0x80, 0x10, 0x80, 0x10, 0x80, 0x10, 0x80,
+                                                        0x10, 0x80, 0x10, 0x80, 0x10, 0x80, 0x10, 0x80));
+    r = _mm256_adds_epi16(_mm256_srai_epi16(_mm256_mullo_epi16(r, _mm256_srli_epi16(a, 1)), 7), c);
+    return _mm256_blendv_epi8(r, d16, _mm256_cmpeq_epi16(ia, _mm256_set1_epi16(0xff)));
+}
+
+static void AlphaBltRow_YUY2_AVX2(BYTE* d, BYTE* s, int w)
+{
+    int i = 0;
+    for (; i + 16 <= w; i += 16) {
+        __m256i dst = _mm256_loadu_si256((__m256i*)(d + i * 2));
+        __m256i lo = AlphaBlt_YUY2_AVX2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(dst)), _mm256_loadu_si256((__m256i*)(s + i * 4)));
+        __m256i hi = AlphaBlt_YUY2_AVX2(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(dst, 1)), _mm256_loadu_si256((__m256i*)(s + i * 4 + 32)));
+        // packus works on each 128-bit lane, put the macropixels back in order
+        _mm256_storeu_si256((__m256i*)(d + i * 2), _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    AlphaBltRow_YUY2_SSE41(d + i * 2, s + i * 4, w - i);
+}
+
+// ((d - 16) * a) >> 8 + y, wrapping around like the scalar code
+static __forceinline __m128i AlphaBlt_YV12_SSE41(__m128i d16, __m128i a16, __m128i y16)
+{
+    __m128i r = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(d16, _mm_set1_epi16(0x10)), 7), _mm_slli_epi16(a16, 1));
+    r = _mm_and_si128(_mm_add_epi16(r, y16), _mm_set1_epi16(0xff));
+    return _mm_blendv_epi8(r, d16, _mm_cmpeq_epi16(a16, _mm_set1_epi16(0xff)));
+}
+
+static void AlphaBltRow_YV12_SSE41(BYTE* d, BYTE* s, int w)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+
+    int i = 0;
+    for (; i + 8 <= w; i += 8) {
+        __m128i src0 = _mm_loadu_si128((__m128i*)(s + i * 4));
+        __m128i src1 = _mm_loadu_si128((__m128i*)(s + i * 4 + 16));
+        __m128i a16 = _mm_packs_epi32(_mm_srli_epi32(src0, 24), _mm_srli_epi32(src1, 24));
+        __m128i y16 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(src0, 8), mask), _mm_and_si128(_mm_srli_epi32(src1, 8), mask));
+        __m128i r = AlphaBlt_YV12_SSE41(_mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*)(d + i))), a16, y16);
+        _mm_storel_epi64((__m128i*)(d + i), _mm_packus_epi16(r, r));
+    }
+    AlphaBltRow_YV12_C(d + i, s + i * 4, w - i);
+}
+
+static __forceinline __m256i AlphaBlt_YV12_AVX2(__m256i d16, __m256i a16, __m256i y16)
+{
+    __m256i r = _mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(d16, _mm256_set1_epi16(0x10)), 7), _mm256_slli_epi16(a16, 1));
+    r = _mm256_and_si256(_mm256_add_epi16(r, y16), _mm256_set1_epi16(0xff));
+    return _mm256_blendv_epi8(r, d16, _mm256_cmpeq_epi16(a16, _mm256_set1_epi16(0xff)));
+}
+
+static void AlphaBltRow_YV12_AVX2(BYTE* d, BYTE* s, int w)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+
+    int i = 0;
+    for (; i + 16 <= w; i += 16) {
+        __m256i src0 = _mm256_loadu_si256((__m256i*)(s + i * 4));
+        __m256i src1 = _mm256_loadu_si256((__m256i*)(s + i * 4 + 32));
+        // packs works on each 128-bit lane, put the pixels back in order
+        __m256i a16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srli_epi32(src0, 24), _mm256_srli_epi32(src1, 24)),
+                                               _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i y16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(src0, 8), mask),
+                                                                  _mm256_and_si256(_mm256_srli_epi32(src1, 8), mask)),
+                                               _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i r = AlphaBlt_YV12_AVX2(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)(d + i))), a16, y16);
+        r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, r), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(d + i), _mm256_castsi256_si128(r));
+    }
+    AlphaBltRow_YV12_SSE41(d + i, s + i * 4, w - i);
+}
+
+// ((d - 128) * a) >> 8 + c, wrapping around like the scalar code
+static __forceinline __m128i AlphaBlt_Chroma_SSE41(__m128i d16, __m128i a16, __m128i c16)
+{
+    __m128i r = _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(d16, _mm_set1_epi16(0x80)), a16), 8);
+    r = _mm_and_si128(_mm_add_epi16(r, c16), _mm_set1_epi16(0xff));
+    return _mm_blendv_epi8(r, d16, _mm_cmpeq_epi16(a16, _mm_set1_epi16(0xff)));
+}
+
+static void AlphaBltChroma_YV12_SSE41(BYTE* du, BYTE* dv, BYTE* s, int srcpitch, int w)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+
+    // Sums of the two rows for four pixels: alpha, and the U or V average in the low word
+    auto load = [&](int offset, __m128i & a, __m128i & c) {
+        __m128i s0 = _mm_loadu_si128((__m128i*)(s + offset));
+        __m128i s1 = _mm_loadu_si128((__m128i*)(s + offset + srcpitch));
+        a = _mm_add_epi32(_mm_srli_epi32(s0, 24), _mm_srli_epi32(s1, 24));
+        c = _mm_srli_epi32(_mm_add_epi32(_mm_and_si128(s0, mask), _mm_and_si128(s1, mask)), 1);
+    };
+
+    int i = 0;
+    for (; i + 8 <= w; i += 8, s += 64) {
+        __m128i a[4], c[4];
+        for (int j = 0; j < 4; j++) {
+            load(j * 16, a[j], c[j]);
+        }
+        __m128i a16 = _mm_packs_epi32(_mm_srli_epi32(_mm_hadd_epi32(a[0], a[1]), 2), _mm_srli_epi32(_mm_hadd_epi32(a[2], a[3]), 2));
+        __m128i c01 = _mm_packs_epi32(c[0], c[1]), c23 = _mm_packs_epi32(c[2], c[3]);
+        __m128i u16 = _mm_packs_epi32(_mm_and_si128(c01, mask), _mm_and_si128(c23, mask));
+        __m128i v16 = _mm_packs_epi32(_mm_srli_epi32(c01, 16), _mm_srli_epi32(c23, 16));
+
+        __m128i r = AlphaBlt_Chroma_SSE41(_mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*)(du + i))), a16, u16);
+        _mm_storel_epi64((__m128i*)(du + i), _mm_packus_epi16(r, r));
+        r = AlphaBlt_Chroma_SSE41(_mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i*)(dv + i))), a16, v16);
+        _mm_storel_epi64((__m128i*)(dv + i), _mm_packus_epi16(r, r));
+    }
+    AlphaBltChroma_YV12_C(du + i, dv + i, s, srcpitch, w - i);
+}
+
+static __forceinline __m256i AlphaBlt_Chroma_AVX2(__m256i d16, __m256i a16, __m256i c16)
+{
+    __m256i r = _mm256_srai_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(d16, _mm256_set1_epi16(0x80)), a16), 8);
+    r = _mm256_and_si256(_mm256_add_epi16(r, c16), _mm256_set1_epi16(0xff));
+    return _mm256_blendv_epi8(r, d16, _mm256_cmpeq_epi16(a16, _mm256_set1_epi16(0xff)));
+}
+
+static void AlphaBltChroma_YV12_AVX2(BYTE* du, BYTE* dv, BYTE* s, int srcpitch, int w)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    // hadd and packs work on each 128-bit lane, this puts the samples back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    auto load = [&](int offset, __m256i & a, __m256i & c) {
+        __m256i s0 = _mm256_loadu_si256((__m256i*)(s + offset));
+        __m256i s1 = _mm256_loadu_si256((__m256i*)(s + offset + srcpitch));
+        a = _mm256_add_epi32(_mm256_srli_epi32(s0, 24), _mm256_srli_epi32(s1, 24));
+        c = _mm256_srli_epi32(_mm256_add_epi32(_mm256_and_si256(s0, mask), _mm256_and_si256(s1, mask)), 1);
+    };
+
+    int i = 0;
+    for (; i + 16 <= w; i += 16, s += 128) {
+        __m256i a[4], c[4];
+        for (int j = 0; j < 4; j++) {
+            load(j * 32, a[j], c[j]);
+        }
+        __m256i a16 = _mm256_packs_epi32(_mm256_srli_epi32(_mm256_hadd_epi32(a[0], a[1]), 2),
+                                         _mm256_srli_epi32(_mm256_hadd_epi32(a[2], a[3]), 2));
+        __m256i c01 = _mm256_packs_epi32(c[0], c[1]), c23 = _mm256_packs_epi32(c[2], c[3]);
+        __m256i u16 = _mm256_packs_epi32(_mm256_and_si256(c01, mask), _mm256_and_si256(c23, mask));
+        __m256i v16 = _mm256_packs_epi32(_mm256_srli_epi32(c01, 16), _mm256_srli_epi32(c23, 16));
+        a16 = _mm256_permutevar8x32_epi32(a16, order);
+        u16 = _mm256_permutevar8x32_epi32(u16, order);
+        v16 = _mm256_permutevar8x32_epi32(v16, order);
+
+        __m256i r = AlphaBlt_Chroma_AVX2(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)(du + i))), a16, u16);
+        r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, r), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(du + i), _mm256_castsi256_si128(r));
+        r = AlphaBlt_Chroma_AVX2(_mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*)(dv + i))), a16, v16);
+        r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, r), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(dv + i), _mm256_castsi256_si128(r));
+    }
+    AlphaBltChroma_YV12_SSE41(du + i, dv + i, s, srcpitch, w - i);
+}
+#endif
+
+static AlphaBltRowFunc GetAlphaBltRowFunc(int type, CMemSubPic::AlphaBltKernel kernel)
+{
+    typedef CMemSubPic::AlphaBltKernel Kernel;
+
+    switch (type) {
+        case MSP_RGBA:
+            return AlphaBltRow_RGBA_C;
+        case MSP_RGB32:
+        case MSP_AYUV:
+#ifdef _WIN64
+            if (kernel >= Kernel::AVX2) {
+                return AlphaBltRow_RGB32_AVX2;
+            } else if (kernel >= Kernel::SSE41) {
+                return AlphaBltRow_RGB32_SSE41;
+            }
+#endif
+            return AlphaBltRow_RGB32_C;
+        case MSP_RGB24:
+            return AlphaBltRow_RGB24_C;
+        case MSP_RGB16:
+            return AlphaBltRow_RGB16_C;
+        case MSP_RGB15:
+            return AlphaBltRow_RGB15_C;
+        case MSP_YUY2:
+#ifdef _WIN64
+            if (kernel >= Kernel::AVX2) {
+                return AlphaBltRow_YUY2_AVX2;
+            } else if (kernel >= Kernel::SSE41) {
+                return AlphaBltRow_YUY2_SSE41;
+            }
+#endif
+            return kernel >= Kernel::SSE2 ? AlphaBltRow_YUY2_SSE2 : AlphaBltRow_YUY2_C;
+        case MSP_YV12:
+        case MSP_IYUV:
+#ifdef _WIN64
+            if (kernel >= Kernel::AVX2) {
+                return AlphaBltRow_YV12_AVX2;
+            } else if (kernel >= Kernel::SSE41) {
+                return AlphaBltRow_YV12_SSE41;
+            }
+#endif
+            return AlphaBltRow_YV12_C;
+        default:
+            return nullptr;
+    }
+}
+
+static AlphaBltChromaFunc GetAlphaBltChromaFunc(CMemSubPic::AlphaBltKernel kernel)
+{
+#ifdef _WIN64
+    if (kernel >= CMemSubPic::AlphaBltKernel::AVX2) {
+        return AlphaBltChroma_YV12_AVX2;
+    } else if (kernel >= CMemSubPic::AlphaBltKernel::SSE41) {
+        return AlphaBltChroma_YV12_SSE41;
+    }
+#else
+    UNREFERENCED_PARAMETER(kernel);
+#endif
+    return AlphaBltChroma_YV12_C;
+}
+
+CMemSubPic::AlphaBltKernel CMemSubPic::s_maxAlphaBltKernel = CMemSubPic::AlphaBltKernel::AVX2;
+
+void CMemSubPic::SetMaxAlphaBltKernel(AlphaBltKernel kernel)
+{
+    s_maxAlphaBltKernel = kernel;
+}
+
+CMemSubPic::AlphaBltKernel CMemSubPic::GetAlphaBltKernel()
+{
+    static const AlphaBltKernel bestKernel = [] {
+#ifdef _WIN64
+        int cpuInfo[4];
+        __cpuid(cpuInfo, 0);
+        int nIds = cpuInfo[0];
+        __cpuid(cpuInfo, 1);
+        if (!(cpuInfo[2] & (1 << 19))) {
+            return AlphaBltKernel::SSE2;
+        }
+        // AVX2 also needs the OS to save the YMM registers
+        bool bOSXSAVE = !!(cpuInfo[2] & (1 << 27));
+        if (nIds >= 7 && bOSXSAVE && (_xgetbv(_XCR_XFEATURE_ENABLED_MASK) & 0x6) == 0x6) {
+            __cpuidex(cpuInfo, 7, 0);
+            if (cpuInfo[1] & (1 << 5)) {
+                return AlphaBltKernel::AVX2;
+            }
+        }
+        return AlphaBltKernel::SSE41;
+#else
+        return AlphaBltKernel::SSE2;
+#endif
+    }();
+
+    return std::min(bestKernel, s_maxAlphaBltKernel);
+}
+
 STDMETHODIMP CMemSubPic::AlphaBlt(RECT* pSrc, RECT* pDst, SubPicDesc* pTarget)
 {
     ASSERT(pTarget);
@@ -442,146 +1020,59 @@ STDMETHODIMP CMemSubPic::AlphaBlt(RECT* pSrc, RECT* pDst, SubPicDesc* pTarget)
         return E_INVALIDARG;
     }
 
+    const AlphaBltKernel kernel = GetAlphaBltKernel();
+    AlphaBltRowFunc alphaBltRow = GetAlphaBltRowFunc(dst.type, kernel);
+    if (!alphaBltRow) {
+        return E_NOTIMPL;
+    }
+
     int w = rs.Width(), h = rs.Height();
     BYTE* s = src.bits + src.pitch * rs.top + rs.left * 4;
     BYTE* d = dst.bits + dst.pitch * rd.top + ((rd.left * dst.bpp) >> 3);
 
-    if (rd.top > rd.bottom) {
-        if (dst.type == MSP_RGB32 || dst.type == MSP_RGB24
-                || dst.type == MSP_RGB16 || dst.type == MSP_RGB15
-                || dst.type == MSP_YUY2 || dst.type == MSP_AYUV) {
-            d = dst.bits + dst.pitch * (rd.top - 1) + (rd.left * dst.bpp >> 3);
-        } else if (dst.type == MSP_YV12 || dst.type == MSP_IYUV) {
-            d = dst.bits + dst.pitch * (rd.top - 1) + (rd.left * 8 >> 3);
-        } else {
-            return E_NOTIMPL;
-        }
+    const bool bPlanar = dst.type == MSP_YV12 || dst.type == MSP_IYUV;
+    const int dstPixelSize = bPlanar ? 1 : dst.bpp >> 3;
 
+    if (rd.top > rd.bottom) {
+        d = dst.bits + dst.pitch * (rd.top - 1) + rd.left * dstPixelSize;
         dst.pitch = -dst.pitch;
     }
 
-    // TODO: m_bInvAlpha support
-    switch (dst.type) {
-        case MSP_RGBA:
-            for (ptrdiff_t j = 0; j < h; j++, s += src.pitch, d += dst.pitch) {
-                BYTE* s2 = s;
-                BYTE* s2end = s2 + w * 4;
-                DWORD* d2 = (DWORD*)d;
-                for (; s2 < s2end; s2 += 4, d2++) {
-                    if (s2[3] < 0xff) {
-                        DWORD bd = 0x00000100 - ((DWORD) s2[3]);
-                        DWORD B = ((*((DWORD*)s2) & 0x000000ff) << 8) / bd;
-                        DWORD V = ((*((DWORD*)s2) & 0x0000ff00) / bd) << 8;
-                        DWORD R = (((*((DWORD*)s2) & 0x00ff0000) >> 8) / bd) << 16;
-                        *d2 = B | V | R
-                              | (0xff000000 - (*((DWORD*)s2) & 0xff000000)) & 0xff000000;
-                    }
-                }
-            }
-            break;
-        case MSP_RGB32:
-        case MSP_AYUV:
-            for (ptrdiff_t j = 0; j < h; j++, s += src.pitch, d += dst.pitch) {
-                BYTE* s2 = s;
-                BYTE* s2end = s2 + w * 4;
-                DWORD* d2 = (DWORD*)d;
-                for (; s2 < s2end; s2 += 4, d2++) {
-#ifdef _WIN64
-                    DWORD ia = 256 - s2[3];
-                    if (s2[3] < 0xff) {
-                        *d2 = ((((*d2 & 0x00ff00ff) * s2[3]) >> 8) + (((*((DWORD*)s2) & 0x00ff00ff) * ia) >> 8) & 0x00ff00ff)
-                              | ((((*d2 & 0x0000ff00) * s2[3]) >> 8) + (((*((DWORD*)s2) & 0x0000ff00) * ia) >> 8) & 0x0000ff00);
-                    }
-#else
-                    if (s2[3] < 0xff) {
-                        *d2 = ((((*d2 & 0x00ff00ff) * s2[3]) >> 8) + (*((DWORD*)s2) & 0x00ff00ff) & 0x00ff00ff)
-                              | ((((*d2 & 0x0000ff00) * s2[3]) >> 8) + (*((DWORD*)s2) & 0x0000ff00) & 0x0000ff00);
-                    }
-#endif
-                }
-            }
-            break;
-        case MSP_RGB24:
-            for (ptrdiff_t j = 0; j < h; j++, s += src.pitch, d += dst.pitch) {
-                BYTE* s2 = s;
-                BYTE* s2end = s2 + w * 4;
-                BYTE* d2 = d;
-                for (; s2 < s2end; s2 += 4, d2 += 3) {
-                    if (s2[3] < 0xff) {
-                        d2[0] = ((d2[0] * s2[3]) >> 8) + s2[0];
-                        d2[1] = ((d2[1] * s2[3]) >> 8) + s2[1];
-                        d2[2] = ((d2[2] * s2[3]) >> 8) + s2[2];
-                    }
-                }
-            }
-            break;
-        case MSP_RGB16:
-            for (ptrdiff_t j = 0; j < h; j++, s += src.pitch, d += dst.pitch) {
-                BYTE* s2 = s;
-                BYTE* s2end = s2 + w * 4;
-                WORD* d2 = (WORD*)d;
-                for (; s2 < s2end; s2 += 4, d2++) {
-                    if (s2[3] < 0x1f) {
-                        *d2 = (WORD)((((((*d2 & 0xf81f) * s2[3]) >> 5) + (*(DWORD*)s2 & 0xf81f)) & 0xf81f)
-                                     | (((((*d2 & 0x07e0) * s2[3]) >> 5) + (*(DWORD*)s2 & 0x07e0)) & 0x07e0));
-                    }
-                }
-            }
-            break;
-        case MSP_RGB15:
-            for (ptrdiff_t j = 0; j < h; j++, s += src.pitch, d += dst.pitch) {
-                BYTE* s2 = s;
-                BYTE* s2end = s2 + w * 4;
-                WORD* d2 = (WORD*)d;
-                for (; s2 < s2end; s2 += 4, d2++) {
-                    if (s2[3] < 0x1f) {
-                        *d2 = (WORD)((((((*d2 & 0x7c1f) * s2[3]) >> 5) + (*(DWORD*)s2 & 0x7c1f)) & 0x7c1f)
-                                     | (((((*d2 & 0x03e0) * s2[3]) >> 5) + (*(DWORD*)s2 & 0x03e0)) & 0x03e0));
-                    }
-                }
-            }
-            break;
-        case MSP_YUY2: {
-#ifdef _WIN64
-            auto alphablt_func = AlphaBlt_YUY2_SSE2;
-#else
-            auto alphablt_func = AlphaBlt_YUY2_MMX;
-#endif
-            //alphablt_func = AlphaBlt_YUY2_C;
-
-            alphablt_func(w, h, d, dst.pitch, s, src.pitch);
+    // Calls f(x, count) for each run of pixels of row y worth blending, x being relative to rs.left
+    const bool bUseRunMap = m_runMap.Covers(rs);
+    const int align = (dst.type == MSP_YUY2 || bPlanar) ? 2 : 1;
+    auto forEachRun = [&](int y, auto && f) {
+        if (!bUseRunMap) {
+            f(0, w);
+            return;
         }
-        break;
-        case MSP_YV12:
-        case MSP_IYUV:
-            for (ptrdiff_t j = 0; j < h; j++, s += src.pitch, d += dst.pitch) {
-                BYTE* s2 = s;
-                BYTE* s2end = s2 + w * 4;
-                BYTE* d2 = d;
-                for (; s2 < s2end; s2 += 4, d2++) {
-                    if (s2[3] < 0xff) {
-                        d2[0] = (((d2[0] - 0x10) * s2[3]) >> 8) + s2[1];
-                    }
-                }
+        size_t nRuns;
+        const auto* pRuns = m_runMap.GetRuns(y, nRuns);
+        for (size_t i = 0; i < nRuns; i++) {
+            int left = (std::max(pRuns[i].first, int(rs.left)) - int(rs.left)) & ~(align - 1);
+            int right = std::min(w, (std::min(pRuns[i].second, int(rs.right)) - int(rs.left) + align - 1) & ~(align - 1));
+            if (left < right) {
+                f(left, right - left);
             }
-            break;
-        default:
-            return E_NOTIMPL;
+        }
+    };
+
+    // TODO: m_bInvAlpha support
+    for (ptrdiff_t j = 0; j < h; j++, s += src.pitch, d += dst.pitch) {
+        forEachRun(rs.top + int(j), [&](int x, int count) {
+            alphaBltRow(d + x * dstPixelSize, s + x * 4, count);
+        });
     }
 
     dst.pitch = abs(dst.pitch);
 
-    if (dst.type == MSP_YV12 || dst.type == MSP_IYUV) {
+    if (bPlanar) {
         int h2 = h / 2;
 
         if (!dst.pitchUV) {
             dst.pitchUV = dst.pitch / 2;
         }
 
-        BYTE* ss[2];
-        ss[0] = src.bits + src.pitch * rs.top + rs.left * 4;
-        ss[1] = ss[0] + 4;
-
         if (!dst.bitsU || !dst.bitsV) {
             dst.bitsU = dst.bits + dst.pitch * dst.h;
             dst.bitsV = dst.bitsU + dst.pitchUV * dst.h / 2;
@@ -593,32 +1084,24 @@ STDMETHODIMP CMemSubPic::AlphaBlt(RECT* pSrc, RECT* pDst, SubPicDesc* pTarget)
             }
         }
 
-        BYTE* dd[2];
-        dd[0] = dst.bitsU + dst.pitchUV * rd.top / 2 + rd.left / 2;
-        dd[1] = dst.bitsV + dst.pitchUV * rd.top / 2 + rd.left / 2;
+        BYTE* du = dst.bitsU + dst.pitchUV * rd.top / 2 + rd.left / 2;
+        BYTE* dv = dst.bitsV + dst.pitchUV * rd.top / 2 + rd.left / 2;
 
         if (rd.top > rd.bottom) {
-            dd[0] = dst.bitsU + dst.pitchUV * (rd.top / 2 - 1) + rd.left / 2;
-            dd[1] = dst.bitsV + dst.pitchUV * (rd.top / 2 - 1) + rd.left / 2;
+            du = dst.bitsU + dst.pitchUV * (rd.top / 2 - 1) + rd.left / 2;
+            dv = dst.bitsV + dst.pitchUV * (rd.top / 2 - 1) + rd.left / 2;
             dst.pitchUV = -dst.pitchUV;
         }
 
-        for (ptrdiff_t i = 0; i < 2; i++) {
-            s = ss[i];
-            d = dd[i];
-            BYTE* is = ss[1 - i];
-            for (ptrdiff_t j = 0; j < h2; j++, s += src.pitch * 2, d += dst.pitchUV, is += src.pitch * 2) {
-                BYTE* s2 = s;
-                BYTE* s2end = s2 + w * 4;
-                BYTE* d2 = d;
-                BYTE* is2 = is;
-                for (; s2 < s2end; s2 += 8, d2++, is2 += 8) {
-                    unsigned int ia = (s2[3] + s2[3 + src.pitch] + is2[3] + is2[3 + src.pitch]) >> 2;
-                    if (ia < 0xff) {
-                        *d2 = BYTE((((*d2 - 0x80) * ia) >> 8) + ((s2[0] + s2[src.pitch]) >> 1));
-                    }
-                }
-            }
+        AlphaBltChromaFunc alphaBltChroma = GetAlphaBltChromaFunc(kernel);
+        const int w2 = (w + 1) / 2;
+
+        s = src.bits + src.pitch * rs.top + rs.left * 4;
+        for (ptrdiff_t j = 0; j < h2; j++, s += src.pitch * 2, du += dst.pitchUV, dv += dst.pitchUV) {
+            forEachRun(rs.top + int(j) * 2, [&](int x, int count) {
+                int x2 = x / 2;
+                alphaBltChroma(du + x2, dv + x2, s + x2 * 8, src.pitch, std::min(w2, (x + count + 1) / 2) - x2);
+            });
         }
     }
 
@@ -633,6 +1116,10 @@ CMemSubPicAllocator::CMemSubPicAllocator(int type, SIZE maxsize)
     : CSubPicAllocatorImpl(maxsize, false)
     , m_type(type)
     , m_maxsize(maxsize)
+    , m_nMemoryLimit(0)
+    , m_nUsedBytes(0)
+    , m_nPooledBytes(0)
+    , m_nPeakBytes(0)
 {
 }
 
@@ -640,8 +1127,35 @@ CMemSubPicAllocator::~CMemSubPicAllocator()
 {
     CAutoLock cAutoLock(this);
 
-    for (const auto& p : m_freeMemoryChunks) {
-        delete[] std::get<1>(p);
+    ASSERT(m_nUsedBytes == 0);
+    TRACE(_T("CMemSubPicAllocator: peak memory usage %Iu KB\n"), m_nPeakBytes >> 10);
+    TrimPool(SIZE_MAX);
+}
+
+size_t CMemSubPicAllocator::GetSizeClass(size_t size)
+{
+    // Round up to a quarter of the next power of two, but at least
+    // to 64 KB, which keeps the waste under 25% and the number of
+    // classes low since the surfaces only change size with the video.
+    size_t granularity = 64 * 1024;
+    while (granularity * 8 < size) {
+        granularity <<= 1;
+    }
+    return (size + granularity - 1) & ~(granularity - 1);
+}
+
+void CMemSubPicAllocator::TrimPool(size_t nBytesNeeded)
+{
+    // Called with the lock held
+    for (auto it = m_freeMemoryChunks.begin(); it != m_freeMemoryChunks.end() && nBytesNeeded > 0;) {
+        auto& chunks = it->second;
+        while (!chunks.empty() && nBytesNeeded > 0) {
+            _aligned_free(chunks.back());
+            chunks.pop_back();
+            m_nPooledBytes -= it->first;
+            nBytesNeeded = nBytesNeeded > it->first ? nBytesNeeded - it->first : 0;
+        }
+        it = chunks.empty() ? m_freeMemoryChunks.erase(it) : std::next(it);
     }
 }
 
@@ -657,7 +1171,7 @@ bool CMemSubPicAllocator::Alloc(bool fStatic, ISubPic** ppSubPic)
     spd.w = m_maxsize.cx;
     spd.h = m_maxsize.cy;
     spd.bpp = 32;
-    spd.pitch = (spd.w * spd.bpp) >> 3;
+    spd.pitch = GetAlignedPitch(spd.w, spd.bpp);
     spd.type = m_type;
     spd.vidrect = m_curvidrect;
 
@@ -669,7 +1183,7 @@ bool CMemSubPicAllocator::Alloc(bool fStatic, ISubPic** ppSubPic)
         *ppSubPic = DEBUG_NEW CMemSubPic(spd, this);
     } catch (CMemoryException* e) {
         e->Delete();
-        delete [] spd.bits;
+        FreeSpdBits(spd);
         return false;
     }
 
@@ -685,22 +1199,36 @@ bool CMemSubPicAllocator::AllocSpdBits(SubPicDesc& spd)
     ASSERT(!spd.bits);
     ASSERT(spd.pitch * spd.h > 0);
 
-    auto it = std::find_if(m_freeMemoryChunks.cbegin(), m_freeMemoryChunks.cend(), [&](const std::pair<size_t, BYTE*>& p) {
-        return std::get<0>(p) == size_t(spd.pitch) * spd.h;
-    });
+    const size_t size = GetSizeClass(size_t(spd.pitch) * spd.h);
 
-    if (it != m_freeMemoryChunks.cend()) {
-        spd.bits = std::get<1>(*it);
-        m_freeMemoryChunks.erase(it);
+    auto it = m_freeMemoryChunks.find(size);
+    if (it != m_freeMemoryChunks.end() && !it->second.empty()) {
+        spd.bits = it->second.back();
+        it->second.pop_back();
+        m_nPooledBytes -= size;
     } else {
-        try {
-            spd.bits = DEBUG_NEW BYTE[spd.pitch * spd.h];
-        } catch (CMemoryException* e) {
+        if (m_nMemoryLimit) {
+            // Make room by dropping surfaces of other sizes first
+            size_t nTotal = m_nUsedBytes + m_nPooledBytes + size;
+            if (nTotal > m_nMemoryLimit) {
+                TrimPool(nTotal - m_nMemoryLimit);
+            }
+            if (m_nUsedBytes + m_nPooledBytes + size > m_nMemoryLimit) {
+                TRACE(_T("CMemSubPicAllocator: memory limit of %Iu KB reached\n"), m_nMemoryLimit >> 10);
+                return false;
+            }
+        }
+
+        spd.bits = (BYTE*)_aligned_malloc(size, ROW_ALIGNMENT);
+        if (!spd.bits) {
             ASSERT(FALSE);
-            e->Delete();
             return false;
         }
     }
+
+    m_nUsedBytes += size;
+    m_nPeakBytes = std::max(m_nPeakBytes, m_nUsedBytes + m_nPooledBytes);
+
     return true;
 }
 
@@ -709,19 +1237,39 @@ void CMemSubPicAllocator::FreeSpdBits(SubPicDesc& spd)
     CAutoLock cAutoLock(this);
 
     ASSERT(spd.bits);
-    m_freeMemoryChunks.emplace_back(spd.pitch * spd.h, spd.bits);
+    const size_t size = GetSizeClass(size_t(spd.pitch) * spd.h);
+    m_freeMemoryChunks[size].emplace_back(spd.bits);
+    m_nUsedBytes -= size;
+    m_nPooledBytes += size;
     spd.bits = nullptr;
 }
 
+void CMemSubPicAllocator::SetMemoryLimit(size_t nMaxBytes)
+{
+    CAutoLock cAutoLock(this);
+
+    m_nMemoryLimit = nMaxBytes;
+    if (m_nMemoryLimit && m_nUsedBytes + m_nPooledBytes > m_nMemoryLimit) {
+        TrimPool(m_nUsedBytes + m_nPooledBytes - m_nMemoryLimit);
+    }
+}
+
+void CMemSubPicAllocator::GetMemoryStats(size_t& nCurrentBytes, size_t& nPeakBytes, size_t& nPooledBytes)
+{
+    CAutoLock cAutoLock(this);
+
+    nCurrentBytes = m_nUsedBytes + m_nPooledBytes;
+    nPeakBytes = m_nPeakBytes;
+    nPooledBytes = m_nPooledBytes;
+}
+
 STDMETHODIMP CMemSubPicAllocator::SetMaxTextureSize(SIZE maxTextureSize)
 {
     if (m_maxsize != maxTextureSize) {
         m_maxsize = maxTextureSize;
         CAutoLock cAutoLock(this);
-        for (const auto& p : m_freeMemoryChunks) {
-            delete[] std::get<1>(p);
-        }
-        m_freeMemoryChunks.clear();
+        // Surfaces of the old size are not going to be requested again
+        TrimPool(SIZE_MAX);
     }
     return S_OK;
 }
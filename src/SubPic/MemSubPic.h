@@ -22,6 +22,7 @@
 #pragma once
 
 #include "SubPicImpl.h"
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -37,19 +38,56 @@ enum {
     MSP_RGBA
 };
 
+// CMemSubPicRunMap
+
+// Horizontal runs of visible pixels of a subpic, built when it is unlocked
+// so that AlphaBlt can skip the fully transparent parts of each row
+class CMemSubPicRunMap
+{
+    CRect m_rect;
+    int m_nGroupRows = 1;
+    std::vector<size_t> m_rowGroups; // index of the first run of each row group
+    std::vector<std::pair<int, int>> m_runs; // [left, right) in subpic coordinates
+
+public:
+    void Build(const SubPicDesc& spd, const CRect& rect);
+    void Reset();
+
+    // True if the runs can be used for the rows of r
+    bool Covers(const CRect& r) const;
+    // Runs of the row group containing row y, y being inside the map
+    const std::pair<int, int>* GetRuns(int y, size_t& nRuns) const;
+};
+
 // CMemSubPic
 class CMemSubPicAllocator;
 class CMemSubPic : public CSubPicImpl
 {
+public:
+    enum class AlphaBltKernel {
+        C,
+        SSE2, // MMX for YUY2 on x86
+        SSE41,
+        AVX2
+    };
+
+private:
     CComPtr<CMemSubPicAllocator> m_pAllocator;
 
     SubPicDesc m_spd;
     std::unique_ptr<SubPicDesc> m_resizedSpd;
+    CMemSubPicRunMap m_runMap;
+
+    static AlphaBltKernel s_maxAlphaBltKernel;
 
 protected:
     STDMETHODIMP_(void*) GetObject(); // returns SubPicDesc*
 
 public:
+    // Caps the kernel picked at runtime, to compare the output of the kernels
+    static void SetMaxAlphaBltKernel(AlphaBltKernel kernel);
+    static AlphaBltKernel GetAlphaBltKernel();
+
     CMemSubPic(const SubPicDesc& spd, CMemSubPicAllocator* pAllocator);
     virtual ~CMemSubPic();
 
@@ -69,16 +107,36 @@ class CMemSubPicAllocator : public CSubPicAllocatorImpl, public CCritSec
     int m_type;
     CSize m_maxsize;
 
-    std::vector<std::pair<size_t, BYTE*>> m_freeMemoryChunks;
+    // Released surfaces are kept per size class so that they can be
+    // handed out again without going back to the heap.
+    std::map<size_t, std::vector<BYTE*>> m_freeMemoryChunks;
+    size_t m_nMemoryLimit;
+    size_t m_nUsedBytes;
+    size_t m_nPooledBytes;
+    size_t m_nPeakBytes;
+
+    static size_t GetSizeClass(size_t size);
+    void TrimPool(size_t nBytesNeeded);
 
     bool Alloc(bool fStatic, ISubPic** ppSubPic);
 
 public:
+    enum { ROW_ALIGNMENT = 64 };
+
     CMemSubPicAllocator(int type, SIZE maxsize);
     virtual ~CMemSubPicAllocator();
 
+    static int GetAlignedPitch(int w, int bpp) {
+        return (((w * bpp) >> 3) + ROW_ALIGNMENT - 1) & ~(ROW_ALIGNMENT - 1);
+    }
+
     bool AllocSpdBits(SubPicDesc& spd);
     void FreeSpdBits(SubPicDesc& spd);
 
+    // nMaxBytes == 0 means no limit
+    void SetMemoryLimit(size_t nMaxBytes);
+    // nCurrentBytes includes the surfaces kept in the pool
+    void GetMemoryStats(size_t& nCurrentBytes, size_t& nPeakBytes, size_t& nPooledBytes);
+
     STDMETHODIMP SetMaxTextureSize(SIZE maxTextureSize) override;
 };
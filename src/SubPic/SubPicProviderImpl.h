@@ -23,7 +23,7 @@
 
 #include "ISubPic.h"
 
-class CSubPicProviderImpl : public CUnknown, public ISubPicProvider
+class CSubPicProviderImpl : public CUnknown, public ISubPicProviderEx
 {
 protected:
     CCritSec* m_pLock;
@@ -49,4 +49,8 @@ public:
     STDMETHODIMP Render(SubPicDesc& spd, REFERENCE_TIME rt, double fps, RECT& bbox) PURE;
     STDMETHODIMP GetTextureSize(POSITION pos, SIZE& MaxTextureSize, SIZE& VirtualSize, POINT& VirtualTopLeft) { return E_NOTIMPL; };
     STDMETHODIMP GetRelativeTo(POSITION pos, RelativeTo& relativeTo) { relativeTo = WINDOW; return S_OK; };
+
+    // ISubPicProviderEx, only exposed by the providers which implement it
+
+    STDMETHODIMP RenderUpdate(SubPicDesc& spd, REFERENCE_TIME rt, double fps, DWORD clearColor, RECT& bbox, RECT& rcUpdate) { return E_NOTIMPL; };
 };
@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <intsafe.h>
 #include "SubPicQueueImpl.h"
+#include "MemSubPic.h"
 #include "../DSUtil/DSUtil.h"
 
 #define SUBPIC_TRACE_LEVEL 0
@@ -42,6 +43,12 @@ CSubPicQueueImpl::CSubPicQueueImpl(SubPicQueueSettings settings, ISubPicAllocato
     , m_rtNow(0)
     , m_settings(settings)
     , m_pAllocator(pAllocator)
+    , m_pLastRenderedSubPic(nullptr)
+    , m_pLastRenderedSubPicProvider(nullptr)
+    , m_rcLastRenderedDirty(0, 0, 0, 0)
+    , m_nRenderCount(0)
+    , m_rtLastLookup(0)
+    , m_rtMaxLookup(0)
 {
     if (phr) {
         *phr = S_OK;
@@ -107,9 +114,30 @@ STDMETHODIMP CSubPicQueueImpl::SetTime(REFERENCE_TIME rtNow)
     return S_OK;
 }
 
+STDMETHODIMP CSubPicQueueImpl::GetLookupStats(REFERENCE_TIME& rtLastLookup, REFERENCE_TIME& rtMaxLookup)
+{
+    rtLastLookup = m_rtLastLookup;
+    rtMaxLookup = m_rtMaxLookup;
+
+    return S_OK;
+}
+
 // private
 
-HRESULT CSubPicQueueImpl::RenderTo(ISubPic* pSubPic, REFERENCE_TIME rtStart, REFERENCE_TIME rtStop, double fps, BOOL bIsAnimated)
+void CSubPicQueueImpl::UpdateLookupStats(std::chrono::steady_clock::time_point lookupStart)
+{
+    // In 100ns units like the other timings
+    REFERENCE_TIME rtLookup = std::chrono::duration_cast<std::chrono::duration<REFERENCE_TIME, std::ratio<1, 10000000>>>(
+                                  std::chrono::steady_clock::now() - lookupStart).count();
+
+    m_rtLastLookup = rtLookup;
+    // Only the presenter thread updates the stats so no need for a compare-and-swap loop
+    if (rtLookup > m_rtMaxLookup) {
+        m_rtMaxLookup = rtLookup;
+    }
+}
+
+HRESULT CSubPicQueueImpl::RenderTo(ISubPic* pSubPic, REFERENCE_TIME rtStart, REFERENCE_TIME rtStop, double fps, BOOL bIsAnimated, bool bAllowUpdate /*= true*/)
 {
     CheckPointer(pSubPic, E_POINTER);
 
@@ -119,32 +147,83 @@ HRESULT CSubPicQueueImpl::RenderTo(ISubPic* pSubPic, REFERENCE_TIME rtStart, REF
         return hr;
     }
 
-    if (pSubPic->GetInverseAlpha()) {
-        hr = pSubPic->ClearDirtyRect(0x00000000);
+    REFERENCE_TIME rtRender;
+    if (bIsAnimated) {
+        // This is some sort of hack to avoid rendering the wrong frame
+        // when the start time is slightly mispredicted by the queue
+        rtRender = (rtStart + rtStop) / 2;
     } else {
-        hr = pSubPic->ClearDirtyRect(0xFF000000);
+        rtRender = rtStart + std::llround((rtStop - rtStart - 1) * m_settings.nRenderAtWhenAnimationIsDisabled / 100.0);
     }
 
+    DWORD clearColor = pSubPic->GetInverseAlpha() ? 0x00000000 : 0xFF000000;
+
+    // Animated subtitles are rendered in the same static subpic frame after frame
+    // so the provider can usually just update the picture it rendered last time.
+    // The memory subpics convert their content in place when they are unlocked
+    // so only the RGB32 ones still hold the picture as it was rendered.
+    // Only the provider calls are made with m_mutexRender held, the subpic is
+    // cleared, locked and unlocked outside of it.
     SubPicDesc spd;
-    if (SUCCEEDED(hr)) {
-        hr = pSubPic->Lock(spd);
-    }
-    if (SUCCEEDED(hr)) {
-        CRect r(0, 0, 0, 0);
-        REFERENCE_TIME rtRender;
-        if (bIsAnimated) {
-            // This is some sort of hack to avoid rendering the wrong frame
-            // when the start time is slightly mispredicted by the queue
-            rtRender = (rtStart + rtStop) / 2;
-        } else {
-            rtRender = rtStart + std::llround((rtStop - rtStart - 1) * m_settings.nRenderAtWhenAnimationIsDisabled / 100.0);
+    CRect rcDirty;
+    CComQIPtr<ISubPicProviderEx> pSubPicProviderEx = pSubPicProvider;
+    bool bCanUpdate = bAllowUpdate && bIsAnimated && pSubPicProviderEx
+                      && SUCCEEDED(pSubPic->GetDirtyRect(rcDirty))
+                      && SUCCEEDED(pSubPic->GetDesc(spd)) && spd.type == MSP_RGB32 && spd.bpp == 32;
+
+    CRect r(0, 0, 0, 0);
+    bool bLocked = false;
+    ULONGLONG nRender = 0;
+
+    if (bCanUpdate && SUCCEEDED(pSubPic->Lock(spd))) {
+        {
+            // The provider must still hold what it rendered in this subpic
+            std::lock_guard<std::mutex> lock(m_mutexRender);
+            if (pSubPic == m_pLastRenderedSubPic && pSubPicProvider == m_pLastRenderedSubPicProvider
+                    && rcDirty == m_rcLastRenderedDirty) {
+                CRect rcUpdate;
+                hr = pSubPicProviderEx->RenderUpdate(spd, rtRender, fps, clearColor, r, rcUpdate);
+                bLocked = SUCCEEDED(hr);
+                nRender = ++m_nRenderCount;
+            }
+            m_pLastRenderedSubPic = nullptr;
+            m_pLastRenderedSubPicProvider = nullptr;
         }
-        hr = pSubPicProvider->Render(spd, rtRender, fps, r);
+        if (!bLocked) {
+            pSubPic->Unlock(rcDirty);
+        }
+    }
+
+    if (!bLocked) {
+        hr = pSubPic->ClearDirtyRect(clearColor);
+        if (SUCCEEDED(hr)) {
+            hr = pSubPic->Lock(spd);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutexRender);
+        m_pLastRenderedSubPic = nullptr;
+        m_pLastRenderedSubPicProvider = nullptr;
+        if (SUCCEEDED(hr)) {
+            bLocked = true;
+            hr = pSubPicProvider->Render(spd, rtRender, fps, r);
+            nRender = ++m_nRenderCount;
+        }
+    }
 
+    if (bLocked) {
         pSubPic->SetStart(rtStart);
         pSubPic->SetStop(rtStop);
-
         pSubPic->Unlock(r);
+
+        if (bAllowUpdate && SUCCEEDED(hr) && SUCCEEDED(pSubPic->GetDirtyRect(rcDirty))) {
+            std::lock_guard<std::mutex> lock(m_mutexRender);
+            // Another thread might have used the provider while the subpic was unlocked
+            if (nRender == m_nRenderCount) {
+                m_pLastRenderedSubPic = pSubPic;
+                m_pLastRenderedSubPicProvider = pSubPicProvider;
+                m_rcLastRenderedDirty = rcDirty;
+            }
+        }
     }
 
     return hr;
@@ -157,9 +236,14 @@ HRESULT CSubPicQueueImpl::RenderTo(ISubPic* pSubPic, REFERENCE_TIME rtStart, REF
 CSubPicQueue::CSubPicQueue(SubPicQueueSettings settings, ISubPicAllocator* pAllocator, HRESULT* phr)
     : CSubPicQueueImpl(settings, pAllocator, phr)
     , m_bExitThread(false)
+    , m_nQueueCapacity(0)
+    , m_nQueueHead(0)
+    , m_nQueueTail(0)
+    , m_bWaitingForRoom(false)
     , m_rtNowLast(LONGLONG_ERROR)
     , m_bInvalidate(false)
     , m_rtInvalidate(0)
+    , m_posRenderFailed(nullptr)
 {
     if (phr && FAILED(*phr)) {
         return;
@@ -172,6 +256,17 @@ CSubPicQueue::CSubPicQueue(SubPicQueueSettings settings, ISubPicAllocator* pAllo
         return;
     }
 
+    // Invalidate doesn't free the slots so twice the queue size are needed
+    // to be able to render new subpics before the dropped ones are skipped
+    m_nQueueCapacity = 2 * size_t(m_settings.nSize);
+    m_queue.reset(DEBUG_NEW QueueSlot[m_nQueueCapacity]);
+
+    // The workers need subpics they can render to directly, otherwise
+    // everything has to go through the allocator's single static subpic
+    if (m_settings.nRenderThreads != 1 && !m_pAllocator->IsDynamicWriteOnly()) {
+        m_pRenderThreadPool = std::make_unique<CThreadPool>(std::max(0, m_settings.nRenderThreads));
+    }
+
     CAMThread::Create();
 }
 
@@ -240,15 +335,15 @@ STDMETHODIMP CSubPicQueue::Invalidate(REFERENCE_TIME rtInvalidate /*= -1*/)
         }
     }
 
-    while (!m_queue.IsEmpty() && m_queue.GetTail()->GetStop() > rtInvalidate) {
+    // LookupSubPic might be using the subpics so they are only marked as dropped
+    for (ULONGLONG i = m_nQueueHead, nTail = m_nQueueTail; i < nTail; i++) {
+        QueueSlot& slot = m_queue[i % m_nQueueCapacity];
+        if (slot.rtStop > rtInvalidate) {
 #if SUBPIC_TRACE_LEVEL > 2
-        const CComPtr<ISubPic>& pSubPic = m_queue.GetTail();
-        REFERENCE_TIME rtStart = pSubPic->GetStart();
-        REFERENCE_TIME rtStop = pSubPic->GetStop();
-        REFERENCE_TIME rtSegmentStop = pSubPic->GetSegmentStop();
-        TRACE(_T("  %f -> %f -> %f\n"), double(rtStart) / 10000000.0, double(rtStop) / 10000000.0, double(rtSegmentStop) / 10000000.0);
+            TRACE(_T("  %f -> %f\n"), double(slot.rtStart) / 10000000.0, double(slot.rtStop) / 10000000.0);
 #endif
-        m_queue.RemoveTailNoReturn();
+            slot.bDropped = true;
+        }
     }
 
     // If we invalidate in the past, always give the queue a chance to re-render the modified subtitles
@@ -271,6 +366,7 @@ STDMETHODIMP_(bool) CSubPicQueue::LookupSubPic(REFERENCE_TIME rtNow, CComPtr<ISu
 
 STDMETHODIMP_(bool) CSubPicQueue::LookupSubPic(REFERENCE_TIME rtNow, bool bAdviseBlocking, CComPtr<ISubPic>& ppSubPic)
 {
+    const auto lookupStart = std::chrono::steady_clock::now();
     bool bStopSearch = false;
 
     {
@@ -307,21 +403,28 @@ STDMETHODIMP_(bool) CSubPicQueue::LookupSubPic(REFERENCE_TIME rtNow, bool bAdvis
     while (!bStopSearch) {
         // Look for the subpic in the queue
         {
-            std::unique_lock<std::mutex> lock(m_mutexQueue);
-
 #if SUBPIC_TRACE_LEVEL > 2
             TRACE(_T("LookupSubPic: Searching the queue\n"));
 #endif
 
-            while (!m_queue.IsEmpty() && !bStopSearch) {
-                const CComPtr<ISubPic>& pSubPic = m_queue.GetHead();
-                REFERENCE_TIME rtSegmentStart = pSubPic->GetSegmentStart();
+            bool bRemovedFromQueue = false;
+            ULONGLONG nHead = m_nQueueHead;
+            const ULONGLONG nTail = m_nQueueTail;
 
-                if (rtSegmentStart > rtNow) {
+            for (; nHead < nTail && !bStopSearch; nHead++) {
+                QueueSlot& slot = m_queue[nHead % m_nQueueCapacity];
+                const CComPtr<ISubPic>& pSubPic = slot.pSubPic;
+
+                if (slot.bDropped) {
+#if SUBPIC_TRACE_LEVEL > 2
+                    TRACE(_T("Removing invalidated subpic\n"));
+#endif
+                } else if (pSubPic->GetSegmentStart() > rtNow) {
 #if SUBPIC_TRACE_LEVEL > 2
                     TRACE(_T("rtSegmentStart > rtNow, stopping the search\n"));
 #endif
                     bStopSearch = true;
+                    break;
                 } else { // rtSegmentStart <= rtNow
                     bool bRemoveFromQueue = true;
                     REFERENCE_TIME rtStart = pSubPic->GetStart();
@@ -356,14 +459,24 @@ STDMETHODIMP_(bool) CSubPicQueue::LookupSubPic(REFERENCE_TIME rtNow, bool bAdvis
                         }
                     }
 
-                    if (bRemoveFromQueue) {
-                        m_queue.RemoveHeadNoReturn();
+                    if (!bRemoveFromQueue) {
+                        break;
                     }
                 }
+
+                // The slot is handed back to the producer once the head moves past it
+                slot.pSubPic.Release();
+                m_nQueueHead = nHead + 1;
+                bRemovedFromQueue = true;
             }
 
-            lock.unlock();
-            m_condQueueFull.notify_one();
+            if (bRemovedFromQueue) {
+                // Only synchronize with the producer when it is waiting for some room
+                if (m_bWaitingForRoom) {
+                    std::lock_guard<std::mutex> lock(m_mutexQueue);
+                }
+                m_condQueueFull.notify_one();
+            }
         }
 
         // If we didn't get any subpic yet and blocking is advised, just try harder to get one
@@ -388,8 +501,9 @@ STDMETHODIMP_(bool) CSubPicQueue::LookupSubPic(REFERENCE_TIME rtNow, bool bAdvis
                     std::unique_lock<std::mutex> lock(m_mutexQueue);
 
                     auto queueReady = [this, rtNow]() {
-                        return ((int)m_queue.GetCount() == m_settings.nSize)
-                               || (!m_queue.IsEmpty() && m_queue.GetTail()->GetStop() > rtNow);
+                        const QueueSlot* pLastSlot = GetLastQueueSlot();
+                        return ((int)GetQueueCount() == m_settings.nSize)
+                               || (pLastSlot && pLastSlot->rtStop > rtNow);
                     };
 
                     m_condQueueReady.wait(lock, queueReady);
@@ -421,6 +535,8 @@ STDMETHODIMP_(bool) CSubPicQueue::LookupSubPic(REFERENCE_TIME rtNow, bool bAdvis
 #endif
     }
 
+    UpdateLookupStats(lookupStart);
+
     return !!ppSubPic;
 }
 
@@ -428,13 +544,17 @@ STDMETHODIMP CSubPicQueue::GetStats(int& nSubPics, REFERENCE_TIME& rtNow, REFERE
 {
     std::lock_guard<std::mutex> lock(m_mutexQueue);
 
-    nSubPics = (int)m_queue.GetCount();
+    nSubPics = 0;
     rtNow = m_rtNow;
-    if (nSubPics) {
-        rtStart = m_queue.GetHead()->GetStart();
-        rtStop = m_queue.GetTail()->GetStop();
-    } else {
-        rtStart = rtStop = 0;
+    rtStart = rtStop = 0;
+    for (ULONGLONG i = m_nQueueHead, nTail = m_nQueueTail; i < nTail; i++) {
+        const QueueSlot& slot = m_queue[i % m_nQueueCapacity];
+        if (!slot.bDropped) {
+            if (!nSubPics++) {
+                rtStart = slot.rtStart;
+            }
+            rtStop = slot.rtStop;
+        }
     }
 
     return S_OK;
@@ -445,18 +565,15 @@ STDMETHODIMP CSubPicQueue::GetStats(int nSubPic, REFERENCE_TIME& rtStart, REFERE
     std::lock_guard<std::mutex> lock(m_mutexQueue);
 
     HRESULT hr = E_INVALIDARG;
+    rtStart = rtStop = -1;
 
-    if (nSubPic >= 0 && nSubPic < (int)m_queue.GetCount()) {
-        if (POSITION pos = m_queue.FindIndex(nSubPic)) {
-            rtStart = m_queue.GetAt(pos)->GetStart();
-            rtStop = m_queue.GetAt(pos)->GetStop();
+    for (ULONGLONG i = m_nQueueHead, nTail = m_nQueueTail; i < nTail && nSubPic >= 0; i++) {
+        const QueueSlot& slot = m_queue[i % m_nQueueCapacity];
+        if (!slot.bDropped && nSubPic-- == 0) {
+            rtStart = slot.rtStart;
+            rtStop = slot.rtStop;
             hr = S_OK;
-        } else {
-            // Can't happen
-            ASSERT(FALSE);
         }
-    } else {
-        rtStart = rtStop = -1;
     }
 
     return hr;
@@ -464,37 +581,129 @@ STDMETHODIMP CSubPicQueue::GetStats(int nSubPic, REFERENCE_TIME& rtStart, REFERE
 
 // private
 
+size_t CSubPicQueue::GetQueueCount() const
+{
+    size_t nCount = 0;
+
+    for (ULONGLONG i = m_nQueueHead, nTail = m_nQueueTail; i < nTail; i++) {
+        if (!m_queue[i % m_nQueueCapacity].bDropped) {
+            nCount++;
+        }
+    }
+
+    return nCount;
+}
+
+bool CSubPicQueue::CanAddToQueue() const
+{
+    return m_nQueueTail - m_nQueueHead < m_nQueueCapacity
+           && (int)GetQueueCount() < m_settings.nSize;
+}
+
+CSubPicQueue::QueueSlot* CSubPicQueue::GetLastQueueSlot() const
+{
+    for (ULONGLONG i = m_nQueueTail, nHead = m_nQueueHead; i > nHead; i--) {
+        QueueSlot& slot = m_queue[(i - 1) % m_nQueueCapacity];
+        if (!slot.bDropped) {
+            return &slot;
+        }
+    }
+
+    return nullptr;
+}
+
 bool CSubPicQueue::EnqueueSubPic(CComPtr<ISubPic>& pSubPic, bool bBlocking)
 {
-    auto canAddToQueue = [this]() {
-        return (int)m_queue.GetCount() < m_settings.nSize;
+    auto isInvalidated = [this, &pSubPic]() {
+        return m_bInvalidate && pSubPic->GetStop() > m_rtInvalidate;
     };
 
     bool bAdded = false;
 
     std::unique_lock<std::mutex> lock(m_mutexQueue);
     if (bBlocking) {
-        // Wait for enough room in the queue
-        m_condQueueFull.wait(lock, canAddToQueue);
+        // Wait for enough room in the queue, LookupSubPic only
+        // takes the lock to wake us up when this flag is set
+        m_bWaitingForRoom = true;
+        m_condQueueFull.wait(lock, [&]() { return CanAddToQueue() || isInvalidated(); });
+        m_bWaitingForRoom = false;
     }
 
-    if (canAddToQueue()) {
-        if (m_bInvalidate && pSubPic->GetStop() > m_rtInvalidate) {
+    if (isInvalidated()) {
 #if SUBPIC_TRACE_LEVEL > 1
-            TRACE(_T("Subtitle Renderer Thread: Dropping rendered subpic because of invalidation\n"));
+        TRACE(_T("Subtitle Renderer Thread: Dropping rendered subpic because of invalidation\n"));
 #endif
-        } else {
-            m_queue.AddTail(pSubPic);
-            lock.unlock();
-            m_condQueueReady.notify_one();
-            bAdded = true;
-        }
+        pSubPic.Release();
+    } else if (CanAddToQueue()) {
+        const ULONGLONG nTail = m_nQueueTail;
+        QueueSlot& slot = m_queue[nTail % m_nQueueCapacity];
+        slot.pSubPic = pSubPic;
+        slot.rtStart = pSubPic->GetStart();
+        slot.rtStop = pSubPic->GetStop();
+        slot.bDropped = false;
+        // Publish the subpic to LookupSubPic
+        m_nQueueTail = nTail + 1;
+
+        lock.unlock();
+        m_condQueueReady.notify_one();
+        bAdded = true;
         pSubPic.Release();
     }
 
     return bAdded;
 }
 
+void CSubPicQueue::SubmitRenderJob(const std::shared_ptr<RenderJob>& pJob)
+{
+    m_renderJobs.emplace_back(pJob);
+
+    m_pRenderThreadPool->Submit([this, pJob] {
+        HRESULT hr = RenderTo(pJob->pSubPic, pJob->rtStart, pJob->rtStop, pJob->fps, pJob->bIsAnimated, false);
+        {
+            std::lock_guard<std::mutex> lock(m_mutexRenderJobs);
+            pJob->hr = hr;
+            pJob->bDone = true;
+        }
+        m_condRenderJobDone.notify_all();
+    });
+}
+
+void CSubPicQueue::WaitForRenderJob(const std::shared_ptr<RenderJob>& pJob)
+{
+    std::unique_lock<std::mutex> lock(m_mutexRenderJobs);
+    m_condRenderJobDone.wait(lock, [&pJob] { return pJob->bDone; });
+}
+
+bool CSubPicQueue::CommitRenderJobs(size_t nMaxPending)
+{
+    while (m_renderJobs.size() > nMaxPending) {
+        const auto& pJob = m_renderJobs.front();
+        WaitForRenderJob(pJob);
+
+        if (FAILED(pJob->hr)) {
+            m_posRenderFailed = pJob->pos;
+        } else if (pJob->pos != m_posRenderFailed) {
+#if SUBPIC_TRACE_LEVEL > 1
+            CRect r;
+            pJob->pSubPic->GetDirtyRect(&r);
+            TRACE(_T("Subtitle Renderer Thread: Rendered %f -> %f (%dx%d)\n"),
+                  double(pJob->pSubPic->GetStart()) / 10000000.0, double(pJob->pSubPic->GetStop()) / 10000000.0,
+                  r.Width(), r.Height());
+#endif
+            // Keep the subpic pending if there is no room left for it
+            if (!EnqueueSubPic(pJob->pSubPic, false)) {
+                if (!pJob->pSubPic) {
+                    m_renderJobs.pop_front();
+                }
+                return false;
+            }
+        }
+        m_renderJobs.pop_front();
+    }
+
+    return true;
+}
+
 REFERENCE_TIME CSubPicQueue::GetCurrentRenderingTime()
 {
     REFERENCE_TIME rtNow = -1;
@@ -502,8 +711,8 @@ REFERENCE_TIME CSubPicQueue::GetCurrentRenderingTime()
     {
         std::lock_guard<std::mutex> lock(m_mutexQueue);
 
-        if (!m_queue.IsEmpty()) {
-            rtNow = m_queue.GetTail()->GetStop();
+        if (const QueueSlot* pLastSlot = GetLastQueueSlot()) {
+            rtNow = pLastSlot->rtStop;
         }
     }
 
@@ -533,7 +742,9 @@ DWORD CSubPicQueue::ThreadProc()
             REFERENCE_TIME rtTimePerFrame = m_rtTimePerFrame;
             REFERENCE_TIME rtTimePerSubFrame = m_rtTimePerSubFrame;
             m_bInvalidate = false;
+            m_posRenderFailed = nullptr;
             CComPtr<ISubPic> pSubPic;
+            size_t nMaxPendingJobs = m_pRenderThreadPool ? m_pRenderThreadPool->GetThreadCount() : 0;
 
             REFERENCE_TIME rtStartRendering = GetCurrentRenderingTime();
             POSITION pos = pSubPicProvider->GetStartPosition(rtStartRendering, fps);
@@ -575,11 +786,6 @@ DWORD CSubPicQueue::ThreadProc()
                             m_pAllocator->SetMaxTextureSize(maxTextureSize);
                         }
 
-                        CComPtr<ISubPic> pStatic;
-                        if (FAILED(m_pAllocator->GetStatic(&pStatic))) {
-                            break;
-                        }
-
                         REFERENCE_TIME rtStopReal;
                         if (rtStop == ISubPicProvider::UNKNOWN_TIME) { // Special case for subtitles with unknown end time
                             // Force a one frame duration
@@ -588,60 +794,106 @@ DWORD CSubPicQueue::ThreadProc()
                             rtStopReal = rtStop;
                         }
 
-                        HRESULT hr;
+                        REFERENCE_TIME rtRenderStart, rtRenderStop, rtSegmentStart, rtSegmentStop;
                         if (bIsAnimated) {
                             // 3/4 is a magic number we use to avoid reusing the wrong frame due to slight
                             // misprediction of the frame end time
-                            hr = RenderTo(pStatic, rtCurrent, std::min(rtCurrent + rtTimePerSubFrame * 3 / 4, rtStopReal), fps, bIsAnimated);
+                            rtRenderStart = rtCurrent;
+                            rtRenderStop = std::min(rtCurrent + rtTimePerSubFrame * 3 / 4, rtStopReal);
                             // Set the segment start and stop timings
-                            pStatic->SetSegmentStart(rtStart);
+                            rtSegmentStart = rtStart;
                             // The stop timing can be moved so that the duration from the current start time
                             // of the subpic to the segment end is always at least one video frame long. This
                             // avoids missing subtitle frame due to rounding errors in the timings.
                             // At worst this can cause a segment to be displayed for one more frame than expected
                             // but it's much less annoying than having the subtitle disappearing for one frame
-                            pStatic->SetSegmentStop(std::max(rtCurrent + rtTimePerFrame, rtStopReal));
+                            rtSegmentStop = std::max(rtCurrent + rtTimePerFrame, rtStopReal);
                             rtCurrent = std::min(rtCurrent + rtTimePerSubFrame, rtStopReal);
                         } else {
-                            hr = RenderTo(pStatic, rtStart, rtStopReal, fps, bIsAnimated);
+                            rtRenderStart = rtStart;
+                            rtRenderStop = rtStopReal;
                             // Non-animated subtitles aren't part of a segment
-                            pStatic->SetSegmentStart(ISubPic::INVALID_TIME);
-                            pStatic->SetSegmentStop(ISubPic::INVALID_TIME);
+                            rtSegmentStart = rtSegmentStop = ISubPic::INVALID_TIME;
                             rtCurrent = rtStopReal;
                         }
 
-                        if (FAILED(hr)) {
-                            break;
-                        }
+                        if (m_pRenderThreadPool) {
+                            // The workers render directly in the dynamic subpics
+                            auto pJob = std::make_shared<RenderJob>();
+                            if (FAILED(m_pAllocator->AllocDynamic(&pJob->pSubPic))) {
+                                break;
+                            }
+                            pJob->pos = pos;
+                            pJob->rtStart = rtRenderStart;
+                            pJob->rtStop = rtRenderStop;
+                            pJob->fps = fps;
+                            pJob->bIsAnimated = bIsAnimated;
+                            pJob->pSubPic->SetSegmentStart(rtSegmentStart);
+                            pJob->pSubPic->SetSegmentStop(rtSegmentStop);
+
+                            if (SUCCEEDED(hr2)) {
+                                pJob->pSubPic->SetVirtualTextureSize(virtualSize, virtualTopLeft);
+                            }
+
+                            RelativeTo relativeTo;
+                            if (SUCCEEDED(pSubPicProvider->GetRelativeTo(pos, relativeTo))) {
+                                pJob->pSubPic->SetRelativeTo(relativeTo);
+                            }
+
+                            SubmitRenderJob(pJob);
+
+                            // Once all the workers are busy, wait for the oldest subpic
+                            // and stop rendering if the queue is full
+                            if (!CommitRenderJobs(nMaxPendingJobs)) {
+                                bStopRendering = true;
+                                break;
+                            }
+                            if (m_posRenderFailed == pos) {
+                                break;
+                            }
+                        } else {
+                            CComPtr<ISubPic> pStatic;
+                            if (FAILED(m_pAllocator->GetStatic(&pStatic))) {
+                                break;
+                            }
+
+                            HRESULT hr = RenderTo(pStatic, rtRenderStart, rtRenderStop, fps, bIsAnimated);
+                            pStatic->SetSegmentStart(rtSegmentStart);
+                            pStatic->SetSegmentStop(rtSegmentStop);
+
+                            if (FAILED(hr)) {
+                                break;
+                            }
 
 #if SUBPIC_TRACE_LEVEL > 1
-                        CRect r;
-                        pStatic->GetDirtyRect(&r);
-                        TRACE(_T("Subtitle Renderer Thread: Render %f -> %f -> %f -> %f (%dx%d)\n"),
-                              double(rtStart) / 10000000.0, double(pStatic->GetStart()) / 10000000.0,
-                              double(pStatic->GetStop()) / 10000000.0, double(rtStop) / 10000000.0,
-                              r.Width(), r.Height());
+                            CRect r;
+                            pStatic->GetDirtyRect(&r);
+                            TRACE(_T("Subtitle Renderer Thread: Render %f -> %f -> %f -> %f (%dx%d)\n"),
+                                  double(rtStart) / 10000000.0, double(pStatic->GetStart()) / 10000000.0,
+                                  double(pStatic->GetStop()) / 10000000.0, double(rtStop) / 10000000.0,
+                                  r.Width(), r.Height());
 #endif
 
-                        pSubPic.Release();
-                        if (FAILED(m_pAllocator->AllocDynamic(&pSubPic))
-                                || FAILED(pStatic->CopyTo(pSubPic))) {
-                            break;
-                        }
+                            pSubPic.Release();
+                            if (FAILED(m_pAllocator->AllocDynamic(&pSubPic))
+                                    || FAILED(pStatic->CopyTo(pSubPic))) {
+                                break;
+                            }
 
-                        if (SUCCEEDED(hr2)) {
-                            pSubPic->SetVirtualTextureSize(virtualSize, virtualTopLeft);
-                        }
+                            if (SUCCEEDED(hr2)) {
+                                pSubPic->SetVirtualTextureSize(virtualSize, virtualTopLeft);
+                            }
 
-                        RelativeTo relativeTo;
-                        if (SUCCEEDED(pSubPicProvider->GetRelativeTo(pos, relativeTo))) {
-                            pSubPic->SetRelativeTo(relativeTo);
-                        }
+                            RelativeTo relativeTo;
+                            if (SUCCEEDED(pSubPicProvider->GetRelativeTo(pos, relativeTo))) {
+                                pSubPic->SetRelativeTo(relativeTo);
+                            }
 
-                        // Try to enqueue the subpic, if the queue is full stop rendering
-                        if (!EnqueueSubPic(pSubPic, false)) {
-                            bStopRendering = true;
-                            break;
+                            // Try to enqueue the subpic, if the queue is full stop rendering
+                            if (!EnqueueSubPic(pSubPic, false)) {
+                                bStopRendering = true;
+                                break;
+                            }
                         }
 
                         if (m_rtNow > rtCurrent) {
@@ -662,6 +914,11 @@ DWORD CSubPicQueue::ThreadProc()
                 }
             }
 
+            // The workers use the provider so they have to be done before unlocking it
+            for (const auto& pJob : m_renderJobs) {
+                WaitForRenderJob(pJob);
+            }
+
             pSubPicProviderWithSharedLock->Unlock();
 
             // If we couldn't enqueue the subpic before, wait for some room in the queue
@@ -669,6 +926,14 @@ DWORD CSubPicQueue::ThreadProc()
             if (pSubPic) {
                 EnqueueSubPic(pSubPic, true);
             }
+            for (; !m_renderJobs.empty(); m_renderJobs.pop_front()) {
+                const auto& pJob = m_renderJobs.front();
+                if (FAILED(pJob->hr)) {
+                    m_posRenderFailed = pJob->pos;
+                } else if (pJob->pSubPic && pJob->pos != m_posRenderFailed) {
+                    EnqueueSubPic(pJob->pSubPic, true);
+                }
+            }
         } else {
             bWaitForEvent = true;
         }
@@ -736,6 +1001,7 @@ STDMETHODIMP_(bool) CSubPicQueueNoThread::LookupSubPic(REFERENCE_TIME rtNow, boo
 {
     // CSubPicQueueNoThread is always blocking so we ignore bAdviseBlocking
 
+    const auto lookupStart = std::chrono::steady_clock::now();
     CComPtr<ISubPic> pSubPic;
 
     {
@@ -790,6 +1056,8 @@ STDMETHODIMP_(bool) CSubPicQueueNoThread::LookupSubPic(REFERENCE_TIME rtNow, boo
                         m_pSubPic.Release();
 
                         if (FAILED(m_pAllocator->AllocDynamic(&m_pSubPic))) {
+                            pSubPicProvider->Unlock();
+                            UpdateLookupStats(lookupStart);
                             return false;
                         }
 
@@ -826,6 +1094,8 @@ STDMETHODIMP_(bool) CSubPicQueueNoThread::LookupSubPic(REFERENCE_TIME rtNow, boo
         }
     }
 
+    UpdateLookupStats(lookupStart);
+
     return !!ppSubPic;
 }
 
@@ -21,12 +21,16 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
 
 #include "ISubPic.h"
 #include "SubPicQueueSettings.h"
+#include "../DSUtil/ThreadPool.h"
 
 class CSubPicQueueImpl : public CUnknown, public ISubPicQueue
 {
@@ -96,12 +100,27 @@ protected:
 
     CComPtr<ISubPicAllocator> m_pAllocator;
 
+    // The providers aren't reentrant so RenderTo only lets one thread render at a time
+    std::mutex m_mutexRender; // to protect the provider rendering and the members below
+
+    // What RenderTo drew last, only used to compare identities
+    ISubPic* m_pLastRenderedSubPic;
+    ISubPicProvider* m_pLastRenderedSubPicProvider;
+    CRect m_rcLastRenderedDirty;
+    ULONGLONG m_nRenderCount; // number of provider calls so far
+
+    std::atomic<REFERENCE_TIME> m_rtLastLookup;
+    std::atomic<REFERENCE_TIME> m_rtMaxLookup;
+
+    void UpdateLookupStats(std::chrono::steady_clock::time_point lookupStart);
+
     std::shared_ptr<SubPicProviderWithSharedLock> GetSubPicProviderWithSharedLock() {
         CAutoLock cAutoLock(&m_csSubPicProvider);
         return m_pSubPicProviderWithSharedLock;
     }
 
-    HRESULT RenderTo(ISubPic* pSubPic, REFERENCE_TIME rtStart, REFERENCE_TIME rtStop, double fps, BOOL bIsAnimated);
+    // bAllowUpdate has to be false when the subpic isn't reused from one frame to the next
+    HRESULT RenderTo(ISubPic* pSubPic, REFERENCE_TIME rtStart, REFERENCE_TIME rtStop, double fps, BOOL bIsAnimated, bool bAllowUpdate = true);
 
 public:
     CSubPicQueueImpl(SubPicQueueSettings settings, ISubPicAllocator* pAllocator, HRESULT* phr);
@@ -117,6 +136,7 @@ public:
 
     STDMETHODIMP SetFPS(double fps);
     STDMETHODIMP SetTime(REFERENCE_TIME rtNow);
+    STDMETHODIMP GetLookupStats(REFERENCE_TIME& rtLastLookup, REFERENCE_TIME& rtMaxLookup);
     /*
     STDMETHODIMP Invalidate(REFERENCE_TIME rtInvalidate = -1) PURE;
     STDMETHODIMP_(bool) LookupSubPic(REFERENCE_TIME rtNow, ISubPic** ppSubPic) PURE;
@@ -133,10 +153,26 @@ protected:
     bool m_bExitThread;
 
     CComPtr<ISubPic> m_pSubPic;
-    CInterfaceList<ISubPic> m_queue;
+
+    // Ring of the ready subpics in presentation order. The queue thread is the only
+    // producer and LookupSubPic the only consumer so looking up a subpic doesn't take
+    // any lock. A slot is only written by the producer, under m_mutexQueue, once the
+    // consumer is done with it so Invalidate marks the subpics as dropped instead of
+    // removing them and the consumer skips them later.
+    struct QueueSlot {
+        CComPtr<ISubPic> pSubPic;
+        std::atomic<REFERENCE_TIME> rtStart { 0 };
+        std::atomic<REFERENCE_TIME> rtStop { 0 };
+        std::atomic<bool> bDropped { false };
+    };
+    std::unique_ptr<QueueSlot[]> m_queue;
+    size_t m_nQueueCapacity;
+    std::atomic<ULONGLONG> m_nQueueHead; // only written by the consumer
+    std::atomic<ULONGLONG> m_nQueueTail; // only written by the producer
+    std::atomic<bool> m_bWaitingForRoom;
 
     std::mutex m_mutexSubpic; // to protect m_pSubPic
-    std::mutex m_mutexQueue; // to protect m_queue
+    std::mutex m_mutexQueue; // to serialize the writes to m_queue and the waits
     std::condition_variable m_condQueueFull;
     std::condition_variable m_condQueueReady;
 
@@ -147,9 +183,37 @@ protected:
     bool m_bInvalidate;
     REFERENCE_TIME m_rtInvalidate;
 
+    // Subpics rendered ahead of time by the workers, they are enqueued in the order they were submitted
+    struct RenderJob {
+        CComPtr<ISubPic> pSubPic;
+        POSITION pos = nullptr; // the provider entry
+        REFERENCE_TIME rtStart = 0, rtStop = 0;
+        double fps = 0.0;
+        bool bIsAnimated = false;
+        HRESULT hr = E_PENDING;
+        bool bDone = false;
+    };
+    std::unique_ptr<CThreadPool> m_pRenderThreadPool;
+    std::deque<std::shared_ptr<RenderJob>> m_renderJobs; // only used by the queue thread
+    POSITION m_posRenderFailed; // the entry whose rendering failed, only used by the queue thread
+    std::mutex m_mutexRenderJobs; // to protect RenderJob::hr and RenderJob::bDone
+    std::condition_variable m_condRenderJobDone;
+
+    // The queue helpers below have to be called with m_mutexQueue held
+    size_t GetQueueCount() const;
+    bool CanAddToQueue() const;
+    QueueSlot* GetLastQueueSlot() const;
+
     bool EnqueueSubPic(CComPtr<ISubPic>& pSubPic, bool bBlocking);
     REFERENCE_TIME GetCurrentRenderingTime();
 
+    void SubmitRenderJob(const std::shared_ptr<RenderJob>& pJob);
+    void WaitForRenderJob(const std::shared_ptr<RenderJob>& pJob);
+    // Enqueues the finished subpics in order, returns false if the queue got full.
+    // Like the serial rendering, an entry is given up after its first failed subpic:
+    // m_posRenderFailed is set and its later subpics are dropped.
+    bool CommitRenderJobs(size_t nMaxPending);
+
     // CAMThread
     virtual DWORD ThreadProc();
 
@@ -21,25 +21,29 @@
 #pragma once
 
 struct SubPicQueueSettings {
-    int  nSize;
+    int  nSize;             // the queue depth, in subpics
     int  nMaxRes;
     bool bDisableSubtitleAnimation;
     int  nRenderAtWhenAnimationIsDisabled;
     int  nAnimationRate;
     bool bAllowDroppingSubpic;
+    int  nRenderThreads;    // 1 renders on the queue thread, 0 uses one worker per logical processor
+    int  nMemoryLimit;      // in MB, 0 means no limit, only used by the memory subpic allocator
 
     SubPicQueueSettings(int nSize, int nMaxRes,
                         bool bDisableSubtitleAnimation, int nRenderAtWhenAnimationIsDisabled, int nAnimationRate,
-                        bool bAllowDroppingSubpic)
+                        bool bAllowDroppingSubpic, int nRenderThreads, int nMemoryLimit)
         : nSize(nSize)
         , nMaxRes(nMaxRes)
         , bDisableSubtitleAnimation(bDisableSubtitleAnimation)
         , nRenderAtWhenAnimationIsDisabled(nRenderAtWhenAnimationIsDisabled)
         , nAnimationRate(nAnimationRate)
         , bAllowDroppingSubpic(bAllowDroppingSubpic)
+        , nRenderThreads(nRenderThreads)
+        , nMemoryLimit(nMemoryLimit)
     {};
 
     SubPicQueueSettings()
-        : SubPicQueueSettings(10, 0, false, 50, 100, true)
+        : SubPicQueueSettings(10, 0, false, 50, 100, true, 1, 0)
     {};
 };
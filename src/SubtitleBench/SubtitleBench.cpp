@@ -0,0 +1,669 @@
+/*
+ * (C) 2026 see Authors.txt
+ *
+ * This file is part of MPC-HC.
+ *
+ * MPC-HC is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MPC-HC is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "stdafx.h"
+#include "../Subtitles/RTS.h"
+#include "../Subtitles/VobSubFile.h"
+#include "../SubPic/MemSubPic.h"
+
+namespace
+{
+    struct Options {
+        CString subtitle;
+        std::vector<CString> vobsubs;
+        CSize size = CSize(1920, 1080);
+        double fps = 25.0;
+        int nThreads = 1;
+        CString checksums;
+        Rasterizer::BlendKernel maxBlendKernel = Rasterizer::BlendKernel::AVX512;
+        bool bAlphaBlt = false;
+        CMemSubPic::AlphaBltKernel maxAlphaBltKernel = CMemSubPic::AlphaBltKernel::AVX2;
+        CVobSubImage::DecodeKernel maxDecodeKernel = CVobSubImage::DecodeKernel::SSE2;
+        bool bCheckKernels = false;
+    };
+
+    bool IsVobSub(const CString& fn)
+    {
+        CString ext = fn.Mid(fn.ReverseFind(_T('.')) + 1);
+        return !ext.CompareNoCase(_T("idx")) || !ext.CompareNoCase(_T("sub"));
+    }
+
+    bool ParseCommandLine(int argc, TCHAR* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; i++) {
+            CString arg = argv[i];
+            bool fHasValue = i + 1 < argc;
+
+            if (!arg.CompareNoCase(_T("/size")) && fHasValue) {
+                if (_stscanf_s(argv[++i], _T("%dx%d"), &options.size.cx, &options.size.cy) != 2
+                        || options.size.cx <= 0 || options.size.cy <= 0) {
+                    return false;
+                }
+            } else if (!arg.CompareNoCase(_T("/fps")) && fHasValue) {
+                options.fps = _tcstod(argv[++i], nullptr);
+                if (options.fps <= 0) {
+                    return false;
+                }
+            } else if (!arg.CompareNoCase(_T("/threads")) && fHasValue) {
+                options.nThreads = _ttoi(argv[++i]);
+            } else if (!arg.CompareNoCase(_T("/checksums")) && fHasValue) {
+                options.checksums = argv[++i];
+            } else if (!arg.CompareNoCase(_T("/kernel")) && fHasValue) {
+                CString kernel = argv[++i];
+                if (!kernel.CompareNoCase(_T("c"))) {
+                    options.maxBlendKernel = Rasterizer::BlendKernel::C;
+                } else if (!kernel.CompareNoCase(_T("sse2"))) {
+                    options.maxBlendKernel = Rasterizer::BlendKernel::SSE2;
+                } else if (!kernel.CompareNoCase(_T("avx2"))) {
+                    options.maxBlendKernel = Rasterizer::BlendKernel::AVX2;
+                } else if (!kernel.CompareNoCase(_T("avx512"))) {
+                    options.maxBlendKernel = Rasterizer::BlendKernel::AVX512;
+                } else {
+                    return false;
+                }
+            } else if (!arg.CompareNoCase(_T("/checkkernels"))) {
+                options.bCheckKernels = true;
+            } else if (!arg.CompareNoCase(_T("/alphablt"))) {
+                options.bAlphaBlt = true;
+            } else if (!arg.CompareNoCase(_T("/bltkernel")) && fHasValue) {
+                CString kernel = argv[++i];
+                if (!kernel.CompareNoCase(_T("c"))) {
+                    options.maxAlphaBltKernel = CMemSubPic::AlphaBltKernel::C;
+                } else if (!kernel.CompareNoCase(_T("sse2"))) {
+                    options.maxAlphaBltKernel = CMemSubPic::AlphaBltKernel::SSE2;
+                } else if (!kernel.CompareNoCase(_T("sse41"))) {
+                    options.maxAlphaBltKernel = CMemSubPic::AlphaBltKernel::SSE41;
+                } else if (!kernel.CompareNoCase(_T("avx2"))) {
+                    options.maxAlphaBltKernel = CMemSubPic::AlphaBltKernel::AVX2;
+                } else {
+                    return false;
+                }
+            } else if (!arg.CompareNoCase(_T("/decoder")) && fHasValue) {
+                CString kernel = argv[++i];
+                if (!kernel.CompareNoCase(_T("c"))) {
+                    options.maxDecodeKernel = CVobSubImage::DecodeKernel::C;
+                } else if (!kernel.CompareNoCase(_T("sse2"))) {
+                    options.maxDecodeKernel = CVobSubImage::DecodeKernel::SSE2;
+                } else {
+                    return false;
+                }
+            } else if (!arg.IsEmpty() && arg[0] != _T('/') && IsVobSub(arg)) {
+                options.vobsubs.push_back(arg);
+            } else if (!arg.IsEmpty() && arg[0] != _T('/') && options.subtitle.IsEmpty()) {
+                options.subtitle = arg;
+            } else {
+                return false;
+            }
+        }
+
+        if (options.bCheckKernels) {
+            return options.subtitle.IsEmpty() && options.vobsubs.empty();
+        }
+        // Either one text subtitle or any number of VobSub files
+        return options.subtitle.IsEmpty() != options.vobsubs.empty();
+    }
+
+    void PrintUsage()
+    {
+        _tprintf(_T("Usage: SubtitleBench <subtitle file> [/size <width>x<height>] [/fps <fps>] [/threads <n>] [/checksums <file>]\n")
+                 _T("                     [/kernel c|sse2|avx2|avx512] [/alphablt [/bltkernel c|sse2|sse41|avx2]]\n")
+                 _T("       SubtitleBench <VobSub file> [<VobSub file> ...] [/decoder c|sse2] [/checksums <file>]\n")
+                 _T("       SubtitleBench /checkkernels [/size <width>x<height>] [/kernel c|sse2|avx2|avx512]\n\n")
+                 _T("Renders every frame of a text subtitle file into a 32-bit memory buffer and reports\n")
+                 _T("the rendering time of the frames showing a subtitle and the rendering caches usage.\n")
+                 _T("With .idx or .sub files, decodes every subpicture of every language of the files and\n")
+                 _T("reports the decoding time and the frame cache usage.\n")
+                 _T("With /checkkernels, blends the same generated shapes with every blending kernel the\n")
+                 _T("processor supports and fails if one of them doesn't give the same pixels as the C one.\n")
+                 _T("  /size       Size of the rendered frames, 1920x1080 by default\n")
+                 _T("  /fps        Frame rate, 25 by default\n")
+                 _T("  /threads    Number of rendering threads, 0 for one per logical processor, 1 by default\n")
+                 _T("  /checksums  Writes the checksum of every frame showing a subtitle to the given file\n")
+                 _T("  /kernel     Best blending kernel allowed, to compare the output of the kernels with /checksums\n")
+                 _T("  /alphablt   Also blends every rendered frame into a video frame of each memory subpic format\n")
+                 _T("  /bltkernel  Best kernel allowed for /alphablt, to compare the checksums of the kernels\n")
+                 _T("  /decoder    Best VobSub decoder allowed, to compare the output of the decoders with /checksums\n"));
+    }
+
+    // 64-bit FNV-1a
+    ULONGLONG HashBuffer(const BYTE* p, size_t len, ULONGLONG hash = 14695981039346656037ui64)
+    {
+        for (size_t i = 0; i < len; i++) {
+            hash = (hash ^ p[i]) * 1099511628211ui64;
+        }
+        return hash;
+    }
+
+    // Hash of the rendered rectangle and its content
+    ULONGLONG HashFrame(const SubPicDesc& spd, const CRect& bbox)
+    {
+        ULONGLONG hash = HashBuffer((const BYTE*)&bbox, sizeof(RECT));
+        for (LONG y = bbox.top; y < bbox.bottom; y++) {
+            hash = HashBuffer(spd.bits + spd.pitch * y + bbox.left * 4, bbox.Width() * 4, hash);
+        }
+        return hash;
+    }
+
+    void ClearRect(SubPicDesc& spd, const CRect& rect)
+    {
+        for (LONG y = rect.top; y < rect.bottom; y++) {
+            DWORD* p = (DWORD*)(spd.bits + spd.pitch * y) + rect.left;
+            std::fill(p, p + rect.Width(), 0xFF000000);
+        }
+    }
+
+    double Percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty()) {
+            return 0.0;
+        }
+        size_t i = std::min(sorted.size() - 1, size_t(p / 100.0 * sorted.size()));
+        return sorted[i];
+    }
+
+    // Blends the rendered frames into a video frame of one of the memory subpic formats
+    struct AlphaBltBench {
+        int type;
+        LPCTSTR name;
+        int bpp;
+        CComPtr<ISubPic> pSubPic;
+        std::vector<BYTE> frame;
+        SubPicDesc target;
+        size_t nFrames = 0;
+        double time = 0.0;
+
+        AlphaBltBench(int _type, LPCTSTR _name, int _bpp, CSize size)
+            : type(_type)
+            , name(_name)
+            , bpp(_bpp) {
+            CComPtr<ISubPicAllocator> pAllocator = DEBUG_NEW CMemSubPicAllocator(type, size);
+            pAllocator->SetCurSize(size);
+            pAllocator->SetCurVidRect(CRect(CPoint(0, 0), size));
+            pAllocator->AllocDynamic(&pSubPic);
+
+            bool bPlanar = type == MSP_YV12 || type == MSP_IYUV;
+            target.type = type;
+            target.w = size.cx;
+            target.h = size.cy;
+            target.bpp = bpp;
+            target.pitch = (size.cx * bpp) >> 3;
+            target.vidrect = CRect(CPoint(0, 0), size);
+            frame.resize(size_t(target.pitch) * size.cy * (bPlanar ? 3 : 2) / 2, 0x80);
+            target.bits = frame.data();
+        }
+
+        void Blend(const SubPicDesc& spd, const CRect& bbox) {
+            if (!pSubPic || bbox.IsRectEmpty()) {
+                return;
+            }
+
+            SubPicDesc sub;
+            pSubPic->ClearDirtyRect(0xFF000000);
+            pSubPic->Lock(sub);
+            for (LONG y = bbox.top; y < bbox.bottom; y++) {
+                memcpy(sub.bits + sub.pitch * y + bbox.left * 4, spd.bits + spd.pitch * y + bbox.left * 4, bbox.Width() * 4);
+            }
+            CRect rect = bbox;
+            pSubPic->Unlock(rect);
+            pSubPic->GetDirtyRect(rect);
+
+            auto start = std::chrono::steady_clock::now();
+            pSubPic->AlphaBlt(rect, rect, &target);
+            std::chrono::duration<double, std::milli> bltTime = std::chrono::steady_clock::now() - start;
+            time += bltTime.count();
+            nFrames++;
+        }
+    };
+
+    void PrintCacheStats(LPCTSTR name, const CRenderingCacheStats& stats)
+    {
+        size_t nLookups = stats.nHits + stats.nMisses;
+        _tprintf(_T("  %-12s %10Iu %10Iu %6.1f%% %10Iu %8Iu %8Iu KB\n"), name,
+                 stats.nHits, stats.nMisses, nLookups ? 100.0 * stats.nHits / nLookups : 0.0,
+                 stats.nEvictions, stats.nEntries, stats.nBytes / 1024);
+    }
+
+    // Gives access to the blending kernel of a rasterizer to draw the same overlay with each kernel
+    class CKernelRasterizer : public Rasterizer
+    {
+    public:
+        // The best kernel allowed, the slower ones can be used too
+        const BlendKernel maxKernel = m_blendKernel;
+
+        void SetBlendKernel(BlendKernel kernel) {
+            ASSERT(kernel <= maxKernel);
+            m_blendKernel = kernel;
+        }
+    };
+
+    int RunKernelCheck(const Options& options)
+    {
+        Rasterizer::SetMaxBlendKernel(options.maxBlendKernel);
+
+        // Fixed xorshift sequence so that every run checks the same shapes
+        DWORD seed = 0x9E3779B9;
+        auto random = [&seed](int n) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return int(seed % DWORD(n));
+        };
+
+        const CSize size = options.size;
+
+        // Stars and ellipses in 1/8 pixels, some of them partly out of the frame, with
+        // borders and blur so that every kernel goes through its main loops and its tails
+        const int nShapes = 48;
+        std::vector<std::unique_ptr<CKernelRasterizer>> shapes;
+        std::vector<CPoint> subs;
+        for (int i = 0; i < nShapes; i++) {
+            CPoint center(random(size.cx + 128) - 64, random(size.cy + 128) - 64);
+            int rx = 8 + random(160), ry = 8 + random(160);
+
+            std::vector<BYTE> types;
+            std::vector<POINT> points;
+            if (i % 2) {
+                int nPoints = 2 * (5 + random(8));
+                for (int j = 0; j < nPoints; j++) {
+                    double angle = 2.0 * M_PI * j / nPoints;
+                    double r = (j % 2) ? 0.4 : 1.0;
+                    POINT p = { std::lround((center.x + r * rx * cos(angle)) * 8), std::lround((center.y + r * ry * sin(angle)) * 8) };
+                    types.push_back(j ? PT_LINETO : PT_MOVETO);
+                    points.push_back(p);
+                }
+            } else {
+                // 4 Bezier curves, the control points are at 0.5523 of the radius
+                const int k[13][2] = {
+                    { 1000, 0 }, { 1000, 552 }, { 552, 1000 }, { 0, 1000 }, { -552, 1000 }, { -1000, 552 }, { -1000, 0 },
+                    { -1000, -552 }, { -552, -1000 }, { 0, -1000 }, { 552, -1000 }, { 1000, -552 }, { 1000, 0 }
+                };
+                for (int j = 0; j < 13; j++) {
+                    types.push_back(j ? PT_BEZIERTO : PT_MOVETO);
+                    points.push_back({ (center.x * 1000 + rx * k[j][0]) * 8 / 1000, (center.y * 1000 + ry * k[j][1]) * 8 / 1000 });
+                }
+            }
+            types.back() |= PT_CLOSEFIGURE;
+
+            auto pShape = std::make_unique<CKernelRasterizer>();
+            int border = random(5) * 8;
+            CPoint sub(random(8), random(8));
+            if (!pShape->SetPath(types.data(), points.data(), int(points.size())) || !pShape->ScanConvert()
+                    || (border && !pShape->CreateWidenedRegion(border, border))
+                    || !pShape->Rasterize(sub.x, sub.y, random(3), random(2) ? 0.0 : 0.5 + random(8) / 2.0)) {
+                _ftprintf(stderr, _T("Unable to rasterize shape %d\n"), i);
+                return 1;
+            }
+            shapes.emplace_back(std::move(pShape));
+            subs.push_back(sub);
+        }
+
+        // Values up to 0x40 like the masks of the \clip tags
+        std::vector<BYTE> alphaMask(size_t(size.cx) * size.cy);
+        for (BYTE& a : alphaMask) {
+            a = BYTE(random(0x41));
+        }
+
+        std::vector<DWORD> colors(nShapes * 2);
+        std::vector<int> switchPoints(nShapes);
+        for (int i = 0; i < nShapes; i++) {
+            colors[i * 2] = DWORD(random(0x10000)) << 16 | DWORD(random(0x10000));
+            colors[i * 2 + 1] = DWORD(random(0x10000)) << 16 | DWORD(random(0x10000));
+            switchPoints[i] = random(shapes[i]->getOverlayWidth() + 1);
+        }
+
+        std::vector<DWORD> buffer(size_t(size.cx) * size.cy);
+        SubPicDesc spd;
+        spd.type = MSP_RGB32;
+        spd.w = size.cx;
+        spd.h = size.cy;
+        spd.bpp = 32;
+        spd.pitch = spd.w * 4;
+        spd.bits = (BYTE*)buffer.data();
+        spd.vidrect = CRect(CPoint(0, 0), size);
+
+        // Draws all the shapes on top of each other for one of the drawing modes, like the renderer does
+        auto drawFrame = [&](Rasterizer::BlendKernel kernel, int mode) {
+            std::fill(buffer.begin(), buffer.end(), 0xFF000000);
+            bool fBody = (mode & 3) != 2, fBorder = (mode & 3) != 1;
+            bool bAlphaMask = !!(mode & 4), bSwitchPoints = !!(mode & 8);
+            CRect clipRect(CPoint(0, 0), size);
+            for (int i = 0; i < nShapes; i++) {
+                DWORD sw[6] = { colors[i * 2], bSwitchPoints ? 0 : DWORD_MAX, colors[i * 2 + 1], DWORD(switchPoints[i]), colors[i * 2 + 1], 0x00ffffff };
+                shapes[i]->SetBlendKernel(kernel);
+                shapes[i]->Draw(spd, clipRect, bAlphaMask ? alphaMask.data() : nullptr, subs[i].x, subs[i].y, sw, fBody, fBorder);
+            }
+            CRect fill(size.cx / 3 + 1, size.cy / 3, size.cx * 2 / 3, size.cy * 2 / 3);
+            shapes[0]->FillSolidRect(spd, fill.left, fill.top, fill.Width(), fill.Height(), colors[1]);
+            return buffer;
+        };
+
+        static LPCTSTR kernelNames[] = { _T("C"), _T("SSE2"), _T("AVX2"), _T("AVX-512") };
+        static LPCTSTR modeNames[] = { _T("body and border"), _T("body"), _T("border") };
+        Rasterizer::BlendKernel maxKernel = shapes[0]->maxKernel;
+        int nMismatches = 0;
+
+        // Mode 3 would draw nothing since it has neither the body nor the border
+        for (int mode = 0; mode < 16; mode++) {
+            if ((mode & 3) == 3) {
+                continue;
+            }
+
+            std::vector<DWORD> reference = drawFrame(Rasterizer::BlendKernel::C, mode);
+            for (int k = int(Rasterizer::BlendKernel::SSE2); k <= int(maxKernel); k++) {
+                std::vector<DWORD> frame = drawFrame(Rasterizer::BlendKernel(k), mode);
+                auto mismatch = std::mismatch(frame.begin(), frame.end(), reference.begin());
+                if (mismatch.first != frame.end()) {
+                    size_t pos = mismatch.first - frame.begin();
+                    _tprintf(_T("%s kernel, %s%s%s: %08x instead of %08x at %Iu,%Iu\n"),
+                             kernelNames[k], modeNames[mode & 3], (mode & 4) ? _T(", alpha mask") : _T(""), (mode & 8) ? _T(", switch point") : _T(""),
+                             *mismatch.first, *mismatch.second, pos % size.cx, pos / size.cx);
+                    nMismatches++;
+                }
+            }
+        }
+
+        _tprintf(_T("%d shapes blended at %dx%d, C kernel compared with the kernels up to %s: %d mismatch(es)\n"),
+                 nShapes, size.cx, size.cy, kernelNames[int(maxKernel)], nMismatches);
+
+        return nMismatches ? 1 : 0;
+    }
+
+    // Gives access to the packets of a VobSub file so that they can be decoded directly
+    class CVobSubPackets : public CVobSubFile
+    {
+    public:
+        explicit CVobSubPackets(CCritSec* pLock)
+            : CVobSubFile(pLock) {}
+
+        using CVobSubFile::GetPacket;
+        using CVobSubFile::GetFrame;
+    };
+
+    int RunVobSubBench(const Options& options)
+    {
+        CVobSubImage::SetMaxDecodeKernel(options.maxDecodeKernel);
+
+        FILE* fChecksums = nullptr;
+        if (!options.checksums.IsEmpty() && _tfopen_s(&fChecksums, options.checksums, _T("wt"))) {
+            _ftprintf(stderr, _T("Unable to create \"%s\"\n"), options.checksums.GetString());
+            return 1;
+        }
+
+        CCritSec lock;
+        CVobSubImage img;
+        std::vector<double> decodeTimes;
+        ULONGLONG nPixels = 0, checksum = 0;
+        // Going twice through the frames of the files shows the use of their frame cache
+        double frameTimes[2] = { 0.0, 0.0 };
+        CRenderingCacheStats frameCacheStats;
+
+        for (size_t nFile = 0; nFile < options.vobsubs.size(); nFile++) {
+            const CString& fn = options.vobsubs[nFile];
+            CAutoPtr<CVobSubPackets> pVSF(DEBUG_NEW CVobSubPackets(&lock));
+            if (!pVSF->Open(fn)) {
+                _ftprintf(stderr, _T("Unable to open \"%s\"\n"), fn.GetString());
+                continue;
+            }
+
+            for (size_t nLang = 0; nLang < pVSF->m_langs.size(); nLang++) {
+                const CAtlArray<CVobSubFile::SubPos>& sp = pVSF->m_langs[nLang].subpos;
+
+                for (size_t i = 0; i < sp.GetCount(); i++) {
+                    if (!sp[i].bValid) {
+                        continue;
+                    }
+
+                    size_t packetSize = 0, dataSize = 0;
+                    CAutoVectorPtr<BYTE> buff;
+                    buff.Attach(pVSF->GetPacket(i, packetSize, dataSize, nLang));
+                    if (!buff || packetSize == 0 || dataSize == 0) {
+                        continue;
+                    }
+
+                    auto decodeStart = std::chrono::steady_clock::now();
+                    bool bDecoded = img.Decode(buff, packetSize, dataSize, INT_MAX, pVSF->m_bCustomPal,
+                                               pVSF->m_tridx, pVSF->m_orgpal, pVSF->m_cuspal, true);
+                    std::chrono::duration<double, std::milli> decodeTime = std::chrono::steady_clock::now() - decodeStart;
+
+                    if (!bDecoded) {
+                        continue;
+                    }
+                    decodeTimes.push_back(decodeTime.count());
+
+                    size_t len = size_t(img.rect.Width()) * img.rect.Height();
+                    nPixels += len;
+
+                    ULONGLONG frameChecksum = HashBuffer((const BYTE*)&img.rect, sizeof(RECT));
+                    frameChecksum = HashBuffer((const BYTE*)img.lpPixels, len * sizeof(RGBQUAD), frameChecksum);
+                    checksum = (checksum ^ frameChecksum) * 1099511628211ui64;
+                    if (fChecksums) {
+                        _ftprintf(fChecksums, _T("%Iu\t%Iu\t%Iu\t%016I64x\n"), nFile, nLang, i, frameChecksum);
+                    }
+                }
+            }
+
+            for (double& frameTime : frameTimes) {
+                auto framesStart = std::chrono::steady_clock::now();
+                for (size_t nLang = 0; nLang < pVSF->m_langs.size(); nLang++) {
+                    for (size_t i = 0; i < pVSF->m_langs[nLang].subpos.GetCount(); i++) {
+                        pVSF->GetFrame(i, nLang);
+                    }
+                }
+                std::chrono::duration<double, std::milli> framesTime = std::chrono::steady_clock::now() - framesStart;
+                frameTime += framesTime.count();
+            }
+
+            CRenderingCacheStats stats = pVSF->GetFrameCacheStats();
+            frameCacheStats.nHits += stats.nHits;
+            frameCacheStats.nMisses += stats.nMisses;
+            frameCacheStats.nEvictions += stats.nEvictions;
+            frameCacheStats.nEntries += stats.nEntries;
+            frameCacheStats.nBytes += stats.nBytes;
+        }
+
+        if (fChecksums) {
+            fclose(fChecksums);
+        }
+
+        std::vector<double> sortedTimes(decodeTimes);
+        std::sort(sortedTimes.begin(), sortedTimes.end());
+        double totalTime = 0.0;
+        for (double t : decodeTimes) {
+            totalTime += t;
+        }
+
+        static LPCTSTR decoderNames[] = { _T("C"), _T("SSE2") };
+        _tprintf(_T("%Iu file(s), %s decoder\n"), options.vobsubs.size(), decoderNames[int(CVobSubImage::GetDecodeKernel())]);
+        _tprintf(_T("%Iu subpictures decoded in %.1f ms, %.1f Mpixels/s after trimming\n"), decodeTimes.size(), totalTime,
+                 totalTime > 0.0 ? nPixels / totalTime / 1000.0 : 0.0);
+        _tprintf(_T("Decoding time (ms): mean %.4f, p50 %.4f, p90 %.4f, p99 %.4f, max %.4f\n"),
+                 decodeTimes.empty() ? 0.0 : totalTime / decodeTimes.size(),
+                 Percentile(sortedTimes, 50), Percentile(sortedTimes, 90), Percentile(sortedTimes, 99),
+                 sortedTimes.empty() ? 0.0 : sortedTimes.back());
+        _tprintf(_T("Checksum: %016I64x\n"), checksum);
+        _tprintf(_T("Frames through the cache: %.1f ms the first time, %.1f ms the second time\n\n"), frameTimes[0], frameTimes[1]);
+
+        _tprintf(_T("  %-12s %10s %10s %7s %10s %8s %11s\n"), _T("Cache"), _T("Hits"), _T("Misses"), _T("Ratio"), _T("Evictions"), _T("Entries"), _T("Size"));
+        PrintCacheStats(_T("Frames"), frameCacheStats);
+
+        return decodeTimes.empty() ? 1 : 0;
+    }
+}
+
+int _tmain(int argc, TCHAR* argv[])
+{
+    if (!AfxWinInit(::GetModuleHandle(nullptr), nullptr, ::GetCommandLine(), 0)) {
+        return 1;
+    }
+
+    Options options;
+    if (!ParseCommandLine(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (options.bCheckKernels) {
+        return RunKernelCheck(options);
+    }
+
+    if (!options.vobsubs.empty()) {
+        return RunVobSubBench(options);
+    }
+
+    Rasterizer::SetMaxBlendKernel(options.maxBlendKernel);
+
+    CCritSec lock;
+    CAutoPtr<CRenderedTextSubtitle> pRTS(DEBUG_NEW CRenderedTextSubtitle(&lock));
+    pRTS->SetRenderingThreads(options.nThreads);
+
+    auto loadStart = std::chrono::steady_clock::now();
+    if (!pRTS->Open(options.subtitle, DEFAULT_CHARSET)) {
+        _ftprintf(stderr, _T("Unable to open \"%s\"\n"), options.subtitle.GetString());
+        return 1;
+    }
+    std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - loadStart;
+
+    int nSegments = 0;
+    pRTS->SearchSubs(0, options.fps, nullptr, &nSegments);
+    if (nSegments <= 0) {
+        _ftprintf(stderr, _T("\"%s\" has nothing to render\n"), options.subtitle.GetString());
+        return 1;
+    }
+    REFERENCE_TIME rtStart = pRTS->TranslateSegmentStart(0, options.fps);
+    REFERENCE_TIME rtStop = pRTS->TranslateSegmentEnd(nSegments - 1, options.fps);
+
+    FILE* fChecksums = nullptr;
+    if (!options.checksums.IsEmpty() && _tfopen_s(&fChecksums, options.checksums, _T("wt"))) {
+        _ftprintf(stderr, _T("Unable to create \"%s\"\n"), options.checksums.GetString());
+        return 1;
+    }
+
+    std::vector<DWORD> buffer(size_t(options.size.cx) * options.size.cy, 0xFF000000);
+
+    SubPicDesc spd;
+    spd.type = MSP_RGB32;
+    spd.w = options.size.cx;
+    spd.h = options.size.cy;
+    spd.bpp = 32;
+    spd.pitch = spd.w * 4;
+    spd.bits = (BYTE*)buffer.data();
+    spd.vidrect = CRect(CPoint(0, 0), options.size);
+
+    std::vector<double> frameTimes;
+    size_t nFrames = 0;
+    ULONGLONG checksum = 0;
+
+    CMemSubPic::SetMaxAlphaBltKernel(options.maxAlphaBltKernel);
+    std::vector<std::unique_ptr<AlphaBltBench>> alphaBltBenches;
+    if (options.bAlphaBlt) {
+        const struct {
+            int type;
+            LPCTSTR name;
+            int bpp;
+        } formats[] = {
+            { MSP_RGB32, _T("RGB32"), 32 },
+            { MSP_RGB24, _T("RGB24"), 24 },
+            { MSP_RGB16, _T("RGB16"), 16 },
+            { MSP_RGB15, _T("RGB15"), 16 },
+            { MSP_RGBA, _T("RGBA"), 32 },
+            { MSP_AYUV, _T("AYUV"), 32 },
+            { MSP_YUY2, _T("YUY2"), 16 },
+            { MSP_YV12, _T("YV12"), 8 },
+            { MSP_IYUV, _T("IYUV"), 8 },
+        };
+        for (const auto& format : formats) {
+            alphaBltBenches.emplace_back(std::make_unique<AlphaBltBench>(format.type, format.name, format.bpp, options.size));
+        }
+    }
+
+    for (REFERENCE_TIME rt = rtStart; rt < rtStop; rt = rtStart + std::llround(++nFrames * UNITS_FLOAT / options.fps)) {
+        CRect bbox;
+
+        auto renderStart = std::chrono::steady_clock::now();
+        HRESULT hr;
+        {
+            CAutoLock cAutoLock(&lock);
+            hr = pRTS->Render(spd, rt, options.fps, bbox);
+        }
+        std::chrono::duration<double, std::milli> renderTime = std::chrono::steady_clock::now() - renderStart;
+
+        if (hr != S_OK) {
+            continue;
+        }
+        frameTimes.push_back(renderTime.count());
+
+        bbox &= CRect(CPoint(0, 0), options.size);
+        for (auto& pBench : alphaBltBenches) {
+            pBench->Blend(spd, bbox);
+        }
+        ULONGLONG frameChecksum = HashFrame(spd, bbox);
+        checksum = (checksum ^ frameChecksum) * 1099511628211ui64;
+        if (fChecksums) {
+            _ftprintf(fChecksums, _T("%Iu\t%I64d\t%016I64x\n"), nFrames, rt / 10000, frameChecksum);
+        }
+
+        ClearRect(spd, bbox);
+    }
+
+    if (fChecksums) {
+        fclose(fChecksums);
+    }
+
+    std::vector<double> sortedTimes(frameTimes);
+    std::sort(sortedTimes.begin(), sortedTimes.end());
+    double totalTime = 0.0;
+    for (double t : frameTimes) {
+        totalTime += t;
+    }
+
+    _tprintf(_T("%s: %Iu entries loaded in %.1f ms\n"), options.subtitle.GetString(), pRTS->GetCount(), loadTime.count());
+    _tprintf(_T("%dx%d at %.3f fps, %d rendering thread(s)\n"), options.size.cx, options.size.cy, options.fps, options.nThreads);
+    _tprintf(_T("%Iu frames, %Iu showing a subtitle rendered in %.1f ms\n"), nFrames, frameTimes.size(), totalTime);
+    _tprintf(_T("Frame time (ms): mean %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n"),
+             frameTimes.empty() ? 0.0 : totalTime / frameTimes.size(),
+             Percentile(sortedTimes, 50), Percentile(sortedTimes, 90), Percentile(sortedTimes, 99),
+             sortedTimes.empty() ? 0.0 : sortedTimes.back());
+    _tprintf(_T("Checksum: %016I64x\n\n"), checksum);
+
+    const RenderingCaches& caches = pRTS->GetRenderingCaches();
+    _tprintf(_T("  %-12s %10s %10s %7s %10s %8s %11s\n"), _T("Cache"), _T("Hits"), _T("Misses"), _T("Ratio"), _T("Evictions"), _T("Entries"), _T("Size"));
+    PrintCacheStats(_T("Text dims"), caches.pGlyphCache->GetTextDimsStats());
+    PrintCacheStats(_T("Glyph paths"), caches.pGlyphCache->GetPathStats());
+    PrintCacheStats(_T("Polygons"), caches.polygonCache.GetStats());
+    PrintCacheStats(_T("SSA tags"), caches.SSATagsCache.GetStats());
+    PrintCacheStats(_T("Ellipses"), caches.ellipseCache.GetStats());
+    PrintCacheStats(_T("Outlines"), caches.outlineCache.GetStats());
+    PrintCacheStats(_T("Overlays"), caches.overlayCache.GetStats());
+    PrintCacheStats(_T("Alpha masks"), caches.alphaMaskCache.GetStats());
+    _tprintf(_T("  Budget: %Iu / %Iu KB\n"), caches.budget.GetBytes() / 1024, caches.budget.GetMaxBytes() / 1024);
+    _tprintf(_T("  Shared glyph cache: %Iu / %Iu KB\n"), caches.pGlyphCache->GetBytes() / 1024, CGlyphCache::DEFAULT_BUDGET / 1024);
+
+    if (!alphaBltBenches.empty()) {
+        static LPCTSTR kernelNames[] = { _T("C"), _T("SSE2"), _T("SSE4.1"), _T("AVX2") };
+        _tprintf(_T("\nAlphaBlt, %s kernel\n"), kernelNames[int(CMemSubPic::GetAlphaBltKernel())]);
+        _tprintf(_T("  %-8s %10s %12s %16s\n"), _T("Format"), _T("Time"), _T("Per frame"), _T("Checksum"));
+        for (const auto& pBench : alphaBltBenches) {
+            _tprintf(_T("  %-8s %7.1f ms %9.3f ms %016I64x\n"), pBench->name, pBench->time,
+                     pBench->nFrames ? pBench->time / pBench->nFrames : 0.0, HashBuffer(pBench->frame.data(), pBench->frame.size()));
+        }
+    }
+
+    return 0;
+}
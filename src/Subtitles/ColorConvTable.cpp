@@ -20,6 +20,8 @@
 
 #include "stdafx.h"
 #include "ColorConvTable.h"
+#include <mutex>
+#include <emmintrin.h>
 
 /************************************
 Formula:
@@ -163,6 +165,76 @@ void MultiplyMatrix(float* lhs_in_out, const float* rhs)
     E(lhs_in_out, 2, 3) = tmp1 * E(rhs, 0, 3) + tmp2 * E(rhs, 1, 3) + tmp3 * E(rhs, 2, 3) + E(lhs_in_out, 2, 3);
 }
 
+// Converts colours whose output components are each the clipped sum of one 16.16 fixed point
+// term per input component, which is the case of every conversion by a matrix. The terms
+// are looked up in 3 tables of 256 entries so no multiplication is left when converting.
+class ConvLut
+{
+public:
+    ConvLut();
+
+    // Components are numbered from the highest byte: 0 for bits 16-23, 1 for bits 8-15 and 2 for bits 0-7
+    void AddTerm(int in, int value, int out, int term) {
+        m_terms[in][value][2 - out] += term;
+    }
+    void SetOutputLevel(int out, int low, int size);
+
+    // The alpha is kept as is
+    void Convert(const DWORD* pSrc, DWORD* pDst, size_t count) const;
+
+private:
+    int m_terms[3][256][4]; // in the order of the output bytes, the last one stays 0
+    short m_low[8], m_size[8]; // twice since 2 pixels are converted at once
+};
+
+ConvLut::ConvLut()
+{
+    ZeroMemory(m_terms, sizeof(m_terms));
+    ZeroMemory(m_low, sizeof(m_low));
+    ZeroMemory(m_size, sizeof(m_size));
+}
+
+void ConvLut::SetOutputLevel(int out, int low, int size)
+{
+    m_low[2 - out] = m_low[6 - out] = short(low);
+    m_size[2 - out] = m_size[6 - out] = short(size);
+}
+
+void ConvLut::Convert(const DWORD* pSrc, DWORD* pDst, size_t count) const
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low = _mm_loadu_si128((const __m128i*)m_low);
+    const __m128i size = _mm_loadu_si128((const __m128i*)m_size);
+
+    auto sum = [this](DWORD c) {
+        __m128i t = _mm_loadu_si128((const __m128i*)m_terms[0][(c >> 16) & 0xff]);
+        t = _mm_add_epi32(t, _mm_loadu_si128((const __m128i*)m_terms[1][(c >> 8) & 0xff]));
+        t = _mm_add_epi32(t, _mm_loadu_si128((const __m128i*)m_terms[2][c & 0xff]));
+        return _mm_srai_epi32(t, 16);
+    };
+
+    // Clips both pixels to [0, size], adds the lowest level and packs them to bytes
+    auto pack = [&](__m128i t0, __m128i t1) {
+        __m128i t = _mm_packs_epi32(t0, t1);
+        t = _mm_add_epi16(_mm_min_epi16(_mm_max_epi16(t, zero), size), low);
+        return _mm_packus_epi16(t, t);
+    };
+
+    size_t i = 0;
+
+    for (; i + 1 < count; i += 2) {
+        DWORD c0 = pSrc[i], c1 = pSrc[i + 1];
+        __m128i t = pack(sum(c0), sum(c1));
+        pDst[i] = (c0 & 0xff000000) | DWORD(_mm_cvtsi128_si32(t));
+        pDst[i + 1] = (c1 & 0xff000000) | DWORD(_mm_cvtsi128_si32(_mm_srli_si128(t, 4)));
+    }
+
+    if (i < count) {
+        DWORD c0 = pSrc[i];
+        pDst[i] = (c0 & 0xff000000) | DWORD(_mm_cvtsi128_si32(pack(sum(c0), zero)));
+    }
+}
+
 class ConvMatrix
 {
 public:
@@ -399,6 +471,33 @@ DWORD func(int y8, int u8, int v8)
     return (r<<16) | (g<<8) | b;                                                          \
 }
 
+// Same computation as DEFINE_YUV2RGB_FUNC
+static void InitYuvToRgbLut(ConvLut& lut, const RGBLevelInfo& RGB_LEVEL, const YUVLevelInfo& YUV_LEVEL, double Kr, double Kg, double Kb)
+{
+    const int Y_SCALE = int(1.0 * RGB_LEVEL.size / YUV_LEVEL.y_size * FRACTION_SCALE + 0.5);
+    const int U_SCALE = int(1.0 * RGB_LEVEL.size / YUV_LEVEL.u_size * (FRACTION_SCALE / 4096) + 0.5);
+    const int INT_RV = int(2 * (1 - Kr) * 4096 + 0.5);
+    const int INT_GU = int(-2 * (1 - Kb) * Kb / Kg * 4096 + 0.5);
+    const int INT_GV = int(-2 * (1 - Kr) * Kr / Kg * 4096 + 0.5);
+    const int INT_BU = int(2 * (1 - Kb) * 4096 + 0.5);
+
+    for (int i = 0; i < 256; i++) {
+        int y8 = (i - YUV_LEVEL.y_low) * Y_SCALE;
+        int uv8 = (i - YUV_LEVEL.u_mid) * U_SCALE;
+        for (int out = 0; out < 3; out++) {
+            lut.AddTerm(0, i, out, y8 + FRACTION_SCALE / 2);
+        }
+        lut.AddTerm(1, i, 1, INT_GU * uv8);
+        lut.AddTerm(1, i, 2, INT_BU * uv8);
+        lut.AddTerm(2, i, 0, INT_RV * uv8);
+        lut.AddTerm(2, i, 1, INT_GV * uv8);
+    }
+
+    for (int out = 0; out < 3; out++) {
+        lut.SetOutputLevel(out, RGB_LEVEL.low, RGB_LEVEL.size);
+    }
+}
+
 #define DEFINE_PREMUL_ARGB2AYUV_FUNC(func, RGB_LEVEL, YUV_LEVEL, Kr, Kg, Kb, YUV_POS)     \
 DWORD func(int a8, int r8, int g8, int b8)                                                \
 {                                                                                         \
@@ -520,6 +619,12 @@ public:
     bool          m_bVSFilterCorrection;
 
     ConvMatrix    m_convMatrix; //for YUV to YUV or other complicated conversions
+
+    const ConvLut* GetYuvToRgbLut(bool bInputPCRange, bool bBT709, bool bOutputPCRange);
+
+private:
+    std::mutex        m_mutexLuts; // to protect m_yuvToRgbLuts
+    CAutoPtr<ConvLut> m_yuvToRgbLuts[2][2][2];
 };
 
 static ConvFunc& ConvFuncInst()
@@ -614,6 +719,24 @@ ConvFunc::ConvFunc(YuvMatrixType yuv_type, YuvRangeType range, bool bOutputTVRan
     InitConvFunc(yuv_type, range);
 }
 
+const ConvLut* ConvFunc::GetYuvToRgbLut(bool bInputPCRange, bool bBT709, bool bOutputPCRange)
+{
+    std::lock_guard<std::mutex> lock(m_mutexLuts);
+
+    CAutoPtr<ConvLut>& lut = m_yuvToRgbLuts[bInputPCRange][bBT709][bOutputPCRange];
+    if (!lut) {
+        lut.Attach(DEBUG_NEW ConvLut());
+        InitYuvToRgbLut(*lut,
+                        bOutputPCRange ? RGB_LVL_PC : RGB_LVL_TV,
+                        bInputPCRange ? YUV_LVL_PC : YUV_LVL_TV,
+                        bBT709 ? 0.2126 : 0.299,
+                        bBT709 ? 0.7152 : 0.587,
+                        bBT709 ? 0.0722 : 0.114);
+    }
+
+    return lut;
+}
+
 //
 // ColorConvTable
 //
@@ -810,6 +933,14 @@ DWORD ColorConvTable::A8Y8U8V8_TO_ARGB(int a8, int y8, int u8, int v8, YuvMatrix
     return (a8 << 24) | funcs[ConvFuncInst().m_eRangeType == RANGE_PC ? 1 : 0][in_type == BT709 ? 1 : 0][ConvFuncInst().m_bOutputTVRange ? 0 : 1](y8, u8, v8);
 }
 
+void ColorConvTable::AYUV_TO_ARGB(const DWORD* pSrc, DWORD* pDst, size_t count, YuvMatrixType in_type)
+{
+    // Same choice as A8Y8U8V8_TO_ARGB
+    const ConvLut* lut = ConvFuncInst().GetYuvToRgbLut(
+                             ConvFuncInst().m_eRangeType == RANGE_PC, in_type == BT709, !ConvFuncInst().m_bOutputTVRange);
+    lut->Convert(pSrc, pDst, count);
+}
+
 DWORD ColorConvTable::ColorCorrection(DWORD argb)
 {
     if (ConvFuncInst().m_bVSFilterCorrection) {
@@ -61,6 +61,10 @@ struct ColorConvTable {
     static DWORD A8Y8U8V8_TO_CUR_AYUV(int a8, int y8, int u8, int v8, YuvRangeType in_range, YuvMatrixType in_type);
     static DWORD A8Y8U8V8_TO_ARGB(int a8, int y8, int u8, int v8, YuvMatrixType in_type);
 
+    // Same as A8Y8U8V8_TO_ARGB for whole palettes or pixel spans, pSrc and pDst can be the
+    // same buffer. The conversion goes through a lookup table built on first use.
+    static void AYUV_TO_ARGB(const DWORD* pSrc, DWORD* pDst, size_t count, YuvMatrixType in_type);
+
     static DWORD RGB_PC_TO_TV(DWORD argb);
 
     static DWORD ColorCorrection(DWORD argb);
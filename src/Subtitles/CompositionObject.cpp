@@ -48,9 +48,11 @@ CompositionObject::CompositionObject(const CompositionObject& obj)
     , m_nRLEPos(0)
     , m_nColorNumber(obj.m_nColorNumber)
     , m_colors(obj.m_colors)
+    , m_hdmvBackground(0)
 {
     if (obj.m_pRLEData) {
         SetRLEData(obj.m_pRLEData, obj.m_nRLEPos, obj.m_nRLEDataSize);
+        m_pHdmvBitmap = obj.m_pHdmvBitmap;
     }
 }
 
@@ -75,6 +77,8 @@ void CompositionObject::Init()
     m_cropping_width = m_cropping_height = 0;
 
     m_colors.fill(0);
+
+    FreeHdmvCache();
 }
 
 void CompositionObject::Reset()
@@ -86,14 +90,31 @@ void CompositionObject::Reset()
 void CompositionObject::SetPalette(int nNbEntry, const HDMV_PALETTE* pPalette, ColorConvTable::YuvMatrixType currentMatrix)
 {
     m_nColorNumber = nNbEntry;
-    for (int i = 0; i < nNbEntry; i++) {
-        m_colors[pPalette[i].entry_id] = ColorConvTable::A8Y8U8V8_TO_ARGB(pPalette[i].T, pPalette[i].Y, pPalette[i].Cb, pPalette[i].Cr, currentMatrix);
+
+    std::array<DWORD, 256> colors;
+    int nColors = std::min(nNbEntry, int(colors.size()));
+    for (int i = 0; i < nColors; i++) {
+        colors[i] = (DWORD(pPalette[i].T) << 24) | (pPalette[i].Y << 16) | (pPalette[i].Cb << 8) | pPalette[i].Cr;
+    }
+
+    ColorConvTable::AYUV_TO_ARGB(colors.data(), colors.data(), nColors, currentMatrix);
+
+    bool bChanged = false;
+    for (int i = 0; i < nColors; i++) {
+        DWORD& color = m_colors[pPalette[i].entry_id];
+        bChanged |= color != colors[i];
+        color = colors[i];
+    }
+
+    if (bChanged) {
+        m_hdmvPixels.clear();
     }
 }
 
 void CompositionObject::SetRLEData(const BYTE* pBuffer, size_t nSize, size_t nTotalSize)
 {
     delete [] m_pRLEData;
+    FreeHdmvCache();
 
     if (nTotalSize > 0 && nSize <= nTotalSize) {
         m_pRLEData     = DEBUG_NEW BYTE[nTotalSize];
@@ -113,25 +134,54 @@ void CompositionObject::AppendRLEData(const BYTE* pBuffer, size_t nSize)
     if (m_nRLEPos + nSize <= m_nRLEDataSize) {
         memcpy(m_pRLEData + m_nRLEPos, pBuffer, nSize);
         m_nRLEPos += nSize;
+        FreeHdmvCache();
     } else {
         ASSERT(FALSE); // This shouldn't happen in normal operation
     }
 }
 
-void CompositionObject::RenderHdmv(SubPicDesc& spd)
+CRect CompositionObject::GetHdmvCropRect() const
 {
-    if (!m_pRLEData || !m_nColorNumber) {
-        return;
+    CRect r(0, 0, m_width, m_height);
+    if (m_object_cropped_flag) {
+        r &= CRect(CPoint(m_cropping_horizontal_position, m_cropping_vertical_position),
+                   CSize(m_cropping_width, m_cropping_height));
     }
+    return r;
+}
+
+CRect CompositionObject::GetHdmvRect() const
+{
+    return CRect(CPoint(m_horizontal_position, m_vertical_position), GetHdmvCropRect().Size());
+}
+
+const std::shared_ptr<CompositionObject::HdmvBitmap>& CompositionObject::GetHdmvBitmap()
+{
+    if (!m_pHdmvBitmap) {
+        m_pHdmvBitmap = std::make_shared<HdmvBitmap>();
+    }
+    return m_pHdmvBitmap;
+}
+
+void CompositionObject::FreeHdmvCache()
+{
+    m_pHdmvBitmap.reset();
+    std::vector<DWORD>().swap(m_hdmvPixels);
+    m_hdmvBackground = 0;
+}
+
+void CompositionObject::DecodeHdmv(HdmvBitmap& bitmap) const
+{
+    bitmap.indexes.assign(size_t(m_width) * m_height, 0xFF);
 
     CGolombBuffer GBuffer(m_pRLEData, m_nRLEDataSize);
     BYTE  bSwitch;
     BYTE  nPaletteIndex = 0;
     LONG nCount;
-    LONG nX = m_horizontal_position;
-    LONG nY = m_vertical_position;
+    LONG nX = 0;
+    LONG nY = 0;
 
-    while ((nY < (m_vertical_position + m_height)) && !GBuffer.IsEOF()) {
+    while ((nY < m_height) && !GBuffer.IsEOF()) {
         BYTE bTemp = GBuffer.ReadByte();
         if (bTemp != 0) {
             nPaletteIndex = bTemp;
@@ -160,17 +210,80 @@ void CompositionObject::RenderHdmv(SubPicDesc& spd)
         }
 
         if (nCount > 0) {
-            if (nPaletteIndex != 0xFF) {    // Fully transparent (section 9.14.4.2.2.1.1)
-                FillSolidRect(spd, nX, nY, nCount, 1, m_colors[nPaletteIndex]);
+            // 0xFF is fully transparent (section 9.14.4.2.2.1.1)
+            if (nPaletteIndex != 0xFF && nX < m_width) {
+                memset(&bitmap.indexes[size_t(nY) * m_width + nX], nPaletteIndex, std::min(nCount, m_width - nX));
             }
             nX += nCount;
         } else {
             nY++;
-            nX = m_horizontal_position;
+            nX = 0;
         }
     }
 }
 
+void CompositionObject::BlendHdmv(SubPicDesc& spd, const CRect& rcSrc, CPoint ptDst) const
+{
+    const std::vector<BYTE>& indexes = m_pHdmvBitmap->indexes;
+
+    for (LONG y = rcSrc.top; y < rcSrc.bottom; y++) {
+        const BYTE* row = &indexes[size_t(y) * m_width];
+
+        for (LONG x = rcSrc.left, nCount; x < rcSrc.right; x += nCount) {
+            BYTE nPaletteIndex = row[x];
+            for (nCount = 1; x + nCount < rcSrc.right && row[x + nCount] == nPaletteIndex; nCount++) {
+                ;
+            }
+
+            if (nPaletteIndex != 0xFF) {
+                FillSolidRect(spd, ptDst.x + x - rcSrc.left, ptDst.y + y - rcSrc.top, nCount, 1, m_colors[nPaletteIndex]);
+            }
+        }
+    }
+}
+
+void CompositionObject::RenderHdmv(SubPicDesc& spd, bool bCleared)
+{
+    CRect rcSrc = GetHdmvCropRect();
+    if (!m_pRLEData || !m_nColorNumber || rcSrc.IsRectEmpty()) {
+        return;
+    }
+
+    HdmvBitmap& bitmap = *GetHdmvBitmap();
+    if (bitmap.indexes.empty()) {
+        DecodeHdmv(bitmap);
+    }
+
+    CPoint ptDst(m_horizontal_position, m_vertical_position);
+    if (!bCleared) {
+        BlendHdmv(spd, rcSrc, ptDst);
+        return;
+    }
+
+    // The subpicture is cleared with a single color so the blended pixels only depend on it
+    int w = rcSrc.Width(), h = rcSrc.Height();
+    BYTE* dst = (BYTE*)((DWORD*)(spd.bits + spd.pitch * ptDst.y) + ptDst.x);
+    DWORD background = *(DWORD*)dst;
+
+    if (m_hdmvPixels.empty() || m_hdmvBackground != background) {
+        m_hdmvPixels.assign(size_t(w) * h, background);
+        m_hdmvBackground = background;
+
+        SubPicDesc spdCache;
+        spdCache.type = spd.type;
+        spdCache.w = w;
+        spdCache.h = h;
+        spdCache.bpp = 32;
+        spdCache.pitch = w * sizeof(DWORD);
+        spdCache.bits = (BYTE*)m_hdmvPixels.data();
+        BlendHdmv(spdCache, rcSrc, CPoint(0, 0));
+    }
+
+    for (int y = 0; y < h; y++, dst += spd.pitch) {
+        memcpy(dst, &m_hdmvPixels[size_t(y) * w], w * sizeof(DWORD));
+    }
+}
+
 void CompositionObject::RenderDvb(SubPicDesc& spd, short nX, short nY)
 {
     if (!m_pRLEData) {
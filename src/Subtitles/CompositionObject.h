@@ -22,6 +22,8 @@
 
 #include "Rasterizer.h"
 #include "ColorConvTable.h"
+#include <memory>
+#include <vector>
 
 
 struct HDMV_PALETTE {
@@ -37,6 +39,11 @@ class CGolombBuffer;
 class CompositionObject : Rasterizer
 {
 public:
+    // The palette indexes of a decoded HDMV object, shared by the copies of the same object version
+    struct HdmvBitmap {
+        std::vector<BYTE> indexes; // empty until the object is first rendered
+    };
+
     short m_object_id_ref;
     BYTE  m_window_id_ref;
     bool  m_object_cropped_flag;
@@ -66,7 +73,14 @@ public:
     size_t GetRLEDataSize() const { return m_nRLEDataSize; };
     size_t GetRLEPos() const { return m_nRLEPos; };
     bool IsRLEComplete() const { return m_nRLEPos >= m_nRLEDataSize; };
-    void RenderHdmv(SubPicDesc& spd);
+    // The displayed part of the object, it only differs from the whole object when it is cropped
+    CRect GetHdmvRect() const;
+    const std::shared_ptr<HdmvBitmap>& GetHdmvBitmap();
+    void SetHdmvBitmap(const std::shared_ptr<HdmvBitmap>& pBitmap) { m_pHdmvBitmap = pBitmap; };
+    // bCleared tells that nothing was drawn yet where the object goes so that
+    // the pixels blended the last time can be copied as they are
+    void RenderHdmv(SubPicDesc& spd, bool bCleared);
+    void FreeHdmvCache();
     void RenderDvb(SubPicDesc& spd, short nX, short nY);
     void WriteSeg(SubPicDesc& spd, short nX, short nY, short nCount, short nPaletteIndex);
     void SetPalette(int nNbEntry, const HDMV_PALETTE* pPalette, ColorConvTable::YuvMatrixType currentMatrix);
@@ -85,6 +99,15 @@ private:
     int m_nColorNumber;
     std::array<DWORD, 256> m_colors;
 
+    std::shared_ptr<HdmvBitmap> m_pHdmvBitmap;
+    // The displayed part of the object as blended over m_hdmvBackground, empty when outdated
+    std::vector<DWORD> m_hdmvPixels;
+    DWORD m_hdmvBackground;
+
+    CRect GetHdmvCropRect() const;
+    void  DecodeHdmv(HdmvBitmap& bitmap) const;
+    void  BlendHdmv(SubPicDesc& spd, const CRect& rcSrc, CPoint ptDst) const;
+
     void  DvbRenderField(SubPicDesc& spd, CGolombBuffer& gb, short nXStart, short nYStart, short nLength);
     void  Dvb2PixelsCodeString(SubPicDesc& spd, CGolombBuffer& gb, short& nX, short& nY);
     void  Dvb4PixelsCodeString(SubPicDesc& spd, CGolombBuffer& gb, short& nX, short& nY);
@@ -34,8 +34,11 @@ CEllipse::CEllipse(int rx, int ry)
         m_arc[m_ry - dy] = m_arc[m_ry + dy] = std::lround(m_rx * std::sqrt(1 - double(dy * dy) / (m_ry * m_ry)));
     }
 
-    m_intersectCache.clear();
-    m_intersectCache.resize(nIntersectCacheLineSize * m_2ry, NOT_CACHED);
+    const size_t nIntersectCacheSize = nIntersectCacheLineSize * m_2ry;
+    m_intersectCache.reset(DEBUG_NEW std::atomic<int>[nIntersectCacheSize]);
+    for (size_t i = 0; i < nIntersectCacheSize; i++) {
+        m_intersectCache[i].store(NOT_CACHED, std::memory_order_relaxed);
+    }
 }
 
 int CEllipse::GetLeftIntersect(int dx, int dy)
@@ -45,7 +48,7 @@ int CEllipse::GetLeftIntersect(int dx, int dy)
     // Crude conditions to filter every case that won't intersect at all or not on the left
     if (dx > -m_rx && dx < m_rx /*&& dy > -m_2ry*/ && dy < m_2ry) {
         const size_t nCache = nIntersectCacheLineSize * dy + dx + m_rx - 1;
-        int iRes = m_intersectCache[nCache];
+        int iRes = m_intersectCache[nCache].load(std::memory_order_relaxed);
 
         if (iRes == NOT_CACHED) {
             iRes = (dx > 0) ? NO_INTERSECT_INNER : NO_INTERSECT_OUTER;
@@ -67,7 +70,7 @@ int CEllipse::GetLeftIntersect(int dx, int dy)
                 }
             }
 
-            m_intersectCache[nCache] = iRes;
+            m_intersectCache[nCache].store(iRes, std::memory_order_relaxed);
         }
 
         return iRes;
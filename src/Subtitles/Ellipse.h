@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <memory>
 #include <atlcoll.h>
@@ -40,7 +41,8 @@ private:
 
     std::vector<int> m_arc;
 
-    std::vector<int> m_intersectCache;
+    // Ellipses are shared between words which might be rasterized concurrently
+    std::unique_ptr<std::atomic<int>[]> m_intersectCache;
     size_t nIntersectCacheLineSize;
 
 public:
@@ -54,6 +56,11 @@ public:
         return m_ry;
     }
 
+    size_t GetMemoryUsage() const {
+        return sizeof(CEllipse) + m_arc.capacity() * sizeof(int)
+               + nIntersectCacheLineSize * m_2ry * sizeof(std::atomic<int>);
+    }
+
     int GetArc(int dy) const {
         return m_arc[m_ry + dy];
     }
@@ -39,6 +39,7 @@ CPGSSub::CPGSSub(CCritSec* pLock, const CString& name, LCID lcid)
     , m_nTotalSegBuffer(0)
     , m_nSegBufferPos(0)
     , m_nSegSize(0)
+    , m_pLastRenderedSegment(nullptr)
 {
     if (m_name.IsEmpty() || m_name == _T("Unknown")) {
         m_name = _T("PGS Embedded Subtitle");
@@ -216,6 +217,7 @@ void CPGSSub::Reset()
     m_nCurSegment = NO_SEGMENT;
     m_pCurrentPresentationSegment.Free();
     m_pPresentationSegments.RemoveAll();
+    m_pLastRenderedSegment = nullptr;
     for (auto& compositionObject : m_compositionObjects) {
         compositionObject.Reset();
     }
@@ -247,6 +249,21 @@ HRESULT CPGSSub::Render(SubPicDesc& spd, REFERENCE_TIME rt, RECT& bbox, bool bRe
     if (posPresentationSegment) {
         const auto& pPresentationSegment = m_pPresentationSegments.GetAt(posPresentationSegment);
 
+        // The objects keep their decoded bitmaps only while their segment is displayed
+        if (m_pLastRenderedSegment != pPresentationSegment) {
+            POSITION pos = m_pPresentationSegments.GetHeadPosition();
+            while (pos) {
+                const auto& pSegment = m_pPresentationSegments.GetNext(pos);
+                if (pSegment == m_pLastRenderedSegment) {
+                    for (const auto& pObject : pSegment->objects) {
+                        pObject->FreeHdmvCache();
+                    }
+                    break;
+                }
+            }
+            m_pLastRenderedSegment = pPresentationSegment;
+        }
+
         m_eSourceMatrix = ColorConvTable::NONE ? (pPresentationSegment->video_descriptor.nVideoWidth > 720) ? ColorConvTable::BT709 : ColorConvTable::BT601 : m_eSourceMatrix;
 
         TRACE_PGSSUB(_T("CPGSSub:Render Presentation segment %d --> %s - %s\n"), pPresentationSegment->composition_descriptor.nNumber,
@@ -257,17 +274,22 @@ HRESULT CPGSSub::Render(SubPicDesc& spd, REFERENCE_TIME rt, RECT& bbox, bool bRe
         bbox.right = bbox.bottom = 0;
 
         for (const auto& pObject : pPresentationSegment->objects) {
-            if (pObject->GetRLEDataSize() && pObject->m_width > 0 && pObject->m_height > 0
-                    && spd.w >= (pObject->m_horizontal_position + pObject->m_width) && spd.h >= (pObject->m_vertical_position + pObject->m_height)) {
+            CRect rcObject = pObject->GetHdmvRect();
+            if (pObject->GetRLEDataSize() && !rcObject.IsRectEmpty()
+                    && rcObject.left >= 0 && rcObject.top >= 0 && spd.w >= rcObject.right && spd.h >= rcObject.bottom) {
                 pObject->SetPalette(pPresentationSegment->CLUT.size, pPresentationSegment->CLUT.palette.data(), m_eSourceMatrix);
-                bbox.left = std::min(pObject->m_horizontal_position, bbox.left);
-                bbox.top = std::min(pObject->m_vertical_position, bbox.top);
-                bbox.right = std::max(pObject->m_horizontal_position + pObject->m_width, bbox.right);
-                bbox.bottom = std::max(pObject->m_vertical_position + pObject->m_height, bbox.bottom);
+
+                // The subpicture is cleared before rendering so only the objects drawn before can be in the way
+                bool bCleared = !bRendered || !CRect().IntersectRect(rcObject, &bbox);
+
+                bbox.left = std::min(rcObject.left, bbox.left);
+                bbox.top = std::min(rcObject.top, bbox.top);
+                bbox.right = std::max(rcObject.right, bbox.right);
+                bbox.bottom = std::max(rcObject.bottom, bbox.bottom);
 
                 TRACE_PGSSUB(_T(" --> Object %d (Pos=%dx%d, Res=%dx%d, SPDRes=%dx%d)\n"),
                              pObject->m_object_id_ref, pObject->m_horizontal_position, pObject->m_vertical_position, pObject->m_width, pObject->m_height, spd.w, spd.h);
-                pObject->RenderHdmv(spd);
+                pObject->RenderHdmv(spd, bCleared);
 
                 bRendered = true;
             } else {
@@ -318,13 +340,17 @@ void CPGSSub::EnqueuePresentationSegment()
 
             // Get the objects' data
             for (auto& pObject : m_pCurrentPresentationSegment->objects) {
-                const CompositionObject& pObjectData = m_compositionObjects[pObject->m_object_id_ref];
+                CompositionObject& pObjectData = m_compositionObjects[pObject->m_object_id_ref];
 
                 pObject->m_width = pObjectData.m_width;
                 pObject->m_height = pObjectData.m_height;
 
                 if (pObjectData.GetRLEData()) {
                     pObject->SetRLEData(pObjectData.GetRLEData(), pObjectData.GetRLEPos(), pObjectData.GetRLEDataSize());
+                    // The segments showing the same version of an object only decode it once
+                    if (pObjectData.IsRLEComplete()) {
+                        pObject->SetHdmvBitmap(pObjectData.GetHdmvBitmap());
+                    }
                 }
             }
 
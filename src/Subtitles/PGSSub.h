@@ -120,6 +120,9 @@ private:
     std::array<HDMV_CLUT, 256> m_CLUTs;
     std::array<CompositionObject, 64> m_compositionObjects;
 
+    // Only compared to know when the displayed segment changes, never dereferenced
+    const HDMV_PRESENTATION_SEGMENT* m_pLastRenderedSegment;
+
     void AllocSegment(size_t nSize);
     int  ParsePresentationSegment(REFERENCE_TIME rt, CGolombBuffer* pGBuffer);
     void EnqueuePresentationSegment();
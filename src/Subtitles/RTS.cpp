@@ -79,6 +79,8 @@ CWord::CWord(const STSStyle& style, CStringW str, int ktype, int kstart, int ken
              RenderingCaches& renderingCaches)
     : m_fDrawn(false)
     , m_p(INT_MAX, INT_MAX)
+    , m_paintStep(PAINT_NONE)
+    , m_bPaintRasterized(false)
     , m_renderingCaches(renderingCaches)
     , m_scalex(scalex)
     , m_scaley(scaley)
@@ -124,8 +126,22 @@ bool CWord::Append(CWord* w)
 
 void CWord::Paint(const CPoint& p, const CPoint& org)
 {
+    if (PaintPrepare(p, org)) {
+        PaintRasterize();
+    }
+    PaintCommit();
+}
+
+bool CWord::PaintPrepare(const CPoint& p, const CPoint& org)
+{
+    m_paintStep = PAINT_NONE;
+    m_bPaintRasterized = false;
+    m_paintPos = p;
+    m_paintOrg = org;
+
     if (!m_str) {
-        return;
+        m_paintStep = PAINT_ABORTED;
+        return false;
     }
 
     COverlayKey overlayKey(this, p, org);
@@ -141,15 +157,13 @@ void CWord::Paint(const CPoint& p, const CPoint& org)
                 if (m_style.borderStyle == 1) {
                     VERIFY(CreateOpaqueBox());
                 }
+                m_fDrawn = true;
+                m_paintStep = PAINT_RASTERIZE;
             } else {
+                // The path has to be created here since GDI can't be used from several threads
                 if (!CreatePath()) {
-                    return;
-                }
-
-                Transform(CPoint((org.x - p.x) * 8, (org.y - p.y) * 8));
-
-                if (!ScanConvert()) {
-                    return;
+                    m_paintStep = PAINT_ABORTED;
+                    return false;
                 }
 
                 if (m_style.borderStyle == 0 && (m_style.outlineWidthX + m_style.outlineWidthY > 0)) {
@@ -164,33 +178,82 @@ void CWord::Paint(const CPoint& p, const CPoint& org)
                             m_renderingCaches.ellipseCache.SetAt(ellipseKey, m_pEllipse);
                         }
                     }
+                }
 
-                    if (!CreateWidenedRegion(rx, ry)) {
-                        return;
-                    }
-                } else if (m_style.borderStyle == 1) {
-                    VERIFY(CreateOpaqueBox());
+                m_paintStep = PAINT_OUTLINE;
+            }
+        } else if ((m_p.x & 7) != (p.x & 7) || (m_p.y & 7) != (p.y & 7)) {
+            m_paintStep = PAINT_RERASTERIZE;
+        }
+    }
+
+    return m_paintStep >= PAINT_OUTLINE;
+}
+
+void CWord::PaintRasterize()
+{
+    switch (m_paintStep) {
+        case PAINT_OUTLINE:
+            Transform(CPoint((m_paintOrg.x - m_paintPos.x) * 8, (m_paintOrg.y - m_paintPos.y) * 8));
+
+            if (!ScanConvert()) {
+                m_paintStep = PAINT_ABORTED;
+                return;
+            }
+
+            if (m_style.borderStyle == 0 && (m_style.outlineWidthX + m_style.outlineWidthY > 0)) {
+                int rx = std::max<int>(0, std::lround(m_style.outlineWidthX));
+                int ry = std::max<int>(0, std::lround(m_style.outlineWidthY));
+
+                if (!CreateWidenedRegion(rx, ry)) {
+                    m_paintStep = PAINT_ABORTED;
+                    return;
                 }
+            }
+        // no break
+        case PAINT_RASTERIZE:
+        case PAINT_RERASTERIZE:
+            m_bPaintRasterized = Rasterize(m_paintPos.x & 7, m_paintPos.y & 7, m_style.fBlur, m_style.fGaussianBlur);
+            break;
+        default:
+            break;
+    }
+}
+
+void CWord::PaintCommit()
+{
+    switch (m_paintStep) {
+        case PAINT_ABORTED:
+            return;
+        case PAINT_OUTLINE:
+        case PAINT_RASTERIZE: {
+            COverlayKey overlayKey(this, m_paintPos, m_paintOrg);
 
+            if (m_paintStep == PAINT_OUTLINE) {
+                if (m_style.borderStyle == 1) {
+                    VERIFY(CreateOpaqueBox());
+                }
                 m_renderingCaches.outlineCache.SetAt(overlayKey, m_pOutlineData);
+                m_fDrawn = true;
             }
 
-            m_fDrawn = true;
-
-            if (!Rasterize(p.x & 7, p.y & 7, m_style.fBlur, m_style.fGaussianBlur)) {
+            if (!m_bPaintRasterized) {
                 return;
             }
             m_renderingCaches.overlayCache.SetAt(overlayKey, m_pOverlayData);
-        } else if ((m_p.x & 7) != (p.x & 7) || (m_p.y & 7) != (p.y & 7)) {
-            Rasterize(p.x & 7, p.y & 7, m_style.fBlur, m_style.fGaussianBlur);
-            m_renderingCaches.overlayCache.SetAt(overlayKey, m_pOverlayData);
+            break;
         }
+        case PAINT_RERASTERIZE:
+            m_renderingCaches.overlayCache.SetAt(COverlayKey(this, m_paintPos, m_paintOrg), m_pOverlayData);
+            break;
+        default:
+            break;
     }
 
-    m_p = p;
+    m_p = m_paintPos;
 
     if (m_pOpaqueBox) {
-        m_pOpaqueBox->Paint(p, org);
+        m_pOpaqueBox->Paint(m_paintPos, m_paintOrg);
     }
 }
 
@@ -441,7 +504,7 @@ CText::CText(const STSStyle& style, CStringW str, int ktype, int kstart, int ken
 
     CTextDimsKey textDimsKey(m_str, m_style);
     CTextDims textDims;
-    if (!renderingCaches.textDimsCache.Lookup(textDimsKey, textDims)) {
+    if (!renderingCaches.pGlyphCache->LookupTextDims(textDimsKey, textDims)) {
         CMyFont font(m_style);
         m_ascent  = font.m_ascent;
         m_descent = font.m_descent;
@@ -475,7 +538,7 @@ CText::CText(const STSStyle& style, CStringW str, int ktype, int kstart, int ken
         textDims.descent = m_descent;
         textDims.width   = m_width;
 
-        renderingCaches.textDimsCache.SetAt(textDimsKey, textDims);
+        renderingCaches.pGlyphCache->SetTextDims(textDimsKey, textDims);
     } else {
         m_ascent  = textDims.ascent;
         m_descent = textDims.descent;
@@ -499,9 +562,16 @@ bool CText::Append(CWord* w)
 
 bool CText::CreatePath()
 {
+    CTextDimsKey glyphKey(m_str, m_style);
+    CPolygonPathSharedPtr pGlyphPath;
+    if (m_renderingCaches.pGlyphCache->LookupPath(glyphKey, pGlyphPath)) {
+        return SetPath(pGlyphPath->typesOrg.GetData(), pGlyphPath->pointsOrg.GetData(), (int)pGlyphPath->typesOrg.GetCount());
+    }
+
     CMyFont font(m_style);
 
     HFONT hOldFont = SelectFont(g_hDC, font);
+    bool bPathOK = true;
 
     if (m_style.fontSpacing) {
         int width = 0;
@@ -518,7 +588,7 @@ bool CText::CreatePath()
             PartialBeginPath(g_hDC, bFirstPath);
             bFirstPath = false;
             TextOutW(g_hDC, 0, 0, s, 1);
-            PartialEndPath(g_hDC, width, 0);
+            bPathOK &= PartialEndPath(g_hDC, width, 0);
 
             width += extent.cx + (int)m_style.fontSpacing;
         }
@@ -532,11 +602,22 @@ bool CText::CreatePath()
 
         BeginPath(g_hDC);
         TextOutW(g_hDC, 0, 0, m_str, m_str.GetLength());
-        EndPath(g_hDC);
+        bPathOK = EndPath(g_hDC);
     }
 
     SelectFont(g_hDC, hOldFont);
 
+    if (bPathOK) {
+        pGlyphPath = std::make_shared<CPolygonPath>();
+        pGlyphPath->typesOrg.SetCount(mPathPoints);
+        pGlyphPath->pointsOrg.SetCount(mPathPoints);
+        if (mPathPoints > 0) {
+            memcpy(pGlyphPath->typesOrg.GetData(), mpPathTypes, mPathPoints * sizeof(BYTE));
+            memcpy(pGlyphPath->pointsOrg.GetData(), mpPathPoints, mPathPoints * sizeof(POINT));
+        }
+        m_renderingCaches.pGlyphCache->SetPath(glyphKey, pGlyphPath);
+    }
+
     return true;
 }
 
@@ -766,24 +847,7 @@ bool CPolygon::CreatePath()
         return false;
     }
 
-    if (mPathPoints != len) {
-        BYTE* pNewPathTypes = (BYTE*)realloc(mpPathTypes, len * sizeof(BYTE));
-        if (!pNewPathTypes) {
-            return false;
-        }
-        mpPathTypes = pNewPathTypes;
-        POINT* pNewPathPoints = (POINT*)realloc(mpPathPoints, len * sizeof(POINT));
-        if (!pNewPathPoints) {
-            return false;
-        }
-        mpPathPoints = pNewPathPoints;
-        mPathPoints = len;
-    }
-
-    memcpy(mpPathTypes, m_pPolygonPath->typesOrg.GetData(), len * sizeof(BYTE));
-    memcpy(mpPathPoints, m_pPolygonPath->pointsOrg.GetData(), len * sizeof(POINT));
-
-    return true;
+    return SetPath(m_pPolygonPath->typesOrg.GetData(), m_pPolygonPath->pointsOrg.GetData(), len);
 }
 
 // CClipper
@@ -1048,99 +1112,220 @@ void CLine::Compact()
     }
 }
 
-CRect CLine::PaintShadow(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha)
+namespace
 {
-    CRect bbox(0, 0, 0, 0);
+    struct WordPaint {
+        CWord* w;
+        int x, y;
+    };
+
+    struct WordDraw {
+        const Rasterizer* pRasterizer;
+        int x, y;
+        DWORD sw[6];
+        bool fBody, fBorder;
+    };
+
+    // The caches and the GDI based path creation aren't thread-safe so only
+    // the rasterization of the words is done by the thread pool.
+    void PaintWords(const std::vector<WordPaint>& words, const CPoint& org, CThreadPool* pThreadPool)
+    {
+        if (!pThreadPool) {
+            for (const auto& word : words) {
+                word.w->Paint(CPoint(word.x, word.y), org);
+            }
+            return;
+        }
+
+        std::vector<CWord*> pending;
+        for (const auto& word : words) {
+            if (word.w->PaintPrepare(CPoint(word.x, word.y), org)) {
+                pending.push_back(word.w);
+            }
+        }
+
+        pThreadPool->ParallelFor(pending.size(), [&pending](size_t i) {
+            pending[i]->PaintRasterize();
+        });
+
+        for (const auto& word : words) {
+            word.w->PaintCommit();
+        }
+    }
+
+    // Each thread blends all the words into its own band of rows so that
+    // every pixel is blended in the same order as when drawing serially.
+    CRect DrawWords(const std::vector<WordDraw>& draws, SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CThreadPool* pThreadPool)
+    {
+        auto drawBand = [&](CRect& bandClipRect) {
+            CRect bbox(0, 0, 0, 0);
+            for (const auto& draw : draws) {
+                bbox |= draw.pRasterizer->Draw(spd, bandClipRect, pAlphaMask, draw.x, draw.y, draw.sw, draw.fBody, draw.fBorder);
+            }
+            return bbox;
+        };
+
+        const int minBandHeight = 32;
+
+        CRect r(0, 0, spd.w, spd.h);
+        r &= clipRect;
+
+        size_t nBands = 1;
+        if (pThreadPool && !draws.empty() && !r.IsRectEmpty()) {
+            nBands = std::min<size_t>(pThreadPool->GetThreadCount() + 1, r.Height() / minBandHeight);
+        }
+        if (nBands <= 1) {
+            return drawBand(clipRect);
+        }
+
+        std::vector<CRect> bboxes(nBands);
+        pThreadPool->ParallelFor(nBands, [&](size_t i) {
+            CRect band(r.left, r.top + int(r.Height() * i / nBands), r.right, r.top + int(r.Height() * (i + 1) / nBands));
+            bboxes[i] = drawBand(band);
+        });
+
+        CRect bbox(0, 0, 0, 0);
+        for (const auto& bandBBox : bboxes) {
+            bbox |= bandBBox;
+        }
+        return bbox;
+    }
+}
+
+CRect CLine::PaintShadow(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha, CThreadPool* pThreadPool)
+{
+    std::vector<WordPaint> words;
 
     POSITION pos = GetHeadPosition();
     while (pos) {
         CWord* w = GetNext(pos);
 
         if (w->m_fLineBreak) {
-            return bbox;    // should not happen since this class is just a line of text without any breaks
+            break;    // should not happen since this class is just a line of text without any breaks
         }
 
         if (w->m_style.shadowDepthX != 0 || w->m_style.shadowDepthY != 0) {
             int x = p.x + (int)(w->m_style.shadowDepthX + 0.5);
             int y = p.y + m_ascent - w->m_ascent + (int)(w->m_style.shadowDepthY + 0.5);
 
-            DWORD a = 0xff - w->m_style.alpha[3];
-            if (alpha > 0) {
-                a = a * (0xff - static_cast<DWORD>(alpha)) / 0xff;
-            }
-            COLORREF shadow = revcolor(w->m_style.colors[3]) | (a << 24);
-            DWORD sw[6] = {shadow, DWORD_MAX};
-            sw[0] = ColorConvTable::ColorCorrection(sw[0]);
+            words.push_back({ w, x, y });
+        }
 
-            w->Paint(CPoint(x, y), org);
+        p.x += w->m_width;
+    }
 
-            if (w->m_style.borderStyle == 0) {
-                bbox |= w->Draw(spd, clipRect, pAlphaMask, x, y, sw,
-                                w->m_ktype > 0 || w->m_style.alpha[0] < 0xff,
-                                (w->m_style.outlineWidthX + w->m_style.outlineWidthY > 0) && !(w->m_ktype == 2 && time < w->m_kstart));
-            } else if (w->m_style.borderStyle == 1 && w->m_pOpaqueBox) {
-                bbox |= w->m_pOpaqueBox->Draw(spd, clipRect, pAlphaMask, x, y, sw, true, false);
-            }
+    PaintWords(words, org, pThreadPool);
+
+    std::vector<WordDraw> draws;
+    draws.reserve(words.size());
+
+    for (const auto& word : words) {
+        CWord* w = word.w;
+
+        DWORD a = 0xff - w->m_style.alpha[3];
+        if (alpha > 0) {
+            a = a * (0xff - static_cast<DWORD>(alpha)) / 0xff;
         }
+        COLORREF shadow = revcolor(w->m_style.colors[3]) | (a << 24);
+        WordDraw draw = { w, word.x, word.y, {shadow, DWORD_MAX} };
+        draw.sw[0] = ColorConvTable::ColorCorrection(draw.sw[0]);
 
-        p.x += w->m_width;
+        if (w->m_style.borderStyle == 0) {
+            draw.fBody = w->m_ktype > 0 || w->m_style.alpha[0] < 0xff;
+            draw.fBorder = (w->m_style.outlineWidthX + w->m_style.outlineWidthY > 0) && !(w->m_ktype == 2 && time < w->m_kstart);
+            draws.push_back(draw);
+        } else if (w->m_style.borderStyle == 1 && w->m_pOpaqueBox) {
+            draw.pRasterizer = w->m_pOpaqueBox;
+            draw.fBody = true;
+            draw.fBorder = false;
+            draws.push_back(draw);
+        }
     }
 
-    return bbox;
+    return DrawWords(draws, spd, clipRect, pAlphaMask, pThreadPool);
 }
 
-CRect CLine::PaintOutline(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha)
+CRect CLine::PaintOutline(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha, CThreadPool* pThreadPool)
 {
-    CRect bbox(0, 0, 0, 0);
+    std::vector<WordPaint> words;
 
     POSITION pos = GetHeadPosition();
     while (pos) {
         CWord* w = GetNext(pos);
 
         if (w->m_fLineBreak) {
-            return bbox;    // should not happen since this class is just a line of text without any breaks
+            break;    // should not happen since this class is just a line of text without any breaks
         }
 
         if ((w->m_style.outlineWidthX + w->m_style.outlineWidthY > 0 || w->m_style.borderStyle == 1) && !(w->m_ktype == 2 && time < w->m_kstart)) {
             int x = p.x;
             int y = p.y + m_ascent - w->m_ascent;
-            DWORD aoutline = w->m_style.alpha[2];
-            if (alpha > 0) {
-                aoutline += alpha * (0xff - w->m_style.alpha[2]) / 0xff;
-            }
-            COLORREF outline = revcolor(w->m_style.colors[2]) | ((0xff - aoutline) << 24);
-            DWORD sw[6] = {outline, DWORD_MAX};
-            sw[0] = ColorConvTable::ColorCorrection(sw[0]);
 
-            w->Paint(CPoint(x, y), org);
-
-            if (w->m_style.borderStyle == 0) {
-                bbox |= w->Draw(spd, clipRect, pAlphaMask, x, y, sw, !w->m_style.alpha[0] && !w->m_style.alpha[1] && !alpha, true);
-            } else if (w->m_style.borderStyle == 1 && w->m_pOpaqueBox) {
-                bbox |= w->m_pOpaqueBox->Draw(spd, clipRect, pAlphaMask, x, y, sw, true, false);
-            }
+            words.push_back({ w, x, y });
         }
 
         p.x += w->m_width;
     }
 
-    return bbox;
+    PaintWords(words, org, pThreadPool);
+
+    std::vector<WordDraw> draws;
+    draws.reserve(words.size());
+
+    for (const auto& word : words) {
+        CWord* w = word.w;
+
+        DWORD aoutline = w->m_style.alpha[2];
+        if (alpha > 0) {
+            aoutline += alpha * (0xff - w->m_style.alpha[2]) / 0xff;
+        }
+        COLORREF outline = revcolor(w->m_style.colors[2]) | ((0xff - aoutline) << 24);
+        WordDraw draw = { w, word.x, word.y, {outline, DWORD_MAX} };
+        draw.sw[0] = ColorConvTable::ColorCorrection(draw.sw[0]);
+
+        if (w->m_style.borderStyle == 0) {
+            draw.fBody = !w->m_style.alpha[0] && !w->m_style.alpha[1] && !alpha;
+            draw.fBorder = true;
+            draws.push_back(draw);
+        } else if (w->m_style.borderStyle == 1 && w->m_pOpaqueBox) {
+            draw.pRasterizer = w->m_pOpaqueBox;
+            draw.fBody = true;
+            draw.fBorder = false;
+            draws.push_back(draw);
+        }
+    }
+
+    return DrawWords(draws, spd, clipRect, pAlphaMask, pThreadPool);
 }
 
-CRect CLine::PaintBody(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha)
+CRect CLine::PaintBody(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha, CThreadPool* pThreadPool)
 {
-    CRect bbox(0, 0, 0, 0);
+    std::vector<WordPaint> words;
 
     POSITION pos = GetHeadPosition();
     while (pos) {
         CWord* w = GetNext(pos);
 
         if (w->m_fLineBreak) {
-            return bbox;    // should not happen since this class is just a line of text without any breaks
+            break;    // should not happen since this class is just a line of text without any breaks
         }
 
         int x = p.x;
         int y = p.y + m_ascent - w->m_ascent;
+
+        words.push_back({ w, x, y });
+
+        p.x += w->m_width;
+    }
+
+    PaintWords(words, org, pThreadPool);
+
+    std::vector<WordDraw> draws;
+    draws.reserve(words.size());
+
+    for (const auto& word : words) {
+        CWord* w = word.w;
+
         // colors
 
         DWORD aprimary = w->m_style.alpha[0];
@@ -1152,7 +1337,8 @@ CRect CLine::PaintBody(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoin
         COLORREF primary = revcolor(w->m_style.colors[0]) | ((0xff - aprimary) << 24);
         COLORREF secondary = revcolor(w->m_style.colors[1]) | ((0xff - asecondary) << 24);
 
-        DWORD sw[6] = {primary, 0, secondary};
+        WordDraw draw = { w, word.x, word.y, {primary, 0, secondary}, true, false };
+        DWORD* sw = draw.sw;
 
         // karaoke
 
@@ -1191,19 +1377,35 @@ CRect CLine::PaintBody(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoin
             bluradjust += 8;
         }
 
-        w->Paint(CPoint(x, y), org);
-
         sw[0] = ColorConvTable::ColorCorrection(sw[0]);
         sw[2] = ColorConvTable::ColorCorrection(sw[2]);
         sw[3] = (int)(w->m_style.outlineWidthX + t * w->getOverlayWidth() + t * bluradjust) >> 3;
         sw[4] = sw[2];
         sw[5] = 0x00ffffff;
 
-        bbox |= w->Draw(spd, clipRect, pAlphaMask, x, y, sw, true, false);
-        p.x += w->m_width;
+        draws.push_back(draw);
     }
 
-    return bbox;
+    return DrawWords(draws, spd, clipRect, pAlphaMask, pThreadPool);
+}
+
+bool CLine::HasKaraokeChanged(int time1, int time2) const
+{
+    POSITION pos = GetHeadPosition();
+    while (pos) {
+        const CWord* w = GetNext(pos);
+
+        bool bStarted1 = time1 >= w->m_kstart, bStarted2 = time2 >= w->m_kstart;
+        if (bStarted1 != bStarted2) {
+            return true;
+        }
+        // \kf progressively fills the word until its end
+        if (w->m_ktype == 1 && bStarted1 && time1 != time2 && (time1 < w->m_kend || time2 < w->m_kend)) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 
@@ -1578,6 +1780,7 @@ CRenderedTextSubtitle::CRenderedTextSubtitle(CCritSec* pLock)
     , m_bOverrideStyle(false)
     , m_bOverridePlacement(false)
     , m_overridePlacement(50, 90)
+    , m_nRenderingThreads(1)
 {
     m_size = CSize(0, 0);
 
@@ -1689,8 +1892,12 @@ void CRenderedTextSubtitle::OnChanged()
     }
 
     m_subtitleCache.RemoveAll();
+    m_parsedEntries.clear();
 
     m_sla.Empty();
+
+    m_lastFrame.bSubsValid = false;
+    m_lastFrame.subs.clear();
 }
 
 bool CRenderedTextSubtitle::Init(CSize size, const CRect& vidrect)
@@ -1716,13 +1923,30 @@ void CRenderedTextSubtitle::Deinit()
     }
 
     m_subtitleCache.RemoveAll();
+    m_parsedEntries.clear();
 
     m_sla.Empty();
 
+    m_lastFrame.bSubsValid = false;
+    m_lastFrame.subs.clear();
+
     m_size = CSize(0, 0);
     m_vidrect.SetRectEmpty();
 }
 
+void CRenderedTextSubtitle::SetRenderingThreads(int nThreads)
+{
+    if (nThreads <= 0) {
+        nThreads = (int)CThreadPool::GetDefaultThreadCount();
+    }
+
+    if (nThreads != m_nRenderingThreads) {
+        m_nRenderingThreads = nThreads;
+        // The rendering thread takes part in the work so it needs one worker less
+        m_pRenderingThreadPool.reset(nThreads > 1 ? DEBUG_NEW CThreadPool(nThreads - 1) : nullptr);
+    }
+}
+
 void CRenderedTextSubtitle::ParseEffect(CSubtitle* sub, CString str)
 {
     str.Trim();
@@ -1855,7 +2079,7 @@ bool CRenderedTextSubtitle::ParseSSATag(SSATagsList& tagsList, const CStringW& s
     }
 
     int nTags = 0, nUnrecognizedTags = 0;
-    tagsList.reset(DEBUG_NEW CAtlList<SSATag>());
+    tagsList.reset(DEBUG_NEW CAtlArray<SSATag>());
 
     for (int i = 0, j; (j = str.Find(L'\\', i)) >= 0; i = j) {
         int jOld;
@@ -2087,8 +2311,9 @@ bool CRenderedTextSubtitle::ParseSSATag(SSATagsList& tagsList, const CStringW& s
                 break;
         }
 
-        tagsList->AddTail(tag);
+        tagsList->Add(tag);
     }
+    tagsList->FreeExtra();
 
     m_renderingCaches.SSATagsCache.SetAt(str, tagsList);
 
@@ -2103,9 +2328,8 @@ bool CRenderedTextSubtitle::CreateSubFromSSATag(CSubtitle* sub, const SSATagsLis
         return false;
     }
 
-    POSITION pos = tagsList->GetHeadPosition();
-    while (pos) {
-        const SSATag& tag = tagsList->GetNext(pos);
+    for (size_t iTag = 0, nTags = tagsList->GetCount(); iTag < nTags; iTag++) {
+        const SSATag& tag = tagsList->GetAt(iTag);
 
         // TODO: call ParseStyleModifier(cmd, params, ..) and move the rest there
 
@@ -2790,12 +3014,35 @@ CSubtitle* CRenderedTextSubtitle::GetSubtitle(int entry)
     m_polygonBaselineOffset = 0;
     ParseEffect(sub, stse.effect);
 
+    SSAParsedEntry& parsedEntry = m_parsedEntries[entry];
+    const bool fReuseBlocks = parsedEntry.str == str;
+    if (!fReuseBlocks) {
+        parsedEntry.str = str;
+        parsedEntry.blocks.clear();
+    }
+    size_t iBlock = 0;
+
     for (int iStart = 0, iEnd; iStart < str.GetLength(); iStart = iEnd) {
         bool bParsed = false;
 
         if (str[iStart] == L'{' && (iEnd = str.Find(L'}', iStart)) > 0) {
             SSATagsList tagsList;
-            bParsed = ParseSSATag(tagsList, str.Mid(iStart + 1, iEnd - iStart - 1));
+            if (fReuseBlocks) {
+                const auto& blocks = parsedEntry.blocks;
+                while (iBlock < blocks.size() && blocks[iBlock].pos < iStart) {
+                    iBlock++;
+                }
+                if (iBlock < blocks.size() && blocks[iBlock].pos == iStart) {
+                    tagsList = blocks[iBlock].tagsList;
+                    bParsed = true;
+                }
+            }
+            if (!tagsList) {
+                bParsed = ParseSSATag(tagsList, str.Mid(iStart + 1, iEnd - iStart - 1));
+                if (bParsed && !fReuseBlocks) {
+                    parsedEntry.blocks.push_back({ iStart, tagsList });
+                }
+            }
             if (bParsed) {
                 CreateSubFromSSATag(sub, tagsList, stss, orgstss);
                 iStart = iEnd + 1;
@@ -2871,6 +3118,7 @@ STDMETHODIMP CRenderedTextSubtitle::NonDelegatingQueryInterface(REFIID riid, voi
         QI(IPersist)
         QI(ISubStream)
         QI(ISubPicProvider)
+        QI(ISubPicProviderEx)
         __super::NonDelegatingQueryInterface(riid, ppv);
 }
 
@@ -2941,10 +3189,8 @@ struct LSub {
     }
 };
 
-STDMETHODIMP CRenderedTextSubtitle::Render(SubPicDesc& spd, REFERENCE_TIME rt, double fps, RECT& bbox)
+bool CRenderedTextSubtitle::LayoutSubs(SubPicDesc& spd, REFERENCE_TIME rt, double fps, std::vector<RenderedSub>& subs)
 {
-    CRect bbox2(0, 0, 0, 0);
-
     if (m_size != CSize(spd.w * 8, spd.h * 8) || m_vidrect != CRect(spd.vidrect.left * 8, spd.vidrect.top * 8, spd.vidrect.right * 8, spd.vidrect.bottom * 8)) {
         Init(CSize(spd.w, spd.h), spd.vidrect);
     }
@@ -2952,7 +3198,7 @@ STDMETHODIMP CRenderedTextSubtitle::Render(SubPicDesc& spd, REFERENCE_TIME rt, d
     int segment;
     const STSSegment* stss = SearchSubs(rt, fps, &segment);
     if (!stss) {
-        return S_FALSE;
+        return false;
     }
 
     // clear any cached subs that is behind current time
@@ -2965,26 +3211,34 @@ STDMETHODIMP CRenderedTextSubtitle::Render(SubPicDesc& spd, REFERENCE_TIME rt, d
 
             STSEntry& stse = GetAt(entry);
             if (stse.end < rt) {
+                for (auto& rs : m_lastFrame.subs) {
+                    if (rs.pSub == pSub) {
+                        rs.pSub = nullptr;
+                    }
+                }
                 delete pSub;
                 m_subtitleCache.RemoveKey(entry);
+                m_parsedEntries.erase(entry);
             }
         }
     }
 
     m_sla.AdvanceToSegment(segment, stss->subs);
 
-    CAtlArray<LSub> subs;
+    CAtlArray<LSub> lsubs;
 
     for (ptrdiff_t i = 0, j = stss->subs.GetCount(); i < j; i++) {
         const auto idx = stss->subs[i];
         const auto& sts_entry = GetAt(idx);
-        subs.Add({ idx, sts_entry.layer, sts_entry.readorder });
+        lsubs.Add({ idx, sts_entry.layer, sts_entry.readorder });
     }
 
-    std::sort(subs.GetData(), subs.GetData() + subs.GetCount());
+    std::sort(lsubs.GetData(), lsubs.GetData() + lsubs.GetCount());
+
+    subs.reserve(lsubs.GetCount());
 
-    for (ptrdiff_t i = 0, j = subs.GetCount(); i < j; i++) {
-        int entry = subs[i].idx;
+    for (ptrdiff_t i = 0, j = lsubs.GetCount(); i < j; i++) {
+        int entry = lsubs[i].idx;
 
         STSEntry stse = GetAt(entry);
 
@@ -3150,81 +3404,224 @@ STDMETHODIMP CRenderedTextSubtitle::Render(SubPicDesc& spd, REFERENCE_TIME rt, d
             org2 = org;
         }
 
-        CPoint p, p2(0, r.top);
+        subs.push_back({ entry, s, m_time, alpha, r, clipRect, org, org2, pAlphaMask });
+    }
+
+    return true;
+}
+
+CRect CRenderedTextSubtitle::PaintSub(SubPicDesc& spd, const RenderedSub& rs, const CRect& rcUpdate, std::vector<CRect>* pLineBBoxes)
+{
+    CSubtitle* s = rs.pSub;
+    const CPoint& org = rs.org;
+    CThreadPool* pThreadPool = m_pRenderingThreadPool.get();
+
+    // Rectangles for inverse clip
+    CRect clipRects[4];
+    size_t nClipRects = 1;
+    if (s->m_clipInverse) {
+        clipRects[0] = CRect(0, 0, spd.w, rs.clipRect.top);
+        clipRects[1] = CRect(0, rs.clipRect.top, rs.clipRect.left, rs.clipRect.bottom);
+        clipRects[2] = CRect(rs.clipRect.right, rs.clipRect.top, spd.w, rs.clipRect.bottom);
+        clipRects[3] = CRect(0, rs.clipRect.bottom, spd.w, spd.h);
+        nClipRects = 4;
+    } else {
+        clipRects[0] = rs.clipRect;
+    }
+    for (size_t k = 0; k < nClipRects; k++) {
+        clipRects[k] &= rcUpdate;
+    }
+
+    if (pLineBBoxes) {
+        pLineBBoxes->assign(s->GetCount(), CRect(0, 0, 0, 0));
+    }
 
-        POSITION pos;
+    typedef CRect(CLine::*PaintFunc)(SubPicDesc&, CRect&, BYTE*, CPoint, CPoint, int, int, CThreadPool*);
+    const PaintFunc paintFuncs[] = { &CLine::PaintShadow, &CLine::PaintOutline, &CLine::PaintBody };
 
-        p = p2;
+    CRect bbox(0, 0, 0, 0);
 
-        // Rectangles for inverse clip
-        CRect iclipRect[4];
-        iclipRect[0] = CRect(0, 0, spd.w, clipRect.top);
-        iclipRect[1] = CRect(0, clipRect.top, clipRect.left, clipRect.bottom);
-        iclipRect[2] = CRect(clipRect.right, clipRect.top, spd.w, clipRect.bottom);
-        iclipRect[3] = CRect(0, clipRect.bottom, spd.w, spd.h);
+    for (const auto paintFunc : paintFuncs) {
+        CPoint p(0, rs.rect.top);
 
-        pos = s->GetHeadPosition();
+        size_t iLine = 0;
+        POSITION pos = s->GetHeadPosition();
         while (pos) {
             CLine* l = s->GetNext(pos);
 
             p.x = (s->m_scrAlignment % 3) == 1 ? org.x
                   : (s->m_scrAlignment % 3) == 0 ? org.x - l->m_width
                   :                            org.x - (l->m_width / 2);
-            if (s->m_clipInverse) {
-                bbox2 |= l->PaintShadow(spd, iclipRect[0], pAlphaMask, p, org2, m_time, alpha);
-                bbox2 |= l->PaintShadow(spd, iclipRect[1], pAlphaMask, p, org2, m_time, alpha);
-                bbox2 |= l->PaintShadow(spd, iclipRect[2], pAlphaMask, p, org2, m_time, alpha);
-                bbox2 |= l->PaintShadow(spd, iclipRect[3], pAlphaMask, p, org2, m_time, alpha);
-            } else {
-                bbox2 |= l->PaintShadow(spd, clipRect, pAlphaMask, p, org2, m_time, alpha);
+            for (size_t k = 0; k < nClipRects; k++) {
+                CRect lineBBox = (l->*paintFunc)(spd, clipRects[k], rs.pAlphaMask, p, rs.org2, rs.time, rs.alpha, pThreadPool);
+                bbox |= lineBBox;
+                if (pLineBBoxes) {
+                    (*pLineBBoxes)[iLine] |= lineBBox;
+                }
             }
             p.y += l->m_ascent + l->m_descent;
+            iLine++;
         }
+    }
 
-        p = p2;
+    return bbox;
+}
 
-        pos = s->GetHeadPosition();
-        while (pos) {
-            CLine* l = s->GetNext(pos);
+void CRenderedTextSubtitle::SetLastFrame(const SubPicDesc& spd, const CRect& bbox, std::vector<RenderedSub>& subs)
+{
+    m_lastFrame.bits = spd.bits;
+    m_lastFrame.w = spd.w;
+    m_lastFrame.h = spd.h;
+    m_lastFrame.pitch = spd.pitch;
+    m_lastFrame.bbox = bbox;
+    m_lastFrame.bSubsValid = true;
+    m_lastFrame.subs.swap(subs);
+}
 
-            p.x = (s->m_scrAlignment % 3) == 1 ? org.x
-                  : (s->m_scrAlignment % 3) == 0 ? org.x - l->m_width
-                  :                            org.x - (l->m_width / 2);
-            if (s->m_clipInverse) {
-                bbox2 |= l->PaintOutline(spd, iclipRect[0], pAlphaMask, p, org2, m_time, alpha);
-                bbox2 |= l->PaintOutline(spd, iclipRect[1], pAlphaMask, p, org2, m_time, alpha);
-                bbox2 |= l->PaintOutline(spd, iclipRect[2], pAlphaMask, p, org2, m_time, alpha);
-                bbox2 |= l->PaintOutline(spd, iclipRect[3], pAlphaMask, p, org2, m_time, alpha);
-            } else {
-                bbox2 |= l->PaintOutline(spd, clipRect, pAlphaMask, p, org2, m_time, alpha);
+STDMETHODIMP CRenderedTextSubtitle::Render(SubPicDesc& spd, REFERENCE_TIME rt, double fps, RECT& bbox)
+{
+    std::vector<RenderedSub> subs;
+    if (!LayoutSubs(spd, rt, fps, subs)) {
+        SetLastFrame(spd, CRect(0, 0, 0, 0), subs);
+        return S_FALSE;
+    }
+
+    CRect bbox2(0, 0, 0, 0);
+
+    const CRect rcFrame(0, 0, spd.w, spd.h);
+    for (auto& rs : subs) {
+        rs.bbox = PaintSub(spd, rs, rcFrame, &rs.lineBBoxes);
+        bbox2 |= rs.bbox;
+    }
+
+    bool bEmpty = subs.empty();
+    SetLastFrame(spd, bbox2, subs);
+
+    bbox = bbox2;
+
+    return (!bEmpty && !bbox2.IsRectEmpty()) ? S_OK : S_FALSE;
+}
+
+// ISubPicProviderEx
+
+STDMETHODIMP CRenderedTextSubtitle::RenderUpdate(SubPicDesc& spd, REFERENCE_TIME rt, double fps, DWORD clearColor, RECT& bbox, RECT& rcUpdate)
+{
+    if (spd.bpp != 32 || spd.bits != m_lastFrame.bits || spd.w != m_lastFrame.w || spd.h != m_lastFrame.h || spd.pitch != m_lastFrame.pitch) {
+        return E_FAIL;
+    }
+
+    std::vector<RenderedSub> subs;
+    LayoutSubs(spd, rt, fps, subs);
+
+    const CRect rcFrame(0, 0, spd.w, spd.h);
+    CRect rcDirty(0, 0, 0, 0);
+    std::vector<bool> moved(subs.size(), false);
+    bool bRedrawAll = !m_lastFrame.bSubsValid;
+
+    for (const auto& prev : m_lastFrame.subs) {
+        if (std::none_of(subs.cbegin(), subs.cend(), [&prev](const RenderedSub & rs) { return rs.entry == prev.entry; })) {
+            rcDirty |= prev.bbox;
+        }
+    }
+
+    for (size_t i = 0; i < subs.size() && !bRedrawAll; i++) {
+        RenderedSub& rs = subs[i];
+
+        auto it = std::find_if(m_lastFrame.subs.cbegin(), m_lastFrame.subs.cend(), [&rs](const RenderedSub & prev) { return prev.entry == rs.entry; });
+        // The subs with transforms are recreated for every frame so nothing is known about them
+        if (it == m_lastFrame.subs.cend() || it->pSub != rs.pSub || rs.pSub->m_fAnimated
+                || it->clipRect != rs.clipRect || it->pAlphaMask != rs.pAlphaMask
+                || it->rect.Size() != rs.rect.Size() || it->org2 - it->rect.TopLeft() != rs.org2 - rs.rect.TopLeft()) {
+            bRedrawAll = true;
+            break;
+        }
+        const RenderedSub& prev = *it;
+
+        if (rs.rect != prev.rect) {
+            // The sub only moved so its new position is known as long as it wasn't clipped
+            CRect rcVisible = rcFrame & prev.clipRect;
+            rcVisible.DeflateRect(1, 1);
+            if (rs.pSub->m_clipInverse || prev.bbox.IsRectEmpty() || (prev.bbox & rcVisible) != prev.bbox) {
+                bRedrawAll = true;
+                break;
+            }
+
+            // Leave some room for the rounding of the position to whole pixels
+            CRect rcMoved = prev.bbox;
+            rcMoved.OffsetRect((rs.rect.left - prev.rect.left) >> 3, (rs.rect.top - prev.rect.top) >> 3);
+            rcMoved.InflateRect(2, 2);
+
+            rcDirty |= prev.bbox;
+            rcDirty |= rcMoved & rs.clipRect;
+            moved[i] = true;
+        } else {
+            rs.bbox = prev.bbox;
+            rs.lineBBoxes = prev.lineBBoxes;
+
+            if (rs.alpha != prev.alpha) {
+                rcDirty |= prev.bbox;
+            } else if (rs.time != prev.time) {
+                size_t iLine = 0;
+                POSITION pos = rs.pSub->GetHeadPosition();
+                while (pos) {
+                    const CLine* l = rs.pSub->GetNext(pos);
+                    if (l->HasKaraokeChanged(prev.time, rs.time)) {
+                        rcDirty |= prev.lineBBoxes[iLine];
+                    }
+                    iLine++;
+                }
             }
-            p.y += l->m_ascent + l->m_descent;
         }
+    }
 
-        p = p2;
+    auto clearRect = [&spd, clearColor](const CRect & r) {
+        BYTE* p = spd.bits + spd.pitch * r.top + r.left * 4;
+        for (int j = r.top; j < r.bottom; j++, p += spd.pitch) {
+            memsetd(p, clearColor, r.Width() * 4);
+        }
+    };
 
-        pos = s->GetHeadPosition();
-        while (pos) {
-            CLine* l = s->GetNext(pos);
+    CRect bbox2(0, 0, 0, 0);
 
-            p.x = (s->m_scrAlignment % 3) == 1 ? org.x
-                  : (s->m_scrAlignment % 3) == 0 ? org.x - l->m_width
-                  :                            org.x - (l->m_width / 2);
-            if (s->m_clipInverse) {
-                bbox2 |= l->PaintBody(spd, iclipRect[0], pAlphaMask, p, org2, m_time, alpha);
-                bbox2 |= l->PaintBody(spd, iclipRect[1], pAlphaMask, p, org2, m_time, alpha);
-                bbox2 |= l->PaintBody(spd, iclipRect[2], pAlphaMask, p, org2, m_time, alpha);
-                bbox2 |= l->PaintBody(spd, iclipRect[3], pAlphaMask, p, org2, m_time, alpha);
-            } else {
-                bbox2 |= l->PaintBody(spd, clipRect, pAlphaMask, p, org2, m_time, alpha);
+    if (bRedrawAll) {
+        // Clear what is left of the previous frame and draw everything again
+        rcDirty = m_lastFrame.bbox & rcFrame;
+        clearRect(rcDirty);
+
+        for (auto& rs : subs) {
+            rs.bbox = PaintSub(spd, rs, rcFrame, &rs.lineBBoxes);
+            bbox2 |= rs.bbox;
+        }
+        rcDirty |= bbox2;
+    } else {
+        // Every sub overlapping the dirty area is drawn again in the same order
+        // but only inside it so that the rest of the picture is left untouched
+        rcDirty &= rcFrame;
+        if (!rcDirty.IsRectEmpty()) {
+            clearRect(rcDirty);
+
+            for (size_t i = 0; i < subs.size(); i++) {
+                RenderedSub& rs = subs[i];
+                if (moved[i]) {
+                    rs.bbox = PaintSub(spd, rs, rcDirty, &rs.lineBBoxes);
+                } else if (!(rs.bbox & rcDirty).IsRectEmpty()) {
+                    PaintSub(spd, rs, rcDirty, nullptr);
+                }
             }
-            p.y += l->m_ascent + l->m_descent;
+        }
+
+        for (const auto& rs : subs) {
+            bbox2 |= rs.bbox;
         }
     }
 
+    bool bEmpty = subs.empty();
+    SetLastFrame(spd, bbox2, subs);
+
     bbox = bbox2;
+    rcUpdate = rcDirty;
 
-    return (subs.GetCount() && !bbox2.IsRectEmpty()) ? S_OK : S_FALSE;
+    return (!bEmpty && !bbox2.IsRectEmpty()) ? S_OK : S_FALSE;
 }
 
 // IPersist
@@ -3329,5 +3726,8 @@ STDMETHODIMP CRenderedTextSubtitle::SetSourceTargetInfo(CString yuvVideoMatrix,
     bool bTransformColors = !bIsVSFilter && !m_sYCbCrMatrix.IsEmpty();
     ColorConvTable::SetDefaultConvType(yuvMatrix, yuvRange, (targetWhiteLevel < 245), bTransformColors);
 
+    // The colors might have changed
+    m_lastFrame.bSubsValid = false;
+
     return S_OK;
 }
@@ -23,9 +23,13 @@
 
 #include <list>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include "STS.h"
 #include "Rasterizer.h"
 #include "../SubPic/SubPicProviderImpl.h"
+#include "../DSUtil/ThreadPool.h"
 #include "RenderingCache.h"
 
 class Effect;
@@ -76,9 +80,20 @@ struct CAlphaMask final : std::unique_ptr<BYTE[]> {
 
 typedef std::shared_ptr<CPolygonPath> CPolygonPathSharedPtr;
 struct SSATag;
-typedef std::shared_ptr<CAtlList<SSATag>> SSATagsList;
+typedef std::shared_ptr<CAtlArray<SSATag>> SSATagsList;
 typedef std::shared_ptr<CAlphaMask> CAlphaMaskSharedPtr;
 
+struct CTextDims;
+
+// Memory owned by the values stored in the rendering caches
+size_t GetRenderingCacheSize(const CTextDims& textDims);
+size_t GetRenderingCacheSize(const CPolygonPathSharedPtr& pPolygonPath);
+size_t GetRenderingCacheSize(const SSATagsList& tagsList);
+size_t GetRenderingCacheSize(const CEllipseSharedPtr& pEllipse);
+size_t GetRenderingCacheSize(const COutlineDataSharedPtr& pOutlineData);
+size_t GetRenderingCacheSize(const COverlayDataSharedPtr& pOverlayData);
+size_t GetRenderingCacheSize(const CAlphaMaskSharedPtr& pAlphaMask);
+
 typedef CRenderingCache<CTextDimsKey, CTextDims, CKeyTraits<CTextDimsKey>> CTextDimsCache;
 typedef CRenderingCache<CPolygonPathKey, CPolygonPathSharedPtr, CKeyTraits<CPolygonPathKey>> CPolygonCache;
 typedef CRenderingCache<CStringW, SSATagsList, CStringElementTraits<CStringW>> CSSATagsCache;
@@ -86,9 +101,43 @@ typedef CRenderingCache<CEllipseKey, CEllipseSharedPtr, CKeyTraits<CEllipseKey>>
 typedef CRenderingCache<COutlineKey, COutlineDataSharedPtr, CKeyTraits<COutlineKey>> COutlineCache;
 typedef CRenderingCache<COverlayKey, COverlayDataSharedPtr, CKeyTraits<COverlayKey>> COverlayCache;
 typedef CRenderingCache<CClipperKey, CAlphaMaskSharedPtr, CKeyTraits<CClipperKey>> CAlphaMaskCache;
+typedef CRenderingCache<CTextDimsKey, CPolygonPathSharedPtr, CKeyTraits<CTextDimsKey>> CGlyphPathCache;
+
+// The text dimensions and the glyph outlines only depend on the text and on the font
+// so they are shared by all the renderers, switching or reloading a track can then
+// reuse what was already obtained from GDI. All the methods are thread-safe.
+class CGlyphCache
+{
+    mutable std::mutex m_mutex; // to protect the caches
+    CRenderingCacheBudget m_budget;
+    CTextDimsCache m_textDimsCache;
+    CGlyphPathCache m_pathCache;
+
+public:
+    static const size_t DEFAULT_BUDGET = 32 * 1024 * 1024;
+
+    CGlyphCache();
+
+    CGlyphCache(const CGlyphCache&) = delete;
+    CGlyphCache& operator=(const CGlyphCache&) = delete;
+
+    bool LookupTextDims(const CTextDimsKey& key, CTextDims& textDims);
+    void SetTextDims(const CTextDimsKey& key, const CTextDims& textDims);
+    bool LookupPath(const CTextDimsKey& key, CPolygonPathSharedPtr& pPath);
+    void SetPath(const CTextDimsKey& key, const CPolygonPathSharedPtr& pPath);
+
+    CRenderingCacheStats GetTextDimsStats() const;
+    CRenderingCacheStats GetPathStats() const;
+    size_t GetBytes() const;
+
+    // The instance is created on first use and lives until the process exits
+    static std::shared_ptr<CGlyphCache> GetInstance();
+};
 
 struct RenderingCaches {
-    CTextDimsCache textDimsCache;
+    std::shared_ptr<CGlyphCache> pGlyphCache;
+    // The memory budget shared by all the caches, it has to outlive them
+    CRenderingCacheBudget budget;
     CPolygonCache polygonCache;
     CSSATagsCache SSATagsCache;
     CEllipseCache ellipseCache;
@@ -98,14 +147,18 @@ struct RenderingCaches {
     std::list<CAlphaMask> alphaMaskPool;
     CAlphaMaskCache alphaMaskCache;
 
+    static const size_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+    // The entry limits only keep the hash maps reasonably small, the memory is bounded by the budget
     RenderingCaches()
-        : textDimsCache(2048)
-        , polygonCache(2048)
-        , SSATagsCache(2048)
-        , ellipseCache(64)
-        , outlineCache(128)
-        , overlayCache(128)
-        , alphaMaskCache(128) {}
+        : pGlyphCache(CGlyphCache::GetInstance())
+        , budget(DEFAULT_BUDGET)
+        , polygonCache(2048, &budget)
+        , SSATagsCache(2048, &budget)
+        , ellipseCache(64, &budget)
+        , outlineCache(2048, &budget)
+        , overlayCache(2048, &budget)
+        , alphaMaskCache(128, &budget) {}
 };
 
 class CMyFont : public CFont
@@ -128,6 +181,17 @@ class CWord : public Rasterizer
     bool m_fDrawn;
     CPoint m_p;
 
+    enum PaintStep {
+        PAINT_NONE,         // nothing left to do but to commit the new position
+        PAINT_ABORTED,      // something failed, the word won't be painted
+        PAINT_OUTLINE,      // the outline has to be created and then rasterized
+        PAINT_RASTERIZE,    // the outline is known, it only needs to be rasterized
+        PAINT_RERASTERIZE   // the subpixel position changed, the outline needs to be rasterized again
+    };
+    PaintStep m_paintStep;
+    bool m_bPaintRasterized;
+    CPoint m_paintPos, m_paintOrg;
+
     void Transform(CPoint org);
 
     void Transform_C(const CPoint& org);
@@ -163,6 +227,13 @@ public:
 
     void Paint(const CPoint& p, const CPoint& org);
 
+    // Paint() split in three steps so that the rasterization of several words can run concurrently.
+    // Only PaintRasterize() is allowed to run on a worker thread, the two other steps access the caches
+    // and the shared GDI context. PaintPrepare() returns true when PaintRasterize() has some work to do.
+    bool PaintPrepare(const CPoint& p, const CPoint& org);
+    void PaintRasterize();
+    void PaintCommit();
+
     friend class COutlineKey;
 };
 
@@ -287,9 +358,15 @@ public:
 
     void Compact();
 
-    CRect PaintShadow(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha);
-    CRect PaintOutline(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha);
-    CRect PaintBody(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha);
+    CRect PaintShadow(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha,
+                      CThreadPool* pThreadPool = nullptr);
+    CRect PaintOutline(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha,
+                       CThreadPool* pThreadPool = nullptr);
+    CRect PaintBody(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha,
+                    CThreadPool* pThreadPool = nullptr);
+
+    // true if the karaoke effects make the line look different at those two times
+    bool HasKaraokeChanged(int time1, int time2) const;
 };
 
 enum SSATagCmd {
@@ -354,11 +431,40 @@ enum SSATagCmd {
 #define SSA_CMD_MIN_LENGTH 1
 #define SSA_CMD_MAX_LENGTH 5
 
+// The numeric parameters of a tag are stored inline, no tag has more than N of them
+template<typename T, size_t N>
+class CSSATagParams
+{
+    T m_params[N];
+    size_t m_nCount = 0;
+
+public:
+    bool IsEmpty() const {
+        return m_nCount == 0;
+    }
+
+    size_t GetCount() const {
+        return m_nCount;
+    }
+
+    void Add(T param) {
+        ASSERT(m_nCount < N);
+        if (m_nCount < N) {
+            m_params[m_nCount++] = param;
+        }
+    }
+
+    const T& operator[](size_t i) const {
+        ASSERT(i < m_nCount);
+        return m_params[i];
+    }
+};
+
 struct SSATag {
     SSATagCmd cmd;
     CAtlArray<CStringW, CStringElementTraits<CStringW>> params;
-    CAtlArray<int> paramsInt;
-    CAtlArray<double> paramsReal;
+    CSSATagParams<int, 8> paramsInt;
+    CSSATagParams<double, 4> paramsReal;
     SSATagsList subTagsList;
 
     SSATag() : cmd(SSA_unknown) {};
@@ -366,15 +472,25 @@ struct SSATag {
     SSATag(const SSATag& tag)
         : cmd(tag.cmd)
         , params()
-        , paramsInt()
-        , paramsReal()
+        , paramsInt(tag.paramsInt)
+        , paramsReal(tag.paramsReal)
         , subTagsList(tag.subTagsList) {
         params.Copy(tag.params);
-        paramsInt.Copy(tag.paramsInt);
-        paramsReal.Copy(tag.paramsReal);
     }
 };
 
+// The override blocks of an entry, kept once parsed since the animated
+// entries have to be built again for every frame
+struct SSAParsedEntry {
+    struct Block {
+        int pos; // of the opening brace in the text
+        SSATagsList tagsList;
+    };
+
+    CStringW str; // the text the blocks were parsed from
+    std::vector<Block> blocks;
+};
+
 enum eftype {
     EF_MOVE = 0,    // {\move(x1=param[0], y1=param[1], x2=param[2], y2=param[3], t1=t[0], t2=t[1])} or {\pos(x=param[0], y=param[1])}
     EF_ORG,         // {\org(x=param[0], y=param[1])}
@@ -446,11 +562,42 @@ class __declspec(uuid("537DCACA-2812-4a4f-B2C6-1A34C17ADEB0"))
 {
     static CAtlMap<CStringW, SSATagCmd, CStringElementTraits<CStringW>> s_SSATagCmds;
     CAtlMap<int, CSubtitle*> m_subtitleCache;
+    std::unordered_map<int, SSAParsedEntry> m_parsedEntries;
 
     RenderingCaches m_renderingCaches;
 
+    // Worker pool used to rasterize and blend the words in parallel, nullptr when rendering serially
+    int m_nRenderingThreads;
+    std::unique_ptr<CThreadPool> m_pRenderingThreadPool;
+
     CScreenLayoutAllocator m_sla;
 
+    // Where and how a subtitle is drawn in a frame
+    struct RenderedSub {
+        int entry;
+        CSubtitle* pSub;
+        int time, alpha;
+        CRect rect, clipRect;
+        CPoint org, org2;
+        BYTE* pAlphaMask;
+        CRect bbox;
+        std::vector<CRect> lineBBoxes;
+    };
+
+    // The last frame drawn by Render or RenderUpdate, it lets RenderUpdate
+    // redraw only the subtitles and lines which changed since then
+    struct RenderedFrame {
+        BYTE* bits = nullptr;
+        int w = 0, h = 0, pitch = 0;
+        CRect bbox;
+        bool bSubsValid = false;
+        std::vector<RenderedSub> subs;
+    } m_lastFrame;
+
+    bool LayoutSubs(SubPicDesc& spd, REFERENCE_TIME rt, double fps, std::vector<RenderedSub>& subs);
+    CRect PaintSub(SubPicDesc& spd, const RenderedSub& rs, const CRect& rcUpdate, std::vector<CRect>* pLineBBoxes);
+    void SetLastFrame(const SubPicDesc& spd, const CRect& bbox, std::vector<RenderedSub>& subs);
+
     CSize m_size;
     CRect m_vidrect;
 
@@ -498,6 +645,14 @@ public:
         m_overridePlacement.SetSize(lHorPos, lVerPos);
     }
 
+    // nThreads == 1 renders serially, nThreads == 0 uses one thread per logical processor.
+    // The output is identical whatever the number of threads.
+    void SetRenderingThreads(int nThreads);
+
+    const RenderingCaches& GetRenderingCaches() const {
+        return m_renderingCaches;
+    }
+
 public:
     bool Init(CSize size, const CRect& vidrect); // will call Deinit()
     void Deinit();
@@ -513,6 +668,9 @@ public:
     STDMETHODIMP_(bool) IsAnimated(POSITION pos);
     STDMETHODIMP Render(SubPicDesc& spd, REFERENCE_TIME rt, double fps, RECT& bbox);
 
+    // ISubPicProviderEx
+    STDMETHODIMP RenderUpdate(SubPicDesc& spd, REFERENCE_TIME rt, double fps, DWORD clearColor, RECT& bbox, RECT& rcUpdate);
+
     // IPersist
     STDMETHODIMP GetClassID(CLSID* pClassID);
 
@@ -39,6 +39,7 @@ Rasterizer::Rasterizer()
     , mpPathPoints(nullptr)
     , mPathPoints(0)
     , m_bUseAVX2(false)
+    , m_blendKernel(std::min(BlendKernel::SSE2, s_maxBlendKernel))
     , mpEdgeBuffer(nullptr)
     , mEdgeHeapSize(0)
     , mEdgeNext(0)
@@ -51,6 +52,19 @@ Rasterizer::Rasterizer()
     }
     __cpuidex(cpuInfo, 7, 0);
     m_bUseAVX2 = !!(cpuInfo[1] & (1 << 5)) && (_xgetbv(_XCR_XFEATURE_ENABLED_MASK) & 0x6) == 0x6;
+    // AVX-512BW also needs the OS to save the opmask and the upper ZMM registers
+    bool bUseAVX512 = m_bUseAVX2 && (cpuInfo[1] & (1 << 16)) && (cpuInfo[1] & (1 << 30))
+                      && (_xgetbv(_XCR_XFEATURE_ENABLED_MASK) & 0xE6) == 0xE6;
+
+    m_blendKernel = std::min(bUseAVX512 ? BlendKernel::AVX512 : m_bUseAVX2 ? BlendKernel::AVX2 : BlendKernel::SSE2,
+                             s_maxBlendKernel);
+}
+
+Rasterizer::BlendKernel Rasterizer::s_maxBlendKernel = Rasterizer::BlendKernel::AVX512;
+
+void Rasterizer::SetMaxBlendKernel(BlendKernel kernel)
+{
+    s_maxBlendKernel = kernel;
 }
 
 Rasterizer::~Rasterizer()
@@ -337,6 +351,35 @@ bool Rasterizer::PartialEndPath(HDC hdc, long dx, long dy)
     return false;
 }
 
+bool Rasterizer::SetPath(const BYTE* pTypes, const POINT* pPoints, int nPoints)
+{
+    if (nPoints <= 0) {
+        _TrashPath();
+        return true;
+    }
+
+    if (mPathPoints != nPoints) {
+        BYTE* pNewPathTypes = (BYTE*)realloc(mpPathTypes, nPoints * sizeof(BYTE));
+        if (pNewPathTypes) {
+            mpPathTypes = pNewPathTypes;
+        }
+        POINT* pNewPathPoints = (POINT*)realloc(mpPathPoints, nPoints * sizeof(POINT));
+        if (pNewPathPoints) {
+            mpPathPoints = pNewPathPoints;
+        }
+        if (!pNewPathTypes || !pNewPathPoints) {
+            _TrashPath();
+            return false;
+        }
+        mPathPoints = nPoints;
+    }
+
+    memcpy(mpPathTypes, pTypes, nPoints * sizeof(BYTE));
+    memcpy(mpPathPoints, pPoints, nPoints * sizeof(POINT));
+
+    return true;
+}
+
 bool Rasterizer::ScanConvert()
 {
     try {
@@ -796,7 +839,8 @@ bool Rasterizer::Rasterize(int xsub, int ysub, int fBlur, double fGaussianBlur)
     m_pOverlayData->mOffsetX = m_pOutlineData->mPathOffsetX - xsub;
     m_pOverlayData->mOffsetY = m_pOutlineData->mPathOffsetY - ysub;
 
-    m_pOutlineData->mWideBorder = (m_pOutlineData->mWideBorder + 7) & ~7;
+    // The outline data can be shared with other words being rasterized at the same time so it must not be modified
+    const int wideBorder = (m_pOutlineData->mWideBorder + 7) & ~7;
 
     if (!m_pOutlineData->mWideOutline.empty() || fBlur || fGaussianBlur > 0) {
         int bluradjust = 0;
@@ -810,14 +854,14 @@ bool Rasterizer::Rasterize(int xsub, int ysub, int fBlur, double fGaussianBlur)
         // Expand the buffer a bit when we're blurring, since that can also widen the borders a bit
         bluradjust = (bluradjust + 7) & ~7;
 
-        width  += 2 * m_pOutlineData->mWideBorder + bluradjust * 2;
-        height += 2 * m_pOutlineData->mWideBorder + bluradjust * 2;
+        width  += 2 * wideBorder + bluradjust * 2;
+        height += 2 * wideBorder + bluradjust * 2;
 
-        xsub += m_pOutlineData->mWideBorder + bluradjust;
-        ysub += m_pOutlineData->mWideBorder + bluradjust;
+        xsub += wideBorder + bluradjust;
+        ysub += wideBorder + bluradjust;
 
-        m_pOverlayData->mOffsetX -= m_pOutlineData->mWideBorder + bluradjust;
-        m_pOverlayData->mOffsetY -= m_pOutlineData->mWideBorder + bluradjust;
+        m_pOverlayData->mOffsetX -= wideBorder + bluradjust;
+        m_pOverlayData->mOffsetY -= wideBorder + bluradjust;
     }
 
     m_pOverlayData->mOverlayWidth = ((width + 7) >> 3) + 1;
@@ -874,13 +918,16 @@ bool Rasterizer::Rasterize(int xsub, int ysub, int fBlur, double fGaussianBlur)
         }
     }
 
+    // The blur passes reuse the scratch memory of the thread instead of allocating it on every call
+    static thread_local SeparableFilterScratch scratch;
+
     // Do some gaussian blur magic
     if (fGaussianBlur > 0) {
         GaussianKernel filter(fGaussianBlur);
         if (m_pOverlayData->mOverlayWidth >= filter.width && m_pOverlayData->mOverlayHeight >= filter.width) {
             size_t pitch = m_pOverlayData->mOverlayPitch;
 
-            byte* tmp = (byte*)_aligned_malloc(pitch * m_pOverlayData->mOverlayHeight * sizeof(byte), 16);
+            byte* tmp = scratch.GetImage(pitch * m_pOverlayData->mOverlayHeight * sizeof(byte));
             if (!tmp) {
                 return false;
             }
@@ -896,13 +943,22 @@ bool Rasterizer::Rasterize(int xsub, int ysub, int fBlur, double fGaussianBlur)
             } else
 #endif
             {
-                SeparableFilterX_SSE2(src, tmp, m_pOverlayData->mOverlayWidth, m_pOverlayData->mOverlayHeight, pitch,
-                                      filter.kernel, filter.width, filter.divisor);
-                SeparableFilterY_SSE2(tmp, src, m_pOverlayData->mOverlayWidth, m_pOverlayData->mOverlayHeight, pitch,
-                                      filter.kernel, filter.width, filter.divisor);
+                if (m_bUseAVX2) {
+                    if (!SeparableFilterX_AVX2(src, tmp, m_pOverlayData->mOverlayWidth, m_pOverlayData->mOverlayHeight, pitch,
+                                               filter.kernel, filter.width, filter.divisor, scratch)
+                            || !SeparableFilterY_AVX2(tmp, src, m_pOverlayData->mOverlayWidth, m_pOverlayData->mOverlayHeight, pitch,
+                                                      filter.kernel, filter.width, filter.divisor, scratch)) {
+                        return false;
+                    }
+                } else {
+                    if (!SeparableFilterX_SSE2(src, tmp, m_pOverlayData->mOverlayWidth, m_pOverlayData->mOverlayHeight, pitch,
+                                               filter.kernel, filter.width, filter.divisor, scratch)
+                            || !SeparableFilterY_SSE2(tmp, src, m_pOverlayData->mOverlayWidth, m_pOverlayData->mOverlayHeight, pitch,
+                                                      filter.kernel, filter.width, filter.divisor, scratch)) {
+                        return false;
+                    }
+                }
             }
-
-            _aligned_free(tmp);
         }
     }
 
@@ -912,7 +968,7 @@ bool Rasterizer::Rasterize(int xsub, int ysub, int fBlur, double fGaussianBlur)
         if (m_pOverlayData->mOverlayWidth >= 3 && m_pOverlayData->mOverlayHeight >= 3) {
             int pitch = m_pOverlayData->mOverlayPitch;
 
-            byte* tmp = DEBUG_NEW byte[pitch * m_pOverlayData->mOverlayHeight];
+            byte* tmp = scratch.GetImage(pitch * m_pOverlayData->mOverlayHeight);
             if (!tmp) {
                 return false;
             }
@@ -920,19 +976,23 @@ bool Rasterizer::Rasterize(int xsub, int ysub, int fBlur, double fGaussianBlur)
             byte* buffer = m_pOutlineData->mWideOutline.empty() ? m_pOverlayData->mpOverlayBufferBody : m_pOverlayData->mpOverlayBufferBorder;
             memcpy(tmp, buffer, pitch * m_pOverlayData->mOverlayHeight);
 
-            // This could be done in a separated way and win some speed
-            for (ptrdiff_t j = 1; j < m_pOverlayData->mOverlayHeight - 1; j++) {
-                byte* src = tmp + pitch * j + 1;
-                byte* dst = buffer + pitch * j + 1;
-
-                for (ptrdiff_t i = 1; i < m_pOverlayData->mOverlayWidth - 1; i++, src++, dst++) {
-                    *dst = (src[-1 - pitch] + (src[-pitch] << 1) + src[+1 - pitch]
-                            + (src[-1] << 1) + (src[0] << 2) + (src[+1] << 1)
-                            + src[-1 + pitch] + (src[+pitch] << 1) + src[+1 + pitch]) >> 4;
+#if defined(_M_IX86_FP) && _M_IX86_FP < 2
+            if (!m_bUseSSE2) {
+                for (ptrdiff_t j = 1; j < m_pOverlayData->mOverlayHeight - 1; j++) {
+                    byte* src = tmp + pitch * j + 1;
+                    byte* dst = buffer + pitch * j + 1;
+
+                    for (ptrdiff_t i = 1; i < m_pOverlayData->mOverlayWidth - 1; i++, src++, dst++) {
+                        *dst = (src[-1 - pitch] + (src[-pitch] << 1) + src[+1 - pitch]
+                                + (src[-1] << 1) + (src[0] << 2) + (src[+1] << 1)
+                                + src[-1 + pitch] + (src[+pitch] << 1) + src[+1 + pitch]) >> 4;
+                    }
                 }
+            } else
+#endif
+            {
+                Blur3x3_SSE2(buffer, tmp, m_pOverlayData->mOverlayWidth, m_pOverlayData->mOverlayHeight, pitch);
             }
-
-            delete [] tmp;
         }
     }
 
@@ -1494,7 +1554,7 @@ namespace
                 __m128i d1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst));
                 __m128i d2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + 16));
                 __m128i d3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + 32));
-                __m128i d4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + 64));
+                __m128i d4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + 48));
 
                 auto c_r_low = _mm256_castsi256_si128(c_r);
                 auto c_g_low = _mm256_castsi256_si128(c_g);
@@ -1520,6 +1580,203 @@ namespace
         }
     };
 
+    // Requires AVX-512BW, the tails shorter than 64 pixels are left to the AVX2 version
+    struct AVX512 {
+
+        // Calculate alpha value AVX-512
+        static __forceinline __m512i __vectorcall calc_alpha_value(__m512i alpha, DWORD color, size_t) {
+            const int ROUNDING_ERR = 1 << (6 - 1);
+
+            const __m512i zero = _mm512_setzero_si512();
+            const __m512i color_alpha_128 = _mm512_set1_epi16(color >> 24);
+            const __m512i round_err_128 = _mm512_set1_epi16(ROUNDING_ERR);
+
+            __m512i srchi = alpha;
+            alpha = _mm512_unpacklo_epi8(alpha, zero);
+            srchi = _mm512_unpackhi_epi8(srchi, zero);
+            alpha = _mm512_mullo_epi16(alpha, color_alpha_128);
+            srchi = _mm512_mullo_epi16(srchi, color_alpha_128);
+            alpha = _mm512_adds_epu16(alpha, round_err_128);
+            alpha = _mm512_srli_epi16(alpha, 6);
+            srchi = _mm512_adds_epu16(srchi, round_err_128);
+            srchi = _mm512_srli_epi16(srchi, 6);
+            alpha = _mm512_packus_epi16(alpha, srchi);
+
+            return alpha;
+        }
+
+        static __forceinline __m512i calc_alpha_value(__m512i border, DWORD color, const BYTE* __restrict,
+                                                      const BYTE* __restrict body, size_t i) {
+            return calc_alpha_value(_mm512_subs_epu8(border, _mm512_loadu_si512(body + i)), color, 0);
+        }
+
+        static __forceinline __m512i calc_alpha_value(__m512i alpha, DWORD color, const BYTE* __restrict am, size_t i) {
+            const int ROUNDING_ERR = 1 << (12 - 1);
+
+            const __m512i color_alpha_128 = _mm512_set1_epi16(color >> 24);
+            const __m512i round_err_128 = _mm512_set1_epi16(ROUNDING_ERR >> 8);
+
+            const __m512i zero = _mm512_setzero_si512();
+
+            __m512i mask = _mm512_loadu_si512(am + i);
+            __m512i src1hi = alpha;
+            __m512i maskhi = mask;
+
+            alpha = _mm512_unpacklo_epi8(alpha, zero);
+            src1hi = _mm512_unpackhi_epi8(src1hi, zero);
+            mask = _mm512_unpacklo_epi8(zero, mask);
+            maskhi = _mm512_unpackhi_epi8(zero, maskhi);
+            alpha = _mm512_mullo_epi16(alpha, color_alpha_128);
+            src1hi = _mm512_mullo_epi16(src1hi, color_alpha_128);
+            alpha = _mm512_mulhi_epu16(alpha, mask);
+            src1hi = _mm512_mulhi_epu16(src1hi, maskhi);
+            alpha = _mm512_adds_epu16(alpha, round_err_128);
+            src1hi = _mm512_adds_epu16(src1hi, round_err_128);
+            alpha = _mm512_srli_epi16(alpha, 12 + 8 - 16);
+            src1hi = _mm512_srli_epi16(src1hi, 12 + 8 - 16);
+            alpha = _mm512_packus_epi16(alpha, src1hi);
+
+            return alpha;
+        }
+
+        static __forceinline __m512i calc_alpha_value(__m512i border, DWORD color, const BYTE* __restrict,
+                                                      const BYTE* __restrict body, const BYTE* __restrict am,
+                                                      size_t i) {
+            return calc_alpha_value(_mm512_subs_epu8(border, _mm512_loadu_si512(body + i)), color, am, i);
+        }
+
+        static __forceinline __m512i pix_mix_row(const __m512i& dst, const __m512i& c_r, const __m512i& c_g,
+                                                 const __m512i& c_b, const __m512i& a) {
+            __m512i d_a, d_r, d_g, d_b;
+
+            d_a = _mm512_srli_epi32(dst, 24);
+
+            d_r = _mm512_slli_epi32(dst, 8);
+            d_r = _mm512_srli_epi32(d_r, 24);
+
+            d_g = _mm512_slli_epi32(dst, 16);
+            d_g = _mm512_srli_epi32(d_g, 24);
+
+            d_b = _mm512_slli_epi32(dst, 24);
+            d_b = _mm512_srli_epi32(d_b, 24);
+
+            d_r = _mm512_or_si512(d_r, c_r);
+            d_g = _mm512_or_si512(d_g, c_g);
+            d_b = _mm512_or_si512(d_b, c_b);
+
+            d_a = _mm512_mullo_epi16(d_a, a);
+            d_r = _mm512_madd_epi16(d_r, a);
+            d_g = _mm512_madd_epi16(d_g, a);
+            d_b = _mm512_madd_epi16(d_b, a);
+
+            d_a = _mm512_srli_epi32(d_a, 8);
+            d_r = _mm512_srli_epi32(d_r, 8);
+            d_g = _mm512_srli_epi32(d_g, 8);
+            d_b = _mm512_srli_epi32(d_b, 8);
+
+            d_a = _mm512_slli_epi32(d_a, 24);
+            d_r = _mm512_slli_epi32(d_r, 16);
+            d_g = _mm512_slli_epi32(d_g, 8);
+
+            d_b = _mm512_or_si512(d_b, d_g);
+            d_b = _mm512_or_si512(d_b, d_r);
+
+            return _mm512_or_si512(d_b, d_a);
+        }
+
+        template <typename... Args>
+        static __forceinline void pix_mix_row(BYTE* __restrict dst, const BYTE* __restrict alpha, int w, DWORD color,
+                                              Args... args) {
+            const __m512i c_r = _mm512_set1_epi32((color & 0xFF0000));
+            const __m512i c_g = _mm512_set1_epi32((color & 0xFF00) << 8);
+            const __m512i c_b = _mm512_set1_epi32((color & 0xFF) << 16);
+
+            const __m512i zero = _mm512_setzero_si512();
+            const __m512i ones = _mm512_set1_epi16(1);
+
+            const BYTE* alpha_end0 = alpha + (w & ~63);
+
+            // The unpacking below works inside each 128-bit lane, this puts the alpha values
+            // of the pixels blended with d1 in the first dword of every lane, d3 in the second,
+            // d2 in the third and d4 in the fourth
+            const __m512i perm_mask = _mm512_set_epi32(15, 7, 11, 3, 14, 6, 10, 2, 13, 5, 9, 1, 12, 4, 8, 0);
+
+            int i = 0;
+            for (; alpha < alpha_end0; alpha += 64, dst += 64 * 4, i += 64) {
+                __m512i a = _mm512_loadu_si512(alpha);
+
+                __m512i d1 = _mm512_loadu_si512(dst);
+                __m512i d2 = _mm512_loadu_si512(dst + 64);
+                __m512i d3 = _mm512_loadu_si512(dst + 128);
+                __m512i d4 = _mm512_loadu_si512(dst + 192);
+
+                a = calc_alpha_value(a, color, args..., i);
+                a = _mm512_permutexvar_epi32(perm_mask, a);
+
+                __m512i ra = _mm512_ternarylogic_epi32(a, a, a, 0x55);
+
+                __m512i a1 = _mm512_unpacklo_epi8(ra, a);
+                __m512i a2 = _mm512_unpackhi_epi8(ra, a);
+
+                __m512i a3 = _mm512_unpackhi_epi8(a1, zero);
+                a1 = _mm512_unpacklo_epi8(a1, zero);
+
+                __m512i a4 = _mm512_unpackhi_epi8(a2, zero);
+                a2 = _mm512_unpacklo_epi8(a2, zero);
+
+                a1 = _mm512_add_epi16(a1, ones);
+                a3 = _mm512_add_epi16(a3, ones);
+
+                a2 = _mm512_add_epi16(a2, ones);
+                a4 = _mm512_add_epi16(a4, ones);
+
+                d1 = pix_mix_row(d1, c_r, c_g, c_b, a1);
+                d2 = pix_mix_row(d2, c_r, c_g, c_b, a2);
+                d3 = pix_mix_row(d3, c_r, c_g, c_b, a3);
+                d4 = pix_mix_row(d4, c_r, c_g, c_b, a4);
+
+                _mm512_storeu_si512(dst, d1);
+                _mm512_storeu_si512(dst + 64, d2);
+                _mm512_storeu_si512(dst + 128, d3);
+                _mm512_storeu_si512(dst + 192, d4);
+            }
+
+            // The AVX2 version also takes care of zeroing the upper halves of the registers
+            AVX2::pix_mix_row(dst, alpha, w & 63, color, (args + i)...);
+        }
+
+        template <typename... Args>
+        static __forceinline void pix_mix_row(BYTE* dst, BYTE alpha, int w, DWORD color, Args... args) {
+            const __m512i c_r = _mm512_set1_epi32((color & 0xFF0000));
+            const __m512i c_g = _mm512_set1_epi32((color & 0xFF00) << 8);
+            const __m512i c_b = _mm512_set1_epi32((color & 0xFF) << 16);
+
+            const int ROUNDING_ERR = 1 << (6 - 1);
+            const DWORD a_ = (alpha * (color >> 24) + ROUNDING_ERR) >> 6;
+            const __m512i a = _mm512_set1_epi32(((a_ + 1) << 16) | (0x100 - a_));
+
+            const BYTE* dst_end0 = dst + ((4 * w) & ~255);
+            for (; dst < dst_end0; dst += 64 * 4) {
+                __m512i d1 = _mm512_loadu_si512(dst);
+                __m512i d2 = _mm512_loadu_si512(dst + 64);
+                __m512i d3 = _mm512_loadu_si512(dst + 128);
+                __m512i d4 = _mm512_loadu_si512(dst + 192);
+
+                d1 = pix_mix_row(d1, c_r, c_g, c_b, a);
+                d2 = pix_mix_row(d2, c_r, c_g, c_b, a);
+                d3 = pix_mix_row(d3, c_r, c_g, c_b, a);
+                d4 = pix_mix_row(d4, c_r, c_g, c_b, a);
+
+                _mm512_storeu_si512(dst, d1);
+                _mm512_storeu_si512(dst + 64, d2);
+                _mm512_storeu_si512(dst + 128, d3);
+                _mm512_storeu_si512(dst + 192, d4);
+            }
+
+            AVX2::pix_mix_row(dst, alpha, w & 63, color, args...);
+        }
+    };
+
     ///////////////////////////////////////////////////////////////////////////
 
     // Draw single color fill or shadow
@@ -1690,19 +1947,23 @@ namespace
     }
 
     template <class... Args>
-    __forceinline void DrawInternal(bool bUseAVX2, Args&& ... args)
+    __forceinline void DrawInternal(Rasterizer::BlendKernel kernel, Args&& ... args)
     {
-#ifndef __AVX2__
-        if (bUseAVX2) {
-#endif
-            DrawInternal<AVX2>(std::forward<Args>(args)...);
-#ifndef __AVX2__
-        } else {
-            DrawInternal<SSE2>(std::forward<Args>(args)...);
+        switch (kernel) {
+            case Rasterizer::BlendKernel::AVX512:
+                DrawInternal<AVX512>(std::forward<Args>(args)...);
+                break;
+            case Rasterizer::BlendKernel::AVX2:
+                DrawInternal<AVX2>(std::forward<Args>(args)...);
+                break;
+            case Rasterizer::BlendKernel::SSE2:
+                DrawInternal<SSE2>(std::forward<Args>(args)...);
+                break;
+            default:
+                // The C version is only used as a reference to check the others
+                DrawInternal<C>(std::forward<Args>(args)...);
+                break;
         }
-#endif
-        // C version is not used, provided only for reference
-        // DrawInternal<C>(std::forward<Args>(args)...);
     }
 }
 
@@ -1784,48 +2045,48 @@ CRect Rasterizer::Draw(SubPicDesc& spd, CRect& clipRect, byte* pAlphaMask, int x
     switch (draw_op) {
         case BODY:
             // Draw single color fill or shadow
-            DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts);
+            DrawInternal(m_blendKernel, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts);
             break;
         case NONE:
             // Draw single color border
             ASSERT(s == srcBorder);
             __assume(s == srcBorder);
-            DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
+            DrawInternal(m_blendKernel, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
                          srcBody);
             break;
         case BODY | SWITCHPOINT:
             // Draw multi color fill or shadow
-            DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, xo);
+            DrawInternal(m_blendKernel, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, xo);
             break;
         case SWITCHPOINT:
             // Draw multi color border
             ASSERT(s == srcBorder);
             __assume(s == srcBorder);
-            DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
+            DrawInternal(m_blendKernel, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
                          srcBody, xo);
             break;
         case ALPHA:
             // Draw single color border with alpha mask
             ASSERT(s == srcBorder);
             __assume(s == srcBorder);
-            DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
+            DrawInternal(m_blendKernel, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
                          srcBody, alphaMask, spd.w);
             break;
         case ALPHA | BODY:
             // Draw single color fill or shadow with alpha mask
-            DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, alphaMask,
+            DrawInternal(m_blendKernel, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, alphaMask,
                          spd.w);
             break;
         case ALPHA | SWITCHPOINT:
             // Draw multi color border with alpha mask
             ASSERT(s == srcBorder);
             __assume(s == srcBorder);
-            DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
+            DrawInternal(m_blendKernel, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
                          srcBody, alphaMask, spd.w, xo);
             break;
         case ALPHA | BODY | SWITCHPOINT:
             // Draw multi color fill or shadow with alpha mask
-            DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, alphaMask,
+            DrawInternal(m_blendKernel, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, alphaMask,
                          spd.w, xo);
             break;
         default:
@@ -1839,5 +2100,5 @@ void Rasterizer::FillSolidRect(SubPicDesc& spd, int x, int y, int nWidth, int nH
 {
     ASSERT(spd.w >= x + nWidth && spd.h >= y + nHeight);
     BYTE* dst = (BYTE*)((DWORD*)(spd.bits + spd.pitch * y) + x);
-    DrawInternal(m_bUseAVX2, dst, spd.pitch, BYTE(0x40), nWidth, nHeight, lColor);
+    DrawInternal(m_blendKernel, dst, spd.pitch, BYTE(0x40), nWidth, nHeight, lColor);
 }
@@ -129,6 +129,21 @@ typedef std::shared_ptr<COverlayData> COverlayDataSharedPtr;
 
 class Rasterizer
 {
+public:
+    // Instruction sets the overlays can be blended with, from the slowest to the fastest
+    enum class BlendKernel {
+        C,
+        SSE2,
+        AVX2,
+        AVX512
+    };
+
+    // Limits the kernel used by the rasterizers created afterwards, mostly to compare their output
+    static void SetMaxBlendKernel(BlendKernel kernel);
+
+private:
+    static BlendKernel s_maxBlendKernel;
+
     bool fFirstSet;
     CPoint firstp, lastp;
 
@@ -137,6 +152,7 @@ protected:
     POINT* mpPathPoints;
     int mPathPoints;
     bool m_bUseAVX2;
+    BlendKernel m_blendKernel;
 
 private:
     enum {
@@ -178,6 +194,8 @@ public:
     bool EndPath(HDC hdc);
     bool PartialBeginPath(HDC hdc, bool bClearPath);
     bool PartialEndPath(HDC hdc, long dx, long dy);
+    // Replaces the current path by a copy of the given one
+    bool SetPath(const BYTE* pTypes, const POINT* pPoints, int nPoints);
     bool ScanConvert();
     bool CreateWidenedRegion(int borderX, int borderY);
     bool Rasterize(int xsub, int ysub, int fBlur, double fGaussianBlur);
@@ -22,6 +22,142 @@
 #include "RenderingCache.h"
 #include "RTS.h"
 
+void CRenderingCacheBudget::MakeRoom(size_t bytes)
+{
+    while (m_bytes + bytes > m_maxBytes) {
+        CCache* pOldestCache = nullptr;
+        ULONGLONG oldestAccess = ULLONG_MAX;
+
+        POSITION pos = m_caches.GetHeadPosition();
+        while (pos) {
+            CCache* pCache = m_caches.GetNext(pos);
+            ULONGLONG access;
+            if (pCache->GetLeastRecentAccess(access) && access < oldestAccess) {
+                pOldestCache = pCache;
+                oldestAccess = access;
+            }
+        }
+
+        if (!pOldestCache) {
+            break; // Nothing left to evict
+        }
+        pOldestCache->EvictLeastRecent();
+    }
+}
+
+CGlyphCache::CGlyphCache()
+    : m_budget(DEFAULT_BUDGET)
+    , m_textDimsCache(8192, &m_budget)
+    , m_pathCache(8192, &m_budget)
+{
+}
+
+bool CGlyphCache::LookupTextDims(const CTextDimsKey& key, CTextDims& textDims)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_textDimsCache.Lookup(key, textDims);
+}
+
+void CGlyphCache::SetTextDims(const CTextDimsKey& key, const CTextDims& textDims)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_textDimsCache.SetAt(key, textDims);
+}
+
+bool CGlyphCache::LookupPath(const CTextDimsKey& key, CPolygonPathSharedPtr& pPath)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pathCache.Lookup(key, pPath);
+}
+
+void CGlyphCache::SetPath(const CTextDimsKey& key, const CPolygonPathSharedPtr& pPath)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pathCache.SetAt(key, pPath);
+}
+
+CRenderingCacheStats CGlyphCache::GetTextDimsStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_textDimsCache.GetStats();
+}
+
+CRenderingCacheStats CGlyphCache::GetPathStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pathCache.GetStats();
+}
+
+size_t CGlyphCache::GetBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget.GetBytes();
+}
+
+std::shared_ptr<CGlyphCache> CGlyphCache::GetInstance()
+{
+    // Holding a reference here keeps the cache alive between two tracks
+    static std::shared_ptr<CGlyphCache> pInstance = std::make_shared<CGlyphCache>();
+    return pInstance;
+}
+
+size_t GetRenderingCacheSize(const CTextDims& /*textDims*/)
+{
+    return 0;
+}
+
+size_t GetRenderingCacheSize(const CPolygonPathSharedPtr& pPolygonPath)
+{
+    return pPolygonPath ? sizeof(CPolygonPath)
+           + pPolygonPath->typesOrg.GetCount() * sizeof(BYTE)
+           + pPolygonPath->pointsOrg.GetCount() * sizeof(CPoint) : 0;
+}
+
+size_t GetRenderingCacheSize(const SSATagsList& tagsList)
+{
+    size_t size = 0;
+
+    if (tagsList) {
+        size += sizeof(CAtlArray<SSATag>);
+
+        for (size_t i = 0; i < tagsList->GetCount(); i++) {
+            const SSATag& tag = tagsList->GetAt(i);
+
+            size += sizeof(SSATag);
+            for (size_t j = 0; j < tag.params.GetCount(); j++) {
+                size += tag.params[j].GetAllocLength() * sizeof(WCHAR);
+            }
+            size += GetRenderingCacheSize(tag.subTagsList);
+        }
+    }
+
+    return size;
+}
+
+size_t GetRenderingCacheSize(const CEllipseSharedPtr& pEllipse)
+{
+    return pEllipse ? pEllipse->GetMemoryUsage() : 0;
+}
+
+size_t GetRenderingCacheSize(const COutlineDataSharedPtr& pOutlineData)
+{
+    return pOutlineData ? sizeof(COutlineData)
+           + pOutlineData->mOutline.capacity() * sizeof(tSpanBuffer::value_type)
+           + pOutlineData->mWideOutline.capacity() * sizeof(tSpanBuffer::value_type) : 0;
+}
+
+size_t GetRenderingCacheSize(const COverlayDataSharedPtr& pOverlayData)
+{
+    // The body and the border buffers
+    return pOverlayData ? sizeof(COverlayData)
+           + 2 * size_t(pOverlayData->mOverlayPitch) * pOverlayData->mOverlayHeight : 0;
+}
+
+size_t GetRenderingCacheSize(const CAlphaMaskSharedPtr& pAlphaMask)
+{
+    return pAlphaMask ? sizeof(CAlphaMask) + pAlphaMask->m_size : 0;
+}
+
 CTextDimsKey::CTextDimsKey(const CStringW& str, const STSStyle& style)
     : m_str(str)
     , m_style(DEBUG_NEW STSStyle(style))
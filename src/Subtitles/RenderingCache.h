@@ -22,19 +22,129 @@
 
 #include <atlcoll.h>
 
+struct CRenderingCacheStats {
+    size_t nHits = 0, nMisses = 0, nEvictions = 0;
+    size_t nEntries = 0, nBytes = 0;
+};
+
+// Memory budget shared by several rendering caches. When it is exceeded,
+// the least recently used entry of all the caches is evicted first.
+class CRenderingCacheBudget
+{
+public:
+    class CCache
+    {
+    public:
+        // Returns false when the cache is empty
+        virtual bool GetLeastRecentAccess(ULONGLONG& access) const = 0;
+        virtual void EvictLeastRecent() = 0;
+
+    protected:
+        ~CCache() = default;
+    };
+
+private:
+    size_t m_maxBytes;
+    size_t m_bytes;
+    ULONGLONG m_clock;
+    CAtlList<CCache*> m_caches;
+
+public:
+    explicit CRenderingCacheBudget(size_t maxBytes)
+        : m_maxBytes(maxBytes)
+        , m_bytes(0)
+        , m_clock(0) {}
+
+    void Register(CCache* pCache) {
+        m_caches.AddTail(pCache);
+    }
+
+    void Unregister(CCache* pCache) {
+        POSITION pos = m_caches.Find(pCache);
+        if (pos) {
+            m_caches.RemoveAt(pos);
+        }
+    }
+
+    ULONGLONG Tick() {
+        return ++m_clock;
+    }
+
+    void Add(size_t bytes) {
+        m_bytes += bytes;
+    }
+
+    void Remove(size_t bytes) {
+        ASSERT(m_bytes >= bytes);
+        m_bytes -= bytes;
+    }
+
+    // Evicts entries until the given amount of bytes fits in the budget or all the caches are empty
+    void MakeRoom(size_t bytes);
+
+    size_t GetMaxBytes() const { return m_maxBytes; };
+    size_t GetBytes() const { return m_bytes; };
+};
+
 template<typename K, typename V, class KTraits = CElementTraits<K>, class VTraits = CElementTraits<V>>
-class CRenderingCache : private CAtlMap<K, POSITION, KTraits>
+class CRenderingCache : private CAtlMap<K, POSITION, KTraits>, private CRenderingCacheBudget::CCache
 {
 private:
     size_t m_maxSize;
+    CRenderingCacheBudget* m_pBudget;
     struct CPositionValue {
         POSITION pos;
         V value;
+        size_t size;
+        ULONGLONG access;
     };
     CAtlList<CPositionValue> m_list;
+    CRenderingCacheStats m_stats;
+
+    // Approximation of the memory used by an entry, the heap memory owned by
+    // the value is given by the GetRenderingCacheSize() overload for its type
+    static size_t GetEntrySize(typename VTraits::INARGTYPE value) {
+        return sizeof(K) + sizeof(CPositionValue) + GetRenderingCacheSize(value);
+    }
+
+    void RemoveEntry(POSITION listPos) {
+        const CPositionValue& posVal = m_list.GetAt(listPos);
+        m_stats.nBytes -= posVal.size;
+        if (m_pBudget) {
+            m_pBudget->Remove(posVal.size);
+        }
+        __super::RemoveAtPos(posVal.pos);
+        m_list.RemoveAt(listPos);
+    }
+
+    virtual bool GetLeastRecentAccess(ULONGLONG& access) const override {
+        if (m_list.IsEmpty()) {
+            return false;
+        }
+        access = m_list.GetTail().access;
+        return true;
+    }
+
+    virtual void EvictLeastRecent() override {
+        RemoveEntry(m_list.GetTailPosition());
+        m_stats.nEvictions++;
+    }
 
 public:
-    CRenderingCache(size_t maxSize) : m_maxSize(maxSize) {};
+    CRenderingCache(size_t maxSize, CRenderingCacheBudget* pBudget = nullptr)
+        : m_maxSize(maxSize)
+        , m_pBudget(pBudget) {
+        if (m_pBudget) {
+            m_pBudget->Register(this);
+        }
+    };
+
+    ~CRenderingCache() {
+        Clear();
+        if (m_pBudget) {
+            m_pBudget->Unregister(this);
+        }
+    }
 
     bool Lookup(KINARGTYPE key, _Out_ typename VTraits::OUTARGTYPE value) {
         POSITION pos;
@@ -42,39 +152,71 @@ public:
 
         if (bFound) {
             m_list.MoveToHead(pos);
-            value = m_list.GetHead().value;
+            CPositionValue& posVal = m_list.GetHead();
+            if (m_pBudget) {
+                posVal.access = m_pBudget->Tick();
+            }
+            value = posVal.value;
+            m_stats.nHits++;
+        } else {
+            m_stats.nMisses++;
         }
 
         return bFound;
     };
 
+    // Unlike Lookup() this doesn't count as an access of the entry
+    bool Contains(KINARGTYPE key) const {
+        POSITION pos;
+        return __super::Lookup(key, pos);
+    }
+
     POSITION SetAt(KINARGTYPE key, typename VTraits::INARGTYPE value) {
         POSITION pos;
-        bool bFound = __super::Lookup(key, pos);
 
-        if (bFound) {
-            m_list.MoveToHead(pos);
-            CPositionValue& posVal = m_list.GetHead();
-            pos = posVal.pos;
-            posVal.value = value;
-        } else {
-            if (m_list.GetCount() >= m_maxSize) {
-                __super::RemoveAtPos(m_list.GetTail().pos);
-                m_list.RemoveTailNoReturn();
-            }
-            pos = __super::SetAt(key, m_list.AddHead());
-            CPositionValue& posVal = m_list.GetHead();
-            posVal.pos = pos;
-            posVal.value = value;
+        // The size of the new value might be different so the entry is replaced completely
+        if (__super::Lookup(key, pos)) {
+            RemoveEntry(pos);
+        }
+
+        if (m_list.GetCount() >= m_maxSize) {
+            EvictLeastRecent();
+        }
+
+        const size_t size = GetEntrySize(value);
+        if (m_pBudget) {
+            m_pBudget->MakeRoom(size);
+        }
+
+        pos = __super::SetAt(key, m_list.AddHead());
+        CPositionValue& posVal = m_list.GetHead();
+        posVal.pos = pos;
+        posVal.value = value;
+        posVal.size = size;
+        posVal.access = m_pBudget ? m_pBudget->Tick() : 0;
+
+        m_stats.nBytes += size;
+        if (m_pBudget) {
+            m_pBudget->Add(size);
         }
 
         return pos;
     };
 
     void Clear() {
+        if (m_pBudget) {
+            m_pBudget->Remove(m_stats.nBytes);
+        }
+        m_stats.nBytes = 0;
         m_list.RemoveAll();
         __super::RemoveAll();
     }
+
+    CRenderingCacheStats GetStats() const {
+        CRenderingCacheStats stats = m_stats;
+        stats.nEntries = m_list.GetCount();
+        return stats;
+    }
 };
 
 template <class Key>
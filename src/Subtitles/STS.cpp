@@ -23,12 +23,15 @@
 #include "STS.h"
 #include <atlbase.h>
 #include <algorithm>
+#include <memory>
+#include <vector>
 
 #include "RealTextParser.h"
 #include <fstream>
 #include "USFSubtitles.h"
 
 #include "../DSUtil/PathUtils.h"
+#include "../DSUtil/ThreadPool.h"
 
 
 struct htmlcolor {
@@ -452,6 +455,88 @@ static CStringW RemoveSSATags(CStringW str, bool fUnicode, int CharSet)
 
 //
 
+namespace
+{
+    enum class ParseResult {
+        SKIPPED,
+        PARSED,
+        FAILED
+    };
+
+    // Collects the records read by a parser and turns them into entries, on several threads
+    // when there are enough of them. The entries are added in the order of the records so the
+    // result is the same as when adding them one by one while reading the file.
+    template<class Record>
+    class CEntryBatch
+    {
+        static const size_t RECORDS_PER_TASK = 128;
+        static const size_t MIN_PARALLEL_RECORDS = 4 * RECORDS_PER_TASK;
+        static const size_t MAX_RECORDS = 16384;
+
+        CSimpleTextSubtitle& m_sts;
+        std::vector<Record> m_records;
+        std::unique_ptr<CThreadPool> m_pThreadPool;
+
+    public:
+        explicit CEntryBatch(CSimpleTextSubtitle& sts)
+            : m_sts(sts) {
+        }
+
+        bool IsEmpty() const {
+            return m_records.empty();
+        }
+
+        bool IsFull() const {
+            return m_records.size() >= MAX_RECORDS;
+        }
+
+        const Record& GetAt(size_t i) const {
+            return m_records[i];
+        }
+
+        void Push(Record&& record) {
+            m_records.emplace_back(std::move(record));
+        }
+
+        // Returns the index of the first record which couldn't be parsed or SIZE_MAX if there is none.
+        // The entries before a failed record are still added and the records are then kept.
+        size_t Flush() {
+            const size_t nRecords = m_records.size();
+            std::vector<STSEntry> entries(nRecords);
+            std::vector<ParseResult> results(nRecords);
+
+            auto parse = [&](size_t iTask) {
+                for (size_t i = iTask * RECORDS_PER_TASK, end = std::min(i + RECORDS_PER_TASK, nRecords); i < end; i++) {
+                    results[i] = m_records[i].Parse(entries[i]);
+                }
+            };
+
+            const size_t nTasks = (nRecords + RECORDS_PER_TASK - 1) / RECORDS_PER_TASK;
+            if (nRecords >= MIN_PARALLEL_RECORDS && !m_pThreadPool && CThreadPool::GetDefaultThreadCount() > 1) {
+                m_pThreadPool.reset(DEBUG_NEW CThreadPool(CThreadPool::GetDefaultThreadCount() - 1));
+            }
+            if (nRecords >= MIN_PARALLEL_RECORDS && m_pThreadPool) {
+                m_pThreadPool->ParallelFor(nTasks, parse);
+            } else {
+                for (size_t i = 0; i < nTasks; i++) {
+                    parse(i);
+                }
+            }
+
+            for (size_t i = 0; i < nRecords; i++) {
+                if (results[i] == ParseResult::FAILED) {
+                    return i;
+                } else if (results[i] == ParseResult::PARSED) {
+                    m_sts.AddEntry(entries[i]);
+                }
+            }
+
+            m_records.clear();
+            return SIZE_MAX;
+        }
+    };
+}
+
 static CStringW SubRipper2SSA(CStringW str, int CharSet)
 {
     str.Replace(L"<i>", L"{\\i1}");
@@ -466,6 +551,20 @@ static CStringW SubRipper2SSA(CStringW str, int CharSet)
 
 static bool OpenSubRipper(CTextFile* file, CSimpleTextSubtitle& ret, int CharSet)
 {
+    struct SubRipEntry {
+        CStringW str;
+        bool fUnicode;
+        int CharSet;
+        REFERENCE_TIME start, end;
+
+        ParseResult Parse(STSEntry& entry) const {
+            return CSimpleTextSubtitle::MakeEntry(entry, SubRipper2SSA(str, CharSet), fUnicode, start, end)
+                   ? ParseResult::PARSED
+                   : ParseResult::SKIPPED;
+        }
+    };
+    CEntryBatch<SubRipEntry> entries(ret);
+
     CStringW buff, start, end;
     while (file->ReadString(buff)) {
         FastTrim(buff);
@@ -511,7 +610,7 @@ static bool OpenSubRipper(CTextFile* file, CSimpleTextSubtitle& ret, int CharSet
                     }
 
                     int num2;
-                    if (swscanf_s(tmp, L"%d%c", &num2, &wc, 1) == 1 && bFoundEmpty) {
+                    if (bFoundEmpty && swscanf_s(tmp, L"%d%c", &num2, &wc, 1) == 1) {
                         num = num2;
                         break;
                     }
@@ -519,18 +618,28 @@ static bool OpenSubRipper(CTextFile* file, CSimpleTextSubtitle& ret, int CharSet
                     str += tmp + '\n';
                 }
 
-                ret.Add(SubRipper2SSA(str, CharSet),
-                        file->IsUnicode(),
-                        MS2RT((((hh1 * 60i64 + mm1) * 60i64) + ss1) * 1000i64 + ms1),
-                        MS2RT((((hh2 * 60i64 + mm2) * 60i64) + ss2) * 1000i64 + ms2));
+                entries.Push({
+                    str,
+                    file->IsUnicode(),
+                    CharSet,
+                    MS2RT((((hh1 * 60i64 + mm1) * 60i64) + ss1) * 1000i64 + ms1),
+                    MS2RT((((hh2 * 60i64 + mm2) * 60i64) + ss2) * 1000i64 + ms2)
+                });
+                if (entries.IsFull()) {
+                    entries.Flush();
+                }
             } else {
+                entries.Flush();
                 return false;
             }
         } else if (c != 1) { // might be another format
+            entries.Flush();
             return false;
         }
     }
 
+    entries.Flush();
+
     return !ret.IsEmpty();
 }
 
@@ -1371,22 +1480,17 @@ static bool LoadUUEFont(CTextFile* file)
 
 static bool OpenSubStationAlpha(CTextFile* file, CSimpleTextSubtitle& ret, int CharSet)
 {
-    bool fRet = false;
-    int version = 3, sver = 3;
-    CStringW buff;
-
-    while (file->ReadString(buff)) {
-        FastTrim(buff);
-        if (buff.IsEmpty() || buff.GetAt(0) == L';') {
-            continue;
-        }
+    struct SSADialogue {
+        CStringW buff;
+        int nOffset, nLength; // the fields following "Dialogue:"
+        int version;
+        bool fUnicode;
+        size_t iLine; // in the batch
 
-        LPCWSTR pszBuff = buff;
-        int nBuffLength = buff.GetLength();
-        CStringW entry = GetStrW(pszBuff, nBuffLength, L':');
-        entry.MakeLower();
+        ParseResult Parse(STSEntry& entry) const {
+            LPCWSTR pszBuff = (LPCWSTR)buff + nOffset;
+            int nBuffLength = nLength;
 
-        if (entry == L"dialogue") {
             try {
                 int hh1, mm1, ss1, ms1_div10, hh2, mm2, ss2, ms2_div10, layer = 0;
                 CRect marginRect;
@@ -1426,17 +1530,77 @@ static bool OpenSubStationAlpha(CTextFile* file, CSimpleTextSubtitle& ret, int C
                     style = _T("Default");
                 }
 
-                ret.Add(pszBuff,
-                        file->IsUnicode(),
-                        MS2RT((((hh1 * 60i64 + mm1) * 60i64) + ss1) * 1000i64 + ms1_div10 * 10i64),
-                        MS2RT((((hh2 * 60i64 + mm2) * 60i64) + ss2) * 1000i64 + ms2_div10 * 10i64),
-                        style, actor, effect,
-                        marginRect,
-                        layer);
+                return CSimpleTextSubtitle::MakeEntry(entry,
+                                                      pszBuff,
+                                                      fUnicode,
+                                                      MS2RT((((hh1 * 60i64 + mm1) * 60i64) + ss1) * 1000i64 + ms1_div10 * 10i64),
+                                                      MS2RT((((hh2 * 60i64 + mm2) * 60i64) + ss2) * 1000i64 + ms2_div10 * 10i64),
+                                                      style, actor, effect,
+                                                      marginRect,
+                                                      layer)
+                       ? ParseResult::PARSED
+                       : ParseResult::SKIPPED;
             } catch (...) {
+                return ParseResult::FAILED;
+            }
+        }
+    };
+    CEntryBatch<SSADialogue> dialogues(ret);
+    ULONGLONG batchPos = 0;
+    size_t nBatchLines = 0;
+
+    bool fRet = false;
+    int version = 3, sver = 3;
+    CStringW buff;
+
+    // On failure the file is left after the faulty line as if the dialogues were parsed while reading it
+    auto flushDialogues = [&]() {
+        size_t iFailed = dialogues.Flush();
+        if (iFailed != SIZE_MAX) {
+            file->Seek(batchPos, CFile::begin);
+            for (size_t i = 0; i <= dialogues.GetAt(iFailed).iLine && file->ReadString(buff); i++) {
+                ;
+            }
+            return false;
+        }
+        return true;
+    };
+
+    for (;;) {
+        if (dialogues.IsEmpty()) {
+            batchPos = file->GetPosition();
+            nBatchLines = 0;
+        }
+        if (!file->ReadString(buff)) {
+            break;
+        }
+        nBatchLines++;
+
+        FastTrim(buff);
+        if (buff.IsEmpty() || buff.GetAt(0) == L';') {
+            continue;
+        }
+
+        LPCWSTR pszBuff = buff;
+        int nBuffLength = buff.GetLength();
+        CStringW entry = GetStrW(pszBuff, nBuffLength, L':');
+        entry.MakeLower();
+
+        if (entry == L"dialogue") {
+            dialogues.Push({ buff, int(pszBuff - (LPCWSTR)buff), nBuffLength, version, file->IsUnicode(), nBatchLines - 1 });
+            if (dialogues.IsFull() && !flushDialogues()) {
                 return false;
             }
-        } else if (entry == L"style") {
+            continue;
+        }
+
+        // The comments are often mixed with the dialogues and have no effect so they don't end
+        // the batch, the other entries are handled in order with the dialogues read before them
+        if (entry != L"comment" && !dialogues.IsEmpty() && !flushDialogues()) {
+            return false;
+        }
+
+        if (entry == L"style") {
             STSStyle* style = DEBUG_NEW STSStyle;
             if (!style) {
                 return false;
@@ -1585,6 +1749,10 @@ static bool OpenSubStationAlpha(CTextFile* file, CSimpleTextSubtitle& ret, int C
         }
     }
 
+    if (!flushDialogues()) {
+        return false;
+    }
+
     return fRet;
 }
 
@@ -1826,6 +1994,7 @@ CSimpleTextSubtitle::CSimpleTextSubtitle()
     , m_fUsingAutoGeneratedDefaultStyle(false)
     , m_ePARCompensationType(EPCTDisabled)
     , m_dPARCompensation(1.0)
+    , m_bDeferSegments(false)
 {
 }
 
@@ -1947,11 +2116,11 @@ static bool SegmentCompStart(const STSSegment& segment, REFERENCE_TIME start)
     return (segment.start < start);
 }
 
-void CSimpleTextSubtitle::Add(CStringW str, bool fUnicode, REFERENCE_TIME start, REFERENCE_TIME end, CString style, CString actor, CString effect, const CRect& marginRect, int layer, int readorder)
+bool CSimpleTextSubtitle::MakeEntry(STSEntry& sub, CStringW str, bool fUnicode, REFERENCE_TIME start, REFERENCE_TIME end, CString style, CString actor, CString effect, const CRect& marginRect, int layer, int readorder)
 {
     FastTrim(str);
     if (str.IsEmpty() || start > end) {
-        return;
+        return false;
     }
 
     str.Remove('\r');
@@ -1961,7 +2130,6 @@ void CSimpleTextSubtitle::Add(CStringW str, bool fUnicode, REFERENCE_TIME start,
     }
     style.TrimLeft('*');
 
-    STSEntry sub;
     sub.str = str;
     sub.fUnicode = fUnicode;
     sub.style = style;
@@ -1971,9 +2139,28 @@ void CSimpleTextSubtitle::Add(CStringW str, bool fUnicode, REFERENCE_TIME start,
     sub.layer = layer;
     sub.start = start;
     sub.end = end;
-    sub.readorder = readorder < 0 ? (int)GetCount() : readorder;
+    sub.readorder = readorder;
+
+    return true;
+}
+
+void CSimpleTextSubtitle::Add(CStringW str, bool fUnicode, REFERENCE_TIME start, REFERENCE_TIME end, CString style, CString actor, CString effect, const CRect& marginRect, int layer, int readorder)
+{
+    STSEntry sub;
+    if (MakeEntry(sub, str, fUnicode, start, end, style, actor, effect, marginRect, layer, readorder)) {
+        AddEntry(sub);
+    }
+}
 
-    int n = (int)__super::Add(sub);
+void CSimpleTextSubtitle::AddEntry(const STSEntry& entry)
+{
+    int n = (int)__super::Add(entry);
+
+    STSEntry& sub = GetAt(n);
+    if (sub.readorder < 0) {
+        sub.readorder = n;
+    }
+    const REFERENCE_TIME start = sub.start, end = sub.end;
 
     // Entries with a null duration don't belong to any segments since
     // they are not to be rendered. We choose not to skip them completely
@@ -1984,6 +2171,12 @@ void CSimpleTextSubtitle::Add(CStringW str, bool fUnicode, REFERENCE_TIME start,
         return;
     }
 
+    // Inserting the entries one by one into the segments is quadratic in the worst
+    // case so when a whole file is being parsed they are all indexed at once later
+    if (m_bDeferSegments) {
+        return;
+    }
+
     size_t segmentsCount = m_segments.GetCount();
 
     if (segmentsCount == 0) { // First segment
@@ -2557,11 +2750,12 @@ static int BreakpointComp(const void* e1, const void* e2)
     return SGN(bp1->t - bp2->t);
 }
 
-void CSimpleTextSubtitle::CreateSegments()
+void CSimpleTextSubtitle::BuildSegments(bool fByReadorder)
 {
     m_segments.RemoveAll();
 
     CAtlArray<Breakpoint> breakpoints;
+    breakpoints.SetCount(0, int(GetCount() * 2));
 
     for (size_t i = 0; i < GetCount(); i++) {
         STSEntry& stse = GetAt(i);
@@ -2579,15 +2773,33 @@ void CSimpleTextSubtitle::CreateSegments()
         }
     }
 
+    // Add() keeps the entries of a segment ordered by readorder, the entries
+    // with the same readorder being kept in the order they were added
+    CAtlArray<int> order;
+    order.SetCount(GetCount());
+    for (size_t i = 0; i < GetCount(); i++) {
+        order[i] = int(i);
+    }
+    if (fByReadorder) {
+        std::stable_sort(order.GetData(), order.GetData() + order.GetCount(), [this](int i1, int i2) {
+            return GetAt(i1).readorder < GetAt(i2).readorder;
+        });
+    }
+
     STSSegment* segmentsStart = m_segments.GetData();
     STSSegment* segmentsEnd   = segmentsStart + m_segments.GetCount();
-    for (size_t i = 0; i < GetCount(); i++) {
-        const STSEntry& stse = GetAt(i);
+    for (size_t i = 0; i < order.GetCount(); i++) {
+        const STSEntry& stse = GetAt(order[i]);
         STSSegment* segment = std::lower_bound(segmentsStart, segmentsEnd, stse.start, SegmentCompStart);
         for (size_t j = segment - segmentsStart; j < m_segments.GetCount() && m_segments[j].end <= stse.end; j++) {
-            m_segments[j].subs.Add(int(i));
+            m_segments[j].subs.Add(order[i]);
         }
     }
+}
+
+void CSimpleTextSubtitle::CreateSegments()
+{
+    BuildSegments(false);
 
     OnChanged();
     /*
@@ -2636,6 +2848,8 @@ bool CSimpleTextSubtitle::Open(CTextFile* f, int CharSet, CString name)
 {
     Empty();
 
+    m_bDeferSegments = true;
+
     ULONGLONG pos = f->GetPosition();
 
     for (ptrdiff_t i = 0; i < nOpenFuncts; i++) {
@@ -2661,13 +2875,15 @@ bool CSimpleTextSubtitle::Open(CTextFile* f, int CharSet, CString name)
         m_encoding = f->GetEncoding();
         m_path = f->GetFilePath();
 
-        // No need to call Sort() or CreateSegments(), everything is done on the fly
-
         CWebTextFile f2(CTextFile::UTF8);
         if (f2.Open(f->GetFilePath() + _T(".style"))) {
             OpenSubStationAlpha(&f2, *this, CharSet);
         }
 
+        // No need to call Sort(), the segments are built the same way Add() would have
+        m_bDeferSegments = false;
+        BuildSegments(true);
+
         CreateDefaultStyle(CharSet);
 
         ChangeUnknownStylesToDefault();
@@ -2679,6 +2895,8 @@ bool CSimpleTextSubtitle::Open(CTextFile* f, int CharSet, CString name)
         return true;
     }
 
+    m_bDeferSegments = false;
+
     return false;
 }
 
@@ -129,8 +129,11 @@ class CSimpleTextSubtitle : public CAtlArray<STSEntry>
 
 protected:
     CAtlArray<STSSegment> m_segments;
+    bool m_bDeferSegments; // set while a file is parsed, the segments are built once at the end
     virtual void OnChanged() {}
 
+    void BuildSegments(bool fByReadorder);
+
 public:
     CString m_name;
     LCID m_lcid;
@@ -183,6 +186,9 @@ public:
     bool SaveAs(CString fn, Subtitle::SubType type, double fps = -1, LONGLONG delay = 0, CTextFile::enc e = CTextFile::DEFAULT_ENCODING, bool bCreateExternalStyleFile = true);
 
     void Add(CStringW str, bool fUnicode, REFERENCE_TIME start, REFERENCE_TIME end, CString style = _T("Default"), CString actor = _T(""), CString effect = _T(""), const CRect& marginRect = CRect(0, 0, 0, 0), int layer = 0, int readorder = -1);
+    // Fills the entry the same way Add() does, returns false if the entry would be dropped
+    static bool MakeEntry(STSEntry& sub, CStringW str, bool fUnicode, REFERENCE_TIME start, REFERENCE_TIME end, CString style = _T("Default"), CString actor = _T(""), CString effect = _T(""), const CRect& marginRect = CRect(0, 0, 0, 0), int layer = 0, int readorder = -1);
+    void AddEntry(const STSEntry& sub);
     STSStyle* CreateDefaultStyle(int CharSet);
     void ChangeUnknownStylesToDefault();
     void AddStyle(CString name, STSStyle* style); // style will be stored and freed in Empty() later
@@ -113,133 +113,143 @@ void SeparableFilterY(unsigned char* src, unsigned char* dst, int width, int hei
 }
 
 
+// Grow-only aligned buffers reused by the blur passes so that they don't allocate on every call.
+// An instance must not be used by several threads at the same time.
+class SeparableFilterScratch
+{
+    struct Buffer {
+        void* p = nullptr;
+        size_t size = 0;
+
+        ~Buffer() {
+            _aligned_free(p);
+        }
+
+        void* Get(size_t newSize) {
+            if (newSize > size) {
+                _aligned_free(p);
+                p = _aligned_malloc(newSize, 32);
+                size = p ? newSize : 0;
+            }
+            return p;
+        }
+    };
+
+    Buffer m_image, m_row, m_coeffs;
+
+public:
+    SeparableFilterScratch() = default;
+    SeparableFilterScratch(const SeparableFilterScratch&) = delete;
+    SeparableFilterScratch& operator=(const SeparableFilterScratch&) = delete;
+
+    // Intermediate image used between the horizontal and the vertical pass
+    unsigned char* GetImage(size_t size) {
+        return static_cast<unsigned char*>(m_image.Get(size));
+    }
+
+    unsigned char* GetRow(size_t size) {
+        return static_cast<unsigned char*>(m_row.Get(size));
+    }
+
+    // Each kernel coefficient is packed with the next one so that two taps
+    // can be applied at once with pmaddwd, the last one is packed with zero
+    const int* GetCoeffPairs(const short* kernel, int kernel_size) {
+        int* pairs = static_cast<int*>(m_coeffs.Get(kernel_size * sizeof(int)));
+        if (pairs) {
+            for (int k = 0; k < kernel_size; k++) {
+                unsigned short next = k + 1 < kernel_size ? (unsigned short)kernel[k + 1] : 0;
+                pairs[k] = (int)(((unsigned int)next << 16) | (unsigned short)kernel[k]);
+            }
+        }
+        return pairs;
+    }
+};
+
+
+// Multiply 16 pixels by the coefficient pair, a holds the pixels for the first tap and b for the second one
+static __forceinline void SeparableFilterMultiplyAdd_SSE2(__m128i a, __m128i b, __m128i coeffs,
+                                                          __m128i& sum0, __m128i& sum1, __m128i& sum2, __m128i& sum3)
+{
+    __m128i aLo = _mm_unpacklo_epi8(a, _mm_setzero_si128());
+    __m128i aHi = _mm_unpackhi_epi8(a, _mm_setzero_si128());
+    __m128i bLo = _mm_unpacklo_epi8(b, _mm_setzero_si128());
+    __m128i bHi = _mm_unpackhi_epi8(b, _mm_setzero_si128());
+
+    sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(aLo, bLo), coeffs));
+    sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi16(aLo, bLo), coeffs));
+    sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi16(aHi, bHi), coeffs));
+    sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi16(aHi, bHi), coeffs));
+}
+
+// Divide the 16 sums, clamp them to [0, 255] and store the first count values
+static __forceinline void SeparableFilterStore_SSE2(unsigned char* out, int count, __m128i sum0, __m128i sum1,
+                                                    __m128i sum2, __m128i sum3, const libdivide::divider<int>& divisor)
+{
+    __m128i res = _mm_packus_epi16(_mm_packs_epi32(sum0 / divisor, sum1 / divisor),
+                                   _mm_packs_epi32(sum2 / divisor, sum3 / divisor));
+    if (count >= 16) {
+        _mm_storeu_si128((__m128i*)out, res);
+    } else {
+        alignas(16) unsigned char tmp[16];
+        _mm_store_si128((__m128i*)tmp, res);
+        memcpy(out, tmp, count);
+    }
+}
+
 // Filter an image in horizontal direction with a one-dimensional filter
-void SeparableFilterX_SSE2(unsigned char* src, unsigned char* dst, int width, int height, ptrdiff_t stride,
-                           short* kernel, int kernel_size, int divisor)
+// The sums are kept in registers for the whole kernel so the output matches SeparableFilterX<1> exactly
+bool SeparableFilterX_SSE2(unsigned char* src, unsigned char* dst, int width, int height, ptrdiff_t stride,
+                           short* kernel, int kernel_size, int divisor, SeparableFilterScratch& scratch)
 {
-    int width16 = width & ~15;
-    int* tmp = (int*)_aligned_malloc(stride * sizeof(int), 16);
+    // Pixels outside of the image count as zero so each row is copied into a zero padded buffer
+    const int kOffset = kernel_size / 2;
+    const size_t rowSize = ((width + 15) & ~15) + kernel_size + 16;
+    unsigned char* row = scratch.GetRow(rowSize);
+    const int* pairs = scratch.GetCoeffPairs(kernel, kernel_size);
+    if (!row || !pairs) {
+        return false;
+    }
+    ZeroMemory(row, rowSize);
+
     libdivide::divider<int> divisorLibdivide(divisor);
 
     for (int y = 0; y < height; y++) {
-        ZeroMemory(tmp, stride * sizeof(int));
-
-        const unsigned char* in = src + y * stride;
+        memcpy(row + kOffset, src + y * stride, width);
         unsigned char* out = dst + y * stride;
 
-        for (int k = 0; k < kernel_size; k++) {
-            int xOffset = k - kernel_size / 2;
-            int xStart = 0;
-            int xEnd = width;
-            if (xOffset < 0) {
-                xEnd += xOffset;
-            } else if (xOffset > 0) {
-                xStart += xOffset;
-            }
-            int xStart16 = (xStart + 15) & ~15;
-            int xEnd16 = xEnd & ~15;
-            if (xStart16 >= xEnd16) { // Don't use SSE2 at all
-                xStart16 = xEnd16 = xEnd;
-            }
-            for (int x = xStart; x < xStart16; x++) {
-                tmp[x - xOffset] += (int)(in[x] * kernel[k]);
-            }
-            __m128i coeff = _mm_set1_epi16(kernel[k]);
-            for (int x = xStart16; x < xEnd16; x += 16) {
-                // Load 16 values
-                __m128i data16 = _mm_load_si128((__m128i*)&in[x]);
-
-                // Multiply the first 8 values by the coefficient to get 8 32-bit integers
-                __m128i data8 = _mm_unpacklo_epi8(data16, _mm_setzero_si128());
-                __m128i resLo = _mm_mullo_epi16(data8, coeff);
-                __m128i resHi = _mm_mulhi_epi16(data8, coeff);
-                __m128i res32bitLo = _mm_unpacklo_epi16(resLo, resHi);
-                __m128i res32bitHi = _mm_unpackhi_epi16(resLo, resHi);
-
-                // Load the 4 32-bit integers values, add the values we computed and store them back
-                __m128i res = _mm_loadu_si128((__m128i*)&tmp[x - xOffset]);
-                res = _mm_add_epi32(res, res32bitLo);
-                _mm_storeu_si128((__m128i*)&tmp[x - xOffset], res);
-                // Repeat the same operation for the next 4 values
-                res = _mm_loadu_si128((__m128i*)&tmp[x - xOffset + 4]);
-                res = _mm_add_epi32(res, res32bitHi);
-                _mm_storeu_si128((__m128i*)&tmp[x - xOffset + 4], res);
-
-                // Multiply the next 8 values by the coefficient to get 8 32-bit integers
-                data8 = _mm_unpackhi_epi8(data16, _mm_setzero_si128());
-                resLo = _mm_mullo_epi16(data8, coeff);
-                resHi = _mm_mulhi_epi16(data8, coeff);
-                res32bitLo = _mm_unpacklo_epi16(resLo, resHi);
-                res32bitHi = _mm_unpackhi_epi16(resLo, resHi);
-
-                // Load the 4 32-bit integers values, add the values we computed and store them back
-                res = _mm_loadu_si128((__m128i*)&tmp[x - xOffset + 8]);
-                res = _mm_add_epi32(res, res32bitLo);
-                _mm_storeu_si128((__m128i*)&tmp[x - xOffset + 8], res);
-                // Repeat the same operation for the next 4 values
-                res = _mm_loadu_si128((__m128i*)&tmp[x - xOffset + 12]);
-                res = _mm_add_epi32(res, res32bitHi);
-                _mm_storeu_si128((__m128i*)&tmp[x - xOffset + 12], res);
-            }
-            for (int x = xEnd16; x < xEnd; x++) {
-                tmp[x - xOffset] += (int)(in[x] * kernel[k]);
-            }
-        }
-        for (int x = 0; x < width16; x += 16) {
-            // Load 4 32-bit integer values and divide them
-            __m128i accum1 = _mm_load_si128((__m128i*)&tmp[x]);
-            accum1 = accum1 / divisorLibdivide;
-            // Repeat the same operation on the next 4 32-bit integer values
-            __m128i accum2 = _mm_load_si128((__m128i*)&tmp[x + 4]);
-            accum2 = accum2 / divisorLibdivide;
-            // Pack the 8 32-bit integers into 8 16-bit integers
-            accum1 = _mm_packs_epi32(accum1, accum2);
-
-            // Load 4 32-bit integer values and divide them
-            __m128i accum3 = _mm_load_si128((__m128i*)&tmp[x + 8]);
-            accum3 = accum3 / divisorLibdivide;
-            // Repeat the same operation on the next 4 32-bit integer values
-            __m128i accum4 = _mm_load_si128((__m128i*)&tmp[x + 12]);
-            accum4 = accum4 / divisorLibdivide;
-            // Pack the 8 32-bit integers into 8 16-bit integers
-            accum3 = _mm_packs_epi32(accum3, accum4);
-
-            // Pack the 16 16-bit integers into 16 8-bit unsigned integers
-            accum1 = _mm_packus_epi16(accum1, accum3);
-
-            // Store the 16 8-bit unsigned integers
-            _mm_store_si128((__m128i*)&out[x], accum1);
-        }
-        for (int x = width16; x < width; x++) {
-            int accum = tmp[x] / divisor;
-            if (accum > 255) {
-                accum = 255;
-            } else if (accum < 0) {
-                accum = 0;
+        for (int x = 0; x < width; x += 16) {
+            __m128i sum0 = _mm_setzero_si128(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+
+            for (int k = 0; k < kernel_size; k += 2) {
+                __m128i a = _mm_loadu_si128((__m128i*)&row[x + k]);
+                __m128i b = _mm_loadu_si128((__m128i*)&row[x + k + 1]);
+                SeparableFilterMultiplyAdd_SSE2(a, b, _mm_set1_epi32(pairs[k]), sum0, sum1, sum2, sum3);
             }
-            out[x] = (unsigned char)accum;
+
+            SeparableFilterStore_SSE2(out + x, width - x, sum0, sum1, sum2, sum3, divisorLibdivide);
         }
     }
 
-    _aligned_free(tmp);
+    return true;
 }
 
 
 // Filter an image in vertical direction with a one-dimensional filter
-void SeparableFilterY_SSE2(unsigned char* src, unsigned char* dst, int width, int height, ptrdiff_t stride,
-                           short* kernel, int kernel_size, int divisor)
+// The sums are kept in registers for the whole kernel so the output matches SeparableFilterY<1> exactly
+bool SeparableFilterY_SSE2(unsigned char* src, unsigned char* dst, int width, int height, ptrdiff_t stride,
+                           short* kernel, int kernel_size, int divisor, SeparableFilterScratch& scratch)
 {
-    int width16 = width & ~15;
-    int* tmp = (int*)_aligned_malloc(stride * sizeof(int), 16);
+    const int* pairs = scratch.GetCoeffPairs(kernel, kernel_size);
+    if (!pairs) {
+        return false;
+    }
+
     libdivide::divider<int> divisorLibdivide(divisor);
 
 #ifdef _OPENMP
     #pragma omp parallel for
 #endif
     for (int y = 0; y < height; y++) {
-        ZeroMemory(tmp, stride * sizeof(int));
-
-        const unsigned char* in = src + y * stride;
         unsigned char* out = dst + y * stride;
 
         int kOffset = kernel_size / 2;
@@ -250,85 +260,217 @@ void SeparableFilterY_SSE2(unsigned char* src, unsigned char* dst, int width, in
         } else if (height <= y + kOffset) {
             kEnd -= kOffset + y + 1 - height;
         }
-        for (int k = kStart; k < kEnd; k++) {
-            __m128i coeff = _mm_set1_epi16(kernel[k]);
-            for (int x = 0; x < width16; x += 16) {
-                // Load 16 values
-                __m128i data16 = _mm_load_si128((__m128i*)&in[(k - kOffset) * stride + x]);
-
-                // Multiply the first 8 values by the coefficient to get 8 32-bit integers
-                __m128i data8 = _mm_unpacklo_epi8(data16, _mm_setzero_si128());
-                __m128i resLo = _mm_mullo_epi16(data8, coeff);
-                __m128i resHi = _mm_mulhi_epi16(data8, coeff);
-                __m128i res32bitLo = _mm_unpacklo_epi16(resLo, resHi);
-                __m128i res32bitHi = _mm_unpackhi_epi16(resLo, resHi);
-
-                // Load the 4 32-bit integers values, add the values we computed and store them back
-                __m128i res = _mm_load_si128((__m128i*)&tmp[x]);
-                res = _mm_add_epi32(res, res32bitLo);
-                _mm_store_si128((__m128i*)&tmp[x], res);
-                // Repeat the same operation for the next 4 values
-                res = _mm_load_si128((__m128i*)&tmp[x + 4]);
-                res = _mm_add_epi32(res, res32bitHi);
-                _mm_store_si128((__m128i*)&tmp[x + 4], res);
-
-                // Multiply the next 8 values by the coefficient to get 8 32-bit integers
-                data8 = _mm_unpackhi_epi8(data16, _mm_setzero_si128());
-                resLo = _mm_mullo_epi16(data8, coeff);
-                resHi = _mm_mulhi_epi16(data8, coeff);
-                res32bitLo = _mm_unpacklo_epi16(resLo, resHi);
-                res32bitHi = _mm_unpackhi_epi16(resLo, resHi);
-
-                // Load the 4 32-bit integers values, add the values we computed and store them back
-                res = _mm_load_si128((__m128i*)&tmp[x + 8]);
-                res = _mm_add_epi32(res, res32bitLo);
-                _mm_store_si128((__m128i*)&tmp[x + 8], res);
-                // Repeat the same operation for the next 4 values
-                res = _mm_load_si128((__m128i*)&tmp[x + 12]);
-                res = _mm_add_epi32(res, res32bitHi);
-                _mm_store_si128((__m128i*)&tmp[x + 12], res);
+
+        for (int x = 0; x < width; x += 16) {
+            __m128i sum0 = _mm_setzero_si128(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+            const unsigned char* in = src + (y + kStart - kOffset) * stride + x;
+
+            int k = kStart;
+            for (; k + 1 < kEnd; k += 2, in += 2 * stride) {
+                __m128i a = _mm_loadu_si128((__m128i*)in);
+                __m128i b = _mm_loadu_si128((__m128i*)(in + stride));
+                SeparableFilterMultiplyAdd_SSE2(a, b, _mm_set1_epi32(pairs[k]), sum0, sum1, sum2, sum3);
             }
-            for (int x = width16; x < width; x++) {
-                tmp[x] += (int)(in[(k - kOffset) * stride + x] * kernel[k]);
+            if (k < kEnd) {
+                __m128i a = _mm_loadu_si128((__m128i*)in);
+                SeparableFilterMultiplyAdd_SSE2(a, _mm_setzero_si128(), _mm_set1_epi32(pairs[k]), sum0, sum1, sum2, sum3);
+            }
+
+            SeparableFilterStore_SSE2(out + x, width - x, sum0, sum1, sum2, sum3, divisorLibdivide);
+        }
+    }
+
+    return true;
+}
+
+
+// Multiply 32 pixels by the coefficient pair, the unpacking is done per 128-bit lane
+// and it is undone by the lane-wise packing in SeparableFilterStore_AVX2
+static __forceinline void SeparableFilterMultiplyAdd_AVX2(__m256i a, __m256i b, __m256i coeffs,
+                                                          __m256i& sum0, __m256i& sum1, __m256i& sum2, __m256i& sum3)
+{
+    __m256i aLo = _mm256_unpacklo_epi8(a, _mm256_setzero_si256());
+    __m256i aHi = _mm256_unpackhi_epi8(a, _mm256_setzero_si256());
+    __m256i bLo = _mm256_unpacklo_epi8(b, _mm256_setzero_si256());
+    __m256i bHi = _mm256_unpackhi_epi8(b, _mm256_setzero_si256());
+
+    sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(_mm256_unpacklo_epi16(aLo, bLo), coeffs));
+    sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(_mm256_unpackhi_epi16(aLo, bLo), coeffs));
+    sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(_mm256_unpacklo_epi16(aHi, bHi), coeffs));
+    sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(_mm256_unpackhi_epi16(aHi, bHi), coeffs));
+}
+
+// Divide 8 sums, rounding toward zero like the integer division. The sums and the divisor are exactly
+// representable as doubles and a quotient can't be rounded to the next integer so the result is exact.
+static __forceinline __m256i SeparableFilterDivide_AVX2(__m256i sum, __m256d divisor)
+{
+    __m128i lo = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(sum)), divisor));
+    __m128i hi = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(sum, 1)), divisor));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+// Divide the 32 sums, clamp them to [0, 255] and store the first count values
+static __forceinline void SeparableFilterStore_AVX2(unsigned char* out, int count, __m256i sum0, __m256i sum1,
+                                                    __m256i sum2, __m256i sum3, __m256d divisor)
+{
+    __m256i res = _mm256_packus_epi16(
+                      _mm256_packs_epi32(SeparableFilterDivide_AVX2(sum0, divisor), SeparableFilterDivide_AVX2(sum1, divisor)),
+                      _mm256_packs_epi32(SeparableFilterDivide_AVX2(sum2, divisor), SeparableFilterDivide_AVX2(sum3, divisor)));
+    if (count >= 32) {
+        _mm256_storeu_si256((__m256i*)out, res);
+    } else {
+        alignas(32) unsigned char tmp[32];
+        _mm256_store_si256((__m256i*)tmp, res);
+        memcpy(out, tmp, count);
+    }
+}
+
+// Filter an image in horizontal direction with a one-dimensional filter
+bool SeparableFilterX_AVX2(unsigned char* src, unsigned char* dst, int width, int height, ptrdiff_t stride,
+                           short* kernel, int kernel_size, int divisor, SeparableFilterScratch& scratch)
+{
+    // Pixels outside of the image count as zero so each row is copied into a zero padded buffer
+    const int kOffset = kernel_size / 2;
+    const size_t rowSize = ((width + 31) & ~31) + kernel_size + 32;
+    unsigned char* row = scratch.GetRow(rowSize);
+    const int* pairs = scratch.GetCoeffPairs(kernel, kernel_size);
+    if (!row || !pairs) {
+        return false;
+    }
+    ZeroMemory(row, rowSize);
+
+    const __m256d divisorPD = _mm256_set1_pd(divisor);
+
+    for (int y = 0; y < height; y++) {
+        memcpy(row + kOffset, src + y * stride, width);
+        unsigned char* out = dst + y * stride;
+
+        for (int x = 0; x < width; x += 32) {
+            __m256i sum0 = _mm256_setzero_si256(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+
+            for (int k = 0; k < kernel_size; k += 2) {
+                __m256i a = _mm256_loadu_si256((__m256i*)&row[x + k]);
+                __m256i b = _mm256_loadu_si256((__m256i*)&row[x + k + 1]);
+                SeparableFilterMultiplyAdd_AVX2(a, b, _mm256_set1_epi32(pairs[k]), sum0, sum1, sum2, sum3);
             }
+
+            SeparableFilterStore_AVX2(out + x, width - x, sum0, sum1, sum2, sum3, divisorPD);
+        }
+    }
+
+    // Zero upper halves of YMM registers to avoid AVX/SSE translation penalties
+    _mm256_zeroupper();
+
+    return true;
+}
+
+
+// Filter an image in vertical direction with a one-dimensional filter
+bool SeparableFilterY_AVX2(unsigned char* src, unsigned char* dst, int width, int height, ptrdiff_t stride,
+                           short* kernel, int kernel_size, int divisor, SeparableFilterScratch& scratch)
+{
+    const int* pairs = scratch.GetCoeffPairs(kernel, kernel_size);
+    if (!pairs) {
+        return false;
+    }
+
+    const __m256d divisorPD = _mm256_set1_pd(divisor);
+    libdivide::divider<int> divisorLibdivide(divisor);
+
+    for (int y = 0; y < height; y++) {
+        unsigned char* out = dst + y * stride;
+
+        int kOffset = kernel_size / 2;
+        int kStart = 0;
+        int kEnd = kernel_size;
+        if (y < kOffset) { // 0 > y - kOffset
+            kStart += kOffset - y;
+        } else if (height <= y + kOffset) {
+            kEnd -= kOffset + y + 1 - height;
         }
-        for (int x = 0; x < width16; x += 16) {
-            // Load 4 32-bit integer values and divide them
-            __m128i accum1 = _mm_load_si128((__m128i*)&tmp[x]);
-            accum1 = accum1 / divisorLibdivide;
-            // Repeat the same operation on the next 4 32-bit integer values
-            __m128i accum2 = _mm_load_si128((__m128i*)&tmp[x + 4]);
-            accum2 = accum2 / divisorLibdivide;
-            // Pack the 8 32-bit integers into 8 16-bit integers
-            accum1 = _mm_packs_epi32(accum1, accum2);
-
-            // Load 4 32-bit integer values and divide them
-            __m128i accum3 = _mm_load_si128((__m128i*)&tmp[x + 8]);
-            accum3 = accum3 / divisorLibdivide;
-            // Repeat the same operation on the next 4 32-bit integer values
-            __m128i accum4 = _mm_load_si128((__m128i*)&tmp[x + 12]);
-            accum4 = accum4 / divisorLibdivide;
-            // Pack the 8 32-bit integers into 8 16-bit integers
-            accum3 = _mm_packs_epi32(accum3, accum4);
-
-            // Pack the 16 16-bit integers into 16 8-bit unsigned integers
-            accum1 = _mm_packus_epi16(accum1, accum3);
-
-            // Store the 16 8-bit unsigned integers
-            _mm_store_si128((__m128i*)&out[x], accum1);
+
+        int x = 0;
+        for (; x + 16 < width; x += 32) {
+            __m256i sum0 = _mm256_setzero_si256(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+            const unsigned char* in = src + (y + kStart - kOffset) * stride + x;
+
+            int k = kStart;
+            for (; k + 1 < kEnd; k += 2, in += 2 * stride) {
+                __m256i a = _mm256_loadu_si256((__m256i*)in);
+                __m256i b = _mm256_loadu_si256((__m256i*)(in + stride));
+                SeparableFilterMultiplyAdd_AVX2(a, b, _mm256_set1_epi32(pairs[k]), sum0, sum1, sum2, sum3);
+            }
+            if (k < kEnd) {
+                __m256i a = _mm256_loadu_si256((__m256i*)in);
+                SeparableFilterMultiplyAdd_AVX2(a, _mm256_setzero_si256(), _mm256_set1_epi32(pairs[k]), sum0, sum1, sum2, sum3);
+            }
+
+            SeparableFilterStore_AVX2(out + x, width - x, sum0, sum1, sum2, sum3, divisorPD);
         }
-        for (int x = width16; x < width; x++) {
-            int accum = tmp[x] / divisor;
-            if (accum > 255) {
-                accum = 255;
-            } else if (accum < 0) {
-                accum = 0;
+
+        // Zero upper halves of YMM registers to avoid AVX/SSE translation penalties
+        _mm256_zeroupper();
+
+        // The rows are only padded to 16 bytes so the last columns might not fit in a 32 bytes load
+        if (x < width) {
+            __m128i sum0 = _mm_setzero_si128(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+            const unsigned char* in = src + (y + kStart - kOffset) * stride + x;
+
+            for (int k = kStart; k < kEnd; k++, in += stride) {
+                __m128i a = _mm_loadu_si128((__m128i*)in);
+                SeparableFilterMultiplyAdd_SSE2(a, _mm_setzero_si128(), _mm_set1_epi32(pairs[k]), sum0, sum1, sum2, sum3);
             }
-            out[x] = (unsigned char)accum;
+
+            SeparableFilterStore_SSE2(out + x, width - x, sum0, sum1, sum2, sum3, divisorLibdivide);
         }
     }
 
-    _aligned_free(tmp);
+    return true;
+}
+
+
+// Apply the 3x3 kernel [1 2 1; 2 4 2; 1 2 1] / 16 used by \be to the inner pixels of the image,
+// the pixels on the borders are kept as is. tmp must be a copy of the image.
+void Blur3x3_SSE2(unsigned char* buffer, const unsigned char* tmp, int width, int height, ptrdiff_t stride)
+{
+    for (int y = 1; y < height - 1; y++) {
+        const unsigned char* src = tmp + y * stride;
+        unsigned char* dst = buffer + y * stride;
+
+        int x = 1;
+        for (; x + 8 + 1 <= width; x += 8) {
+            // Weight the 3 rows for the 10 columns around the 8 pixels
+            __m128i vLeft, vCenter, vRight;
+            {
+                __m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)&src[x - 1 - stride]), _mm_setzero_si128());
+                __m128i mid = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)&src[x - 1]), _mm_setzero_si128());
+                __m128i bot = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)&src[x - 1 + stride]), _mm_setzero_si128());
+                vLeft = _mm_add_epi16(_mm_add_epi16(top, bot), _mm_slli_epi16(mid, 1));
+            }
+            {
+                __m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)&src[x - stride]), _mm_setzero_si128());
+                __m128i mid = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)&src[x]), _mm_setzero_si128());
+                __m128i bot = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)&src[x + stride]), _mm_setzero_si128());
+                vCenter = _mm_add_epi16(_mm_add_epi16(top, bot), _mm_slli_epi16(mid, 1));
+            }
+            {
+                __m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)&src[x + 1 - stride]), _mm_setzero_si128());
+                __m128i mid = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)&src[x + 1]), _mm_setzero_si128());
+                __m128i bot = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i*)&src[x + 1 + stride]), _mm_setzero_si128());
+                vRight = _mm_add_epi16(_mm_add_epi16(top, bot), _mm_slli_epi16(mid, 1));
+            }
+            // The sum is at most 16 * 255 so it fits in 16 bits
+            __m128i res = _mm_add_epi16(_mm_add_epi16(vLeft, vRight), _mm_slli_epi16(vCenter, 1));
+            res = _mm_srli_epi16(res, 4);
+            _mm_storel_epi64((__m128i*)&dst[x], _mm_packus_epi16(res, res));
+        }
+        for (; x < width - 1; x++) {
+            const unsigned char* s = src + x;
+            dst[x] = (s[-1 - stride] + (s[-stride] << 1) + s[+1 - stride]
+                      + (s[-1] << 1) + (s[0] << 2) + (s[+1] << 1)
+                      + s[-1 + stride] + (s[+stride] << 1) + s[+1 + stride]) >> 4;
+        }
+    }
 }
 
 
@@ -217,12 +217,21 @@ CString FindLangFromId(WORD id)
 CVobSubFile::CVobSubFile(CCritSec* pLock)
     : CSubPicProviderImpl(pLock)
     , m_sub(1024 * 1024)
+    , m_cacheBudget(FRAME_CACHE_BUDGET)
+    , m_frameCache(FRAME_CACHE_ENTRIES, &m_cacheBudget)
+    , m_nCacheGeneration(0)
+    , m_bPredecodeRequest(false)
+    , m_bPredecodeExit(false)
+    , m_nPredecodeLang(SIZE_T_ERROR)
+    , m_nPredecodeIdx(SIZE_T_ERROR)
     , m_nLang(0)
 {
+    m_cacheSettings = GetDecodeSettings();
 }
 
 CVobSubFile::~CVobSubFile()
 {
+    StopPredecode();
 }
 
 //
@@ -231,6 +240,9 @@ bool CVobSubFile::Copy(CVobSubFile& vsf)
 {
     Close();
 
+    vsf.StopPredecode();
+    CAutoLock cAutoLock(&vsf.m_csSub);
+
     *(CVobSubSettings*)this = *(CVobSubSettings*)&vsf;
     m_title = vsf.m_title;
     m_nLang = vsf.m_nLang;
@@ -393,6 +405,13 @@ bool CVobSubFile::Save(CString fn, int delay, SubFormat sf)
 
 void CVobSubFile::Close()
 {
+    StopPredecode();
+    {
+        std::lock_guard<std::mutex> lock(m_mutexCache);
+        m_frameCache.Clear();
+        m_nCacheGeneration++;
+    }
+
     InitSettings();
     m_title.Empty();
     m_sub.SetLength(0);
@@ -1106,6 +1125,8 @@ bool CVobSubFile::WriteIdx(CString fn, int delay)
 
 bool CVobSubFile::WriteSub(CString fn)
 {
+    CAutoLock cAutoLock(&m_csSub);
+
     CFile f;
     if (!f.Open(fn, CFile::modeCreate | CFile::modeWrite | CFile::typeBinary | CFile::shareDenyWrite)) {
         return false;
@@ -1130,6 +1151,8 @@ bool CVobSubFile::WriteSub(CString fn)
 
 BYTE* CVobSubFile::GetPacket(size_t idx, size_t& packetSize, size_t& dataSize, size_t nLang /*= SIZE_T_ERROR*/)
 {
+    CAutoLock cAutoLock(&m_csSub);
+
     BYTE* ret = nullptr;
 
     if (nLang >= m_langs.size()) {
@@ -1227,24 +1250,59 @@ bool CVobSubFile::GetFrame(size_t idx, size_t nLang /*= SIZE_T_ERROR*/, REFERENC
 
     if (m_img.nLang != nLang || m_img.nIdx != idx
             || (sp[idx].bAnimated && sp[idx].start + m_img.tCurrent <= rt)) {
-        size_t packetSize = 0, dataSize = 0;
-        CAutoVectorPtr<BYTE> buff;
-        buff.Attach(GetPacket(idx, packetSize, dataSize, nLang));
-        if (!buff || packetSize == 0 || dataSize == 0) {
-            return false;
-        }
-
-        m_img.start = sp[idx].start;
+        if (sp[idx].bAnimated) {
+            size_t packetSize = 0, dataSize = 0;
+            CAutoVectorPtr<BYTE> buff;
+            buff.Attach(GetPacket(idx, packetSize, dataSize, nLang));
+            if (!buff || packetSize == 0 || dataSize == 0) {
+                return false;
+            }
 
-        bool ret = m_img.Decode(buff, packetSize, dataSize, rt >= 0 ? int(rt - sp[idx].start) : INT_MAX,
-                                m_bCustomPal, m_tridx, m_orgpal, m_cuspal, true);
+            if (!m_img.Decode(buff, packetSize, dataSize, rt >= 0 ? int(rt - sp[idx].start) : INT_MAX,
+                              m_bCustomPal, m_tridx, m_orgpal, m_cuspal, true)) {
+                return false;
+            }
+        } else {
+            DecodeSettings settings = GetDecodeSettings();
+            CVobSubFrameSharedPtr pFrame;
+            {
+                std::lock_guard<std::mutex> lock(m_mutexCache);
+                if (!(settings == m_cacheSettings)) {
+                    // The palette changed, nothing that was decoded so far can be used
+                    m_frameCache.Clear();
+                    m_cacheSettings = settings;
+                    m_nCacheGeneration++;
+                }
+                m_frameCache.Lookup(GetFrameKey(idx, nLang), pFrame);
+            }
 
-        m_img.delay = sp[idx].stop - sp[idx].start;
+            if (pFrame) {
+                if (!m_img.SetPixels(pFrame->rect, pFrame->pPixels)) {
+                    return false;
+                }
+                m_img.bForced = pFrame->bForced;
+                m_img.bAnimated = false;
+                m_img.tCurrent = pFrame->tCurrent;
+                memcpy(m_img.pal, pFrame->pal, sizeof(m_img.pal));
+                // Same palette state as after Decode() since the export reads it from m_img
+                m_img.bCustomPal = m_cacheSettings.bCustomPal;
+                m_img.tridx = m_cacheSettings.tridx;
+                m_img.orgpal = m_cacheSettings.orgpal;
+                m_img.cuspal = m_cacheSettings.cuspal;
+            } else {
+                // m_cacheSettings is only changed by GetFrame() so it can be used without locking
+                pFrame = DecodeFrame(m_img, idx, nLang, m_cacheSettings);
+                if (!pFrame) {
+                    return false;
+                }
 
-        if (!ret) {
-            return false;
+                std::lock_guard<std::mutex> lock(m_mutexCache);
+                m_frameCache.SetAt(GetFrameKey(idx, nLang), pFrame);
+            }
         }
 
+        m_img.start = sp[idx].start;
+        m_img.delay = sp[idx].stop - sp[idx].start;
         m_img.nIdx = idx;
         m_img.nLang = nLang;
     }
@@ -1252,6 +1310,154 @@ bool CVobSubFile::GetFrame(size_t idx, size_t nLang /*= SIZE_T_ERROR*/, REFERENC
     return (m_bOnlyShowForcedSubs ? m_img.bForced : true);
 }
 
+CVobSubFile::DecodeSettings CVobSubFile::GetDecodeSettings() const
+{
+    DecodeSettings settings;
+    settings.bCustomPal = m_bCustomPal;
+    settings.tridx = m_tridx;
+    memcpy(settings.orgpal, m_orgpal, sizeof(settings.orgpal));
+    memcpy(settings.cuspal, m_cuspal, sizeof(settings.cuspal));
+    return settings;
+}
+
+CVobSubFrameSharedPtr CVobSubFile::DecodeFrame(CVobSubImage& img, size_t idx, size_t nLang, DecodeSettings& settings)
+{
+    size_t packetSize = 0, dataSize = 0;
+    CAutoVectorPtr<BYTE> buff;
+    buff.Attach(GetPacket(idx, packetSize, dataSize, nLang));
+    if (!buff || packetSize == 0 || dataSize == 0) {
+        return nullptr;
+    }
+
+    if (!img.Decode(buff, packetSize, dataSize, INT_MAX,
+                    settings.bCustomPal, settings.tridx, settings.orgpal, settings.cuspal, true)) {
+        return nullptr;
+    }
+
+    auto pFrame = std::make_shared<CVobSubFrame>();
+    size_t len = size_t(img.rect.Width()) * img.rect.Height();
+    if (!pFrame->pPixels.Allocate(len)) {
+        return nullptr;
+    }
+    memcpy(pFrame->pPixels, img.lpPixels, len * sizeof(RGBQUAD));
+    pFrame->rect = img.rect;
+    pFrame->bForced = img.bForced;
+    pFrame->tCurrent = img.tCurrent;
+    memcpy(pFrame->pal, img.pal, sizeof(pFrame->pal));
+
+    return pFrame;
+}
+
+void CVobSubFile::SchedulePredecode(size_t idx, size_t nLang)
+{
+    if (nLang >= m_langs.size()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutexPredecode);
+
+    if (m_nPredecodeIdx == idx && m_nPredecodeLang == nLang) {
+        return; // already requested
+    }
+    m_nPredecodeIdx = idx;
+    m_nPredecodeLang = nLang;
+    m_bPredecodeRequest = true;
+
+    if (!m_predecodeThread.joinable()) {
+        m_predecodeThread = std::thread([this] { PredecodeThreadProc(); });
+    }
+    m_condPredecode.notify_one();
+}
+
+void CVobSubFile::StopPredecode()
+{
+    if (!m_predecodeThread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutexPredecode);
+        m_bPredecodeExit = true;
+    }
+    m_condPredecode.notify_one();
+    m_predecodeThread.join();
+
+    m_bPredecodeExit = m_bPredecodeRequest = false;
+    m_nPredecodeIdx = m_nPredecodeLang = SIZE_T_ERROR;
+}
+
+void CVobSubFile::PredecodeThreadProc()
+{
+    SetThreadName(DWORD(-1), "CVobSubFile Predecode");
+
+    CVobSubImage img;
+
+    for (;;) {
+        size_t idx, nLang;
+        {
+            std::unique_lock<std::mutex> lock(m_mutexPredecode);
+            m_condPredecode.wait(lock, [this] { return m_bPredecodeExit || m_bPredecodeRequest; });
+            if (m_bPredecodeExit) {
+                return;
+            }
+            m_bPredecodeRequest = false;
+            idx = m_nPredecodeIdx;
+            nLang = m_nPredecodeLang;
+        }
+
+        DecodeSettings settings;
+        ULONG nGeneration;
+        {
+            std::lock_guard<std::mutex> lock(m_mutexCache);
+            settings = m_cacheSettings;
+            nGeneration = m_nCacheGeneration;
+        }
+
+        // The subpictures can only be added or removed once this thread is stopped
+        const CAtlArray<SubPos>& sp = m_langs[nLang].subpos;
+        size_t first = (idx == SIZE_T_ERROR) ? 0 : idx + 1;
+        for (size_t i = first, last = std::min(sp.GetCount(), first + PREDECODE_FRAMES); i < last; i++) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutexPredecode);
+                if (m_bPredecodeExit || m_bPredecodeRequest) {
+                    break; // the next request will take it from there
+                }
+            }
+
+            if (!sp[i].bValid || sp[i].bAnimated) {
+                continue;
+            }
+
+            const ULONGLONG key = GetFrameKey(i, nLang);
+            {
+                std::lock_guard<std::mutex> lock(m_mutexCache);
+                if (m_frameCache.Contains(key)) {
+                    continue;
+                }
+            }
+
+            CVobSubFrameSharedPtr pFrame = DecodeFrame(img, i, nLang, settings);
+            if (pFrame) {
+                std::lock_guard<std::mutex> lock(m_mutexCache);
+                if (nGeneration == m_nCacheGeneration) {
+                    m_frameCache.SetAt(key, pFrame);
+                }
+            }
+        }
+    }
+}
+
+CRenderingCacheStats CVobSubFile::GetFrameCacheStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutexCache);
+    return m_frameCache.GetStats();
+}
+
+size_t GetRenderingCacheSize(const CVobSubFrameSharedPtr& pFrame)
+{
+    return pFrame ? sizeof(CVobSubFrame) + size_t(pFrame->rect.Width()) * pFrame->rect.Height() * sizeof(RGBQUAD) : 0;
+}
+
 bool CVobSubFile::GetFrameByTimeStamp(__int64 time)
 {
     return GetFrame(GetFrameIdxByTimeStamp(time));
@@ -1367,7 +1573,10 @@ STDMETHODIMP CVobSubFile::Render(SubPicDesc& spd, REFERENCE_TIME rt, double fps,
 
     rt /= 10000;
 
-    if (!GetFrame(GetFrameIdxByTimeStamp(rt), SIZE_T_ERROR, rt)) {
+    size_t idx = GetFrameIdxByTimeStamp(rt);
+    SchedulePredecode(idx, m_nLang);
+
+    if (!GetFrame(idx, SIZE_T_ERROR, rt)) {
         return E_FAIL;
     }
 
@@ -22,7 +22,12 @@
 #pragma once
 
 #include <atlcoll.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include "VobSubImage.h"
+#include "RenderingCache.h"
 #include "../SubPic/SubPicProviderImpl.h"
 
 #define VOBSUBIDXVER 7
@@ -77,6 +82,22 @@ public:
     void SetAlignment(bool bAlign, int x, int y, int hor = 1, int ver = 1);
 };
 
+// A decoded and trimmed subpicture of CVobSubFile
+struct CVobSubFrame {
+    CRect rect;
+    bool bForced;
+    int tCurrent;
+    CVobSubImage::SubPal pal[4];
+    CAutoVectorPtr<RGBQUAD> pPixels;
+};
+
+typedef std::shared_ptr<CVobSubFrame> CVobSubFrameSharedPtr;
+
+size_t GetRenderingCacheSize(const CVobSubFrameSharedPtr& pFrame);
+
+// The key is made of the index and of the language of the subpicture
+typedef CRenderingCache<ULONGLONG, CVobSubFrameSharedPtr> CVobSubFrameCache;
+
 class __declspec(uuid("998D4C9A-460F-4de6-BDCD-35AB24F94ADF"))
     CVobSubFile : public CVobSubSettings, public ISubStream, public CSubPicProviderImpl
 {
@@ -111,6 +132,47 @@ protected:
     bool WriteIdx(CString fn, int delay), WriteSub(CString fn);
 
     CMemFile m_sub;
+    CCritSec m_csSub; // to protect the position of m_sub
+
+    // What the decoded pixels depend on besides the packet itself
+    struct DecodeSettings {
+        bool bCustomPal;
+        int tridx;
+        RGBQUAD orgpal[16], cuspal[4];
+
+        bool operator ==(const DecodeSettings& rhs) const {
+            return bCustomPal == rhs.bCustomPal && tridx == rhs.tridx
+                   && !memcmp(orgpal, rhs.orgpal, sizeof(orgpal)) && !memcmp(cuspal, rhs.cuspal, sizeof(cuspal));
+        }
+    };
+
+    // Non-animated subpictures are kept decoded, the frames following the one being
+    // rendered are decoded ahead of time by a background thread
+    enum {
+        FRAME_CACHE_ENTRIES = 256,
+        FRAME_CACHE_BUDGET = 32 * 1024 * 1024,
+        PREDECODE_FRAMES = 4
+    };
+    mutable std::mutex m_mutexCache; // to protect the cache and m_cacheSettings
+    CRenderingCacheBudget m_cacheBudget;
+    CVobSubFrameCache m_frameCache;
+    DecodeSettings m_cacheSettings;
+    ULONG m_nCacheGeneration;
+
+    std::thread m_predecodeThread;
+    std::mutex m_mutexPredecode; // to protect the predecode request
+    std::condition_variable m_condPredecode;
+    bool m_bPredecodeRequest, m_bPredecodeExit;
+    size_t m_nPredecodeLang, m_nPredecodeIdx;
+
+    static ULONGLONG GetFrameKey(size_t idx, size_t nLang) {
+        return (ULONGLONG(idx) << 5) | nLang;
+    }
+    DecodeSettings GetDecodeSettings() const;
+    CVobSubFrameSharedPtr DecodeFrame(CVobSubImage& img, size_t idx, size_t nLang, DecodeSettings& settings);
+    void SchedulePredecode(size_t idx, size_t nLang);
+    void StopPredecode();
+    void PredecodeThreadProc();
 
     BYTE* GetPacket(size_t idx, size_t& packetSize, size_t& dataSize, size_t nLang = SIZE_T_ERROR);
     const SubPos* GetFrameInfo(size_t idx, size_t nLang = SIZE_T_ERROR) const;
@@ -146,6 +208,8 @@ public:
 
     CString GetTitle() { return m_title; }
 
+    CRenderingCacheStats GetFrameCacheStats() const;
+
     DECLARE_IUNKNOWN
     STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, void** ppv);
 
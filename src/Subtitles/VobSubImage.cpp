@@ -24,6 +24,7 @@
 #include "RTS.h"
 #include <cmath>
 #include <algorithm>
+#include <emmintrin.h>
 
 CVobSubImage::CVobSubImage()
     : org(CSize(0, 0))
@@ -53,6 +54,18 @@ CVobSubImage::~CVobSubImage()
     Free();
 }
 
+CVobSubImage::DecodeKernel CVobSubImage::s_maxDecodeKernel = CVobSubImage::DecodeKernel::SSE2;
+
+void CVobSubImage::SetMaxDecodeKernel(DecodeKernel kernel)
+{
+    s_maxDecodeKernel = kernel;
+}
+
+CVobSubImage::DecodeKernel CVobSubImage::GetDecodeKernel()
+{
+    return s_maxDecodeKernel; // SSE2 is always available
+}
+
 bool CVobSubImage::Alloc(int w, int h)
 {
     // if there is nothing to crop TrimSubImage might even add a 1 pixel
@@ -97,6 +110,18 @@ void CVobSubImage::Free()
     lpPixels = nullptr;
 }
 
+bool CVobSubImage::SetPixels(const CRect& r, const RGBQUAD* pPixels)
+{
+    if (!Alloc(r.Width(), r.Height())) {
+        return false;
+    }
+
+    rect = r;
+    memcpy(lpPixels, pPixels, r.Width() * r.Height() * sizeof(RGBQUAD));
+
+    return true;
+}
+
 bool CVobSubImage::Decode(BYTE* _lpData, size_t _packetSize, size_t _dataSize, int _t,
                           bool _bCustomPal,
                           int _tridx,
@@ -119,6 +144,17 @@ bool CVobSubImage::Decode(BYTE* _lpData, size_t _packetSize, size_t _dataSize, i
     tridx = _tridx;
     cuspal = _cuspal;
 
+    if (GetDecodeKernel() != DecodeKernel::C) {
+        CRect bbox;
+        rect.bottom = rect.top + DecodeRows(_lpData, _dataSize, bbox);
+
+        if (_bTrim) {
+            TrimSubImage(bbox);
+        }
+
+        return true;
+    }
+
     CPoint p = rect.TopLeft();
 
     size_t end[] = { nOffset[1], _dataSize };
@@ -318,6 +354,95 @@ void CVobSubImage::DrawPixels(CPoint p, int length, size_t colorId)
     }
 }
 
+static void FillPixels(DWORD* p, int length, DWORD c)
+{
+    if (length >= 8) {
+        const __m128i c4 = _mm_set1_epi32(int(c));
+        for (; length >= 4; length -= 4, p += 4) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p), c4);
+        }
+    }
+
+    while (length-- > 0) {
+        *p++ = c;
+    }
+}
+
+// Decodes the interlaced rows of the image and returns how many were complete.
+// The bounding box of the non transparent pixels is returned in bbox, relatively to rect.
+int CVobSubImage::DecodeRows(const BYTE* lpData, size_t dataSize, CRect& bbox)
+{
+    const int w = rect.Width(), h = rect.Height();
+
+    // The palette only has to be expanded once per image
+    DWORD colors[4];
+    for (size_t i = 0; i < 4; i++) {
+        RGBQUAD c;
+        if (!bCustomPal) {
+            c = orgpal[pal[i].pal];
+            c.rgbReserved = (pal[i].tr << 4) | pal[i].tr;
+        } else {
+            c = cuspal[i];
+        }
+        colors[i] = *(DWORD*)&c;
+    }
+
+    // Same initial values as in TrimSubImage() so that an empty image isn't trimmed either
+    bbox.SetRect(w, h, 0, 0);
+
+    size_t end[] = { nOffset[1], dataSize };
+
+    for (int y = 0; y < h; y++) {
+        DWORD* row = (DWORD*)&lpPixels[w * y];
+        int left = w, right = -1;
+
+        int x = 0;
+        do {
+            // As with the C decoder, a row cut short by the end of the data isn't kept
+            if (nOffset[nPlane] >= end[nPlane]) {
+                return y;
+            }
+
+            DWORD code;
+            int length;
+
+            if ((code = GetNibble(lpData)) >= 0x4
+                    || (code = (code << 4) | GetNibble(lpData)) >= 0x10
+                    || (code = (code << 4) | GetNibble(lpData)) >= 0x40
+                    || (code = (code << 4) | GetNibble(lpData)) >= 0x100) {
+                length = std::min(int(code >> 2), w - x);
+            } else {
+                length = w - x; // until the end of the line
+            }
+
+            const DWORD c = colors[code & 3];
+            FillPixels(&row[x], length, c);
+
+            if ((c >> 24) && length > 0) {
+                left = std::min(left, x);
+                right = std::max(right, x + length - 1);
+            }
+
+            x += length;
+        } while (x < w);
+
+        if (left <= right) {
+            bbox.left = std::min<LONG>(bbox.left, left);
+            bbox.right = std::max<LONG>(bbox.right, right);
+            bbox.top = std::min<LONG>(bbox.top, y);
+            bbox.bottom = std::max<LONG>(bbox.bottom, y);
+        }
+
+        if (!bAligned) {
+            GetNibble(lpData);    // align to byte
+        }
+
+        nPlane = 1 - nPlane;
+    }
+
+    return h;
+}
+
 void CVobSubImage::TrimSubImage()
 {
     CRect r;
@@ -347,6 +472,12 @@ void CVobSubImage::TrimSubImage()
         }
     }
 
+    TrimSubImage(r);
+}
+
+// r is the bounding box of the non transparent pixels, relatively to rect and with its right and bottom included
+void CVobSubImage::TrimSubImage(CRect r)
+{
     if (r.left > r.right || r.top > r.bottom) {
         return;
     }
@@ -396,9 +527,9 @@ CAutoPtrList<COutline>* CVobSubImage::GetOutlineList(CPoint& topleft)
         return nullptr;
     }
 
-    CAutoPtrList<COutline>* ol;
+    CAutoPtr<CAutoPtrList<COutline>> ol;
     try {
-        ol = DEBUG_NEW CAutoPtrList<COutline>();
+        ol.Attach(DEBUG_NEW CAutoPtrList<COutline>());
     } catch (CMemoryException* e) {
         ASSERT(FALSE);
         e->Delete();
@@ -416,30 +547,29 @@ CAutoPtrList<COutline>* CVobSubImage::GetOutlineList(CPoint& topleft)
 
     topleft.x = topleft.y = INT_MAX;
 
-    for (;;) {
-        cp = p;
-
-        int x = 0;
-        int y = 0;
+    // Tracing an outline only marks empty pixels so it never creates a new starting
+    // point, the search can go on from the previous one instead of the first pixel.
+    int sx = 0, sy = 0;
 
-        for (y = 0; y < h; y++) {
-            for (x = 0; x < w - 1; x++, cp++) {
-                if (cp[0] == 0 && cp[1] == 1) {
-                    break;
-                }
+    for (;;) {
+        for (; sy < h; sy++, sx = 0) {
+            const BYTE* row = &p[sy * w];
+            while (sx < w - 1 && !(row[sx] == 0 && row[sx + 1] == 1)) {
+                sx++;
             }
 
-            if (x < w - 1) {
+            if (sx < w - 1) {
                 break;
             }
-
-            cp++;
         }
 
-        if (y == h) {
+        if (sy == h) {
             break;
         }
 
+        int x = sx;
+        int y = sy;
+
         int dir = UP;
 
         int ox = x, oy = y, odir = dir;
@@ -565,7 +695,7 @@ CAutoPtrList<COutline>* CVobSubImage::GetOutlineList(CPoint& topleft)
         }
     }
 
-    return ol;
+    return ol.Detach();
 }
 
 static bool FitLine(const COutline& o, int& start, int& end)
@@ -1201,11 +1331,11 @@ bool CVobSubImage::Polygonize(CAtlArray<BYTE>& pathTypes, CAtlArray<CPoint>& pat
 
                 if (iFirst < 0) {
                     iFirst = i;
-                    pathTypes.Add(PT_MOVETO);
-                    pathPoints.Add(o2.pa[0]);
+                    types.Add(PT_MOVETO);
+                    points.Add(o2.pa[0]);
                 }
 
-                AddSegment(o2, pathTypes, pathPoints);
+                AddSegment(o2, types, points);
             }
         } else {
             /*
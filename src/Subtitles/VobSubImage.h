@@ -40,7 +40,20 @@ class CVobSubImage
 {
     friend class CVobSubFile;
 
+public:
+    // Decoders of the RLE data, from the slowest to the fastest
+    enum class DecodeKernel {
+        C,   // one palette lookup per run, then a separate pass to trim the image
+        SSE2 // whole rows with vector fills, the bounding box is found while decoding
+    };
+
+    // Limits the decoder used afterwards, mostly to compare their output
+    static void SetMaxDecodeKernel(DecodeKernel kernel);
+    static DecodeKernel GetDecodeKernel();
+
 private:
+    static DecodeKernel s_maxDecodeKernel;
+
     CSize org;
     RGBQUAD* lpTemp1;
     RGBQUAD* lpTemp2;
@@ -56,7 +69,9 @@ private:
 
     BYTE GetNibble(const BYTE* lpData);
     void DrawPixels(CPoint p, int length, size_t colorId);
+    int DecodeRows(const BYTE* lpData, size_t dataSize, CRect& bbox);
     void TrimSubImage();
+    void TrimSubImage(CRect r);
 
 public:
     size_t nLang, nIdx;
@@ -75,6 +90,9 @@ public:
 
     void Invalidate() { nLang = nIdx = SIZE_T_ERROR; }
 
+    // Replaces the image by already decoded pixels of the given rect
+    bool SetPixels(const CRect& r, const RGBQUAD* pPixels);
+
     void GetPacketInfo(const BYTE* lpData, size_t packetSize, size_t dataSize, int t = INT_MAX);
     bool Decode(BYTE* lpData, size_t packetSize, size_t dataSize, int t,
                 bool bCustomPal,
@@ -625,6 +625,97 @@ HRESULT Cluster::Write(IStream* pStream)
     return S_OK;
 }
 
+ClusterWriter::ClusterWriter(DWORD id)
+    : CID(id)
+    , m_pos(0)
+    , m_len(0)
+    , TimeCode(0xE7)
+    , PrevSize(0xAB)
+{
+}
+
+ClusterWriter::~ClusterWriter()
+{
+    ASSERT(!IsOpen());
+}
+
+HRESULT ClusterWriter::Open(IStream* pStream, UINT64 timecode)
+{
+    CheckPointer(pStream, E_POINTER);
+    ASSERT(!IsOpen());
+
+    LARGE_INTEGER li = {0};
+    ULARGE_INTEGER pos;
+    HRESULT hr = pStream->Seek(li, STREAM_SEEK_CUR, &pos);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    m_pStream = pStream;
+    m_pos = pos.QuadPart;
+    m_len = 0;
+
+    // the size is unknown until Close(), write it as "unknown" with the widest coding for now
+    CID::Write(pStream);
+    CLength(0x00FFFFFFFFFFFFFFi64).Write(pStream);
+
+    TimeCode.Set(timecode);
+    m_len += TimeCode.Size();
+    m_len += PrevSize.Size();
+    TimeCode.Write(pStream);
+    return PrevSize.Write(pStream);
+}
+
+HRESULT ClusterWriter::Add(BlockGroup* b)
+{
+    CheckPointer(b, E_POINTER);
+    if (!IsOpen()) {
+        return E_UNEXPECTED;
+    }
+
+    m_len += b->Size();
+    return b->Write(m_pStream);
+}
+
+HRESULT ClusterWriter::Close()
+{
+    if (!IsOpen()) {
+        return S_FALSE;
+    }
+
+    CComPtr<IStream> pStream;
+    pStream.Attach(m_pStream.Detach());
+
+    LARGE_INTEGER li = {0};
+    ULARGE_INTEGER end;
+    HRESULT hr = pStream->Seek(li, STREAM_SEEK_CUR, &end);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    QWORD idlen = CID::Size();
+    ASSERT(end.QuadPart == m_pos + idlen + 8 + m_len);
+
+    // 8 bytes length coding: 0x01 followed by the size on 7 bytes
+    UINT64 val = m_len;
+    bswap((BYTE*)&val, 8);
+    *(BYTE*)&val = 0x01;
+
+    li.QuadPart = m_pos + idlen;
+    if (FAILED(hr = pStream->Seek(li, STREAM_SEEK_SET, nullptr))
+            || FAILED(hr = pStream->Write(&val, 8, nullptr))) {
+        return hr;
+    }
+
+    li.QuadPart = end.QuadPart;
+    if (FAILED(hr = pStream->Seek(li, STREAM_SEEK_SET, nullptr))) {
+        return hr;
+    }
+
+    PrevSize.Set(idlen + 8 + m_len);
+    return S_OK;
+}
+
 BlockGroup::BlockGroup(DWORD id)
     : CID(id)
     , BlockDuration(0x9B)
@@ -752,6 +843,67 @@ HRESULT Cue::Write(IStream* pStream)
     return S_OK;
 }
 
+CueIndex::CueIndex(DWORD id)
+    : CID(id)
+{
+}
+
+void CueIndex::Add(UINT64 time, UINT64 track, UINT64 clusterpos, UINT64 blocknum)
+{
+    CueEntry e = {time, track, clusterpos, blocknum};
+    m_entries.Add(e);
+}
+
+QWORD CueIndex::CuePointSize(const CueEntry& e, CUInt& CueTime, CueTrackPosition& ctp)
+{
+    CueTime.Set(e.CueTime);
+    ctp.CueTrack.Set(e.CueTrack);
+    ctp.CueClusterPosition.Set(e.CueClusterPosition);
+    if (e.CueBlockNumber) {
+        ctp.CueBlockNumber.Set(e.CueBlockNumber);
+    } else {
+        ctp.CueBlockNumber.UnSet();
+    }
+    return CueTime.Size() + ctp.Size();
+}
+
+QWORD CueIndex::Size(bool fWithHeader)
+{
+    CID cp(0xBB);
+    CUInt CueTime(0xB3);
+    CueTrackPosition ctp;
+
+    QWORD len = 0;
+    for (size_t i = 0, j = m_entries.GetCount(); i < j; i++) {
+        QWORD cplen = CuePointSize(m_entries[i], CueTime, ctp);
+        len += cp.Size() + CLength(cplen).Size() + cplen;
+    }
+    if (fWithHeader) {
+        len += HeaderSize(len);
+    }
+    return len;
+}
+
+HRESULT CueIndex::Write(IStream* pStream)
+{
+    HeaderWrite(pStream);
+
+    CID cp(0xBB);
+    CUInt CueTime(0xB3);
+    CueTrackPosition ctp;
+
+    for (size_t i = 0, j = m_entries.GetCount(); i < j; i++) {
+        cp.Write(pStream);
+        CLength(CuePointSize(m_entries[i], CueTime, ctp)).Write(pStream);
+        CueTime.Write(pStream);
+        HRESULT hr = ctp.Write(pStream);
+        if (FAILED(hr)) {
+            return hr;
+        }
+    }
+    return S_OK;
+}
+
 CuePoint::CuePoint(DWORD id)
     : CID(id)
     , CueTime(0xB3)
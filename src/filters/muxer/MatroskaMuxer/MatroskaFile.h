@@ -323,6 +323,33 @@ namespace MatroskaWriter
         HRESULT Write(IStream* pStream);
     };
 
+    // Writes the block groups of a cluster straight to the stream as they come,
+    // the size of the cluster is reserved with 8 bytes and patched in Close()
+    class ClusterWriter : public CID
+    {
+        CComPtr<IStream> m_pStream;
+        ULONGLONG m_pos;
+        QWORD m_len;
+
+    public:
+        CUInt TimeCode, PrevSize;
+
+        ClusterWriter(DWORD id = 0x1F43B675);
+        virtual ~ClusterWriter();
+        bool IsOpen() const {
+            return !!m_pStream;
+        }
+        ULONGLONG GetPosition() const {
+            return m_pos;
+        }
+        QWORD GetLength() const {
+            return m_len;
+        }
+        HRESULT Open(IStream* pStream, UINT64 timecode);
+        HRESULT Add(BlockGroup* b);
+        HRESULT Close();
+    };
+
     /*class CueReference : public CID
     {
     public:
@@ -365,6 +392,27 @@ namespace MatroskaWriter
         HRESULT Write(IStream* pStream);
     };
 
+    // Same output as Cue, but keeps each cue point as a few plain integers
+    // instead of a tree of nodes, so long recordings stay cheap to index
+    class CueIndex : public CID
+    {
+        struct CueEntry {
+            UINT64 CueTime, CueTrack, CueClusterPosition, CueBlockNumber;
+        };
+        CAtlArray<CueEntry> m_entries;
+
+        static QWORD CuePointSize(const CueEntry& e, CUInt& CueTime, CueTrackPosition& ctp);
+
+    public:
+        CueIndex(DWORD id = 0x1C53BB6B);
+        void Add(UINT64 time, UINT64 track, UINT64 clusterpos, UINT64 blocknum = 0);
+        bool IsEmpty() const {
+            return m_entries.IsEmpty();
+        }
+        QWORD Size(bool fWithHeader = true);
+        HRESULT Write(IStream* pStream);
+    };
+
     class SeekID : public CID
     {
         CID m_cid;
@@ -395,13 +395,8 @@ DWORD CMatroskaMuxerFilter::ThreadProc()
     Segment().Write(pStream);
     ULONGLONG segpos = GetStreamPosition(pStream);
 
-    // TODO
-    QWORD voidlen = 100;
-    if (rtDur > 0) {
-        voidlen += QWORD(1.0 * rtDur / MAXCLUSTERTIME / 10000 + 0.5) * 20;
-    } else {
-        voidlen += QWORD(1.0 * 1000 * 60 * 60 * 24 / MAXCLUSTERTIME + 0.5) * 20; // when no duration is known, allocate for 24 hours (~340k)
-    }
+    // room for the meta seek, it only points to the top level elements (clusters are found through the cues)
+    QWORD voidlen = 128;
     ULONGLONG voidpos = GetStreamPosition(pStream);
     {
         Void v(voidlen);
@@ -462,8 +457,7 @@ DWORD CMatroskaMuxerFilter::ThreadProc()
 
     //
 
-    Cluster c;
-    c.TimeCode.Set(0);
+    ClusterWriter c;
 
     bool fFirstBlock = true;
     INT64 firstTimeCode = 0;
@@ -491,10 +485,10 @@ DWORD CMatroskaMuxerFilter::ThreadProc()
             case CMD_RUN:
                 Reply(S_OK);
 
-                Cue cue;
+                CueIndex cue;
                 ULONGLONG lastcueclusterpos = (ULONGLONG) - 1;
                 INT64 lastcuetimecode = (INT64) - 1;
-                UINT64 nBlocksInCueTrack = 0;
+                UINT64 nBlocksInCluster = 0, nBlocksInCueTrack = 0;
 
                 while (!CheckRequest(nullptr)) {
                     if (m_State == State_Paused) {
@@ -601,19 +595,13 @@ DWORD CMatroskaMuxerFilter::ThreadProc()
                             continue;
                         }
 
-                        while ((INT64)(c.TimeCode + MAXCLUSTERTIME) < b->Block.TimeCode) {
-                            if (!c.BlockGroups.IsEmpty()) {
-                                sh.Attach(DEBUG_NEW SeekHead());
-                                sh->ID.Set(c.GetID()/*0x1F43B675*/);
-                                sh->Position.Set(GetStreamPosition(pStream) - segpos);
-                                seek.SeekHeads.AddTail(sh);
-
-                                c.Write(pStream); // TODO: write blocks
-                            }
+                        if (c.IsOpen() && ((INT64)(c.TimeCode + MAXCLUSTERTIME) < b->Block.TimeCode || c.GetLength() >= MAXCLUSTERSIZE)) {
+                            c.Close();
+                        }
 
-                            c.TimeCode.Set(c.TimeCode + MAXCLUSTERTIME);
-                            c.BlockGroups.RemoveAll();
-                            nBlocksInCueTrack = 0;
+                        if (!c.IsOpen()) {
+                            c.Open(pStream, std::max<REFERENCE_TIME>(b->Block.TimeCode, 0));
+                            nBlocksInCluster = nBlocksInCueTrack = 0;
                         }
 
                         if (b->Block.TrackNumber == TrackNumber) {
@@ -621,18 +609,9 @@ DWORD CMatroskaMuxerFilter::ThreadProc()
                         }
 
                         if (b->ReferenceBlock == 0 && b->Block.TrackNumber == TrackNumber) {
-                            ULONGLONG clusterpos = GetStreamPosition(pStream) - segpos;
+                            ULONGLONG clusterpos = c.GetPosition() - segpos;
                             if (lastcueclusterpos != clusterpos || lastcuetimecode + 1000 < b->Block.TimeCode) {
-                                CAutoPtr<CueTrackPosition> ctp(DEBUG_NEW CueTrackPosition());
-                                ctp->CueTrack.Set(b->Block.TrackNumber);
-                                ctp->CueClusterPosition.Set(clusterpos);
-                                if (!c.BlockGroups.IsEmpty()) {
-                                    ctp->CueBlockNumber.Set(nBlocksInCueTrack);
-                                }
-                                CAutoPtr<CuePoint> cp(DEBUG_NEW CuePoint());
-                                cp->CueTime.Set(b->Block.TimeCode);
-                                cp->CueTrackPositions.AddTail(ctp);
-                                cue.CuePoints.AddTail(cp);
+                                cue.Add(b->Block.TimeCode, b->Block.TrackNumber, clusterpos, nBlocksInCluster ? nBlocksInCueTrack : 0);
                                 lastcueclusterpos = clusterpos;
                                 lastcuetimecode = b->Block.TimeCode;
                             }
@@ -643,20 +622,14 @@ DWORD CMatroskaMuxerFilter::ThreadProc()
                         m_rtCurrent = b->Block.TimeCode * 10000;
 
                         b->Block.TimeCode -= c.TimeCode;
-                        c.BlockGroups.AddTail(b);
+                        c.Add(b);
+                        nBlocksInCluster++;
                     }
                 }
 
-                if (!c.BlockGroups.IsEmpty()) {
-                    sh.Attach(DEBUG_NEW SeekHead());
-                    sh->ID.Set(c.GetID()/*0x1F43B675*/);
-                    sh->Position.Set(GetStreamPosition(pStream) - segpos);
-                    seek.SeekHeads.AddTail(sh);
-
-                    c.Write(pStream);
-                }
+                c.Close();
 
-                if (!cue.CuePoints.IsEmpty()) {
+                if (!cue.IsEmpty()) {
                     sh.Attach(DEBUG_NEW SeekHead());
                     sh->ID.Set(cue.GetID()/*0x1C53BB6B*/);
                     sh->Position.Set(GetStreamPosition(pStream) - segpos);
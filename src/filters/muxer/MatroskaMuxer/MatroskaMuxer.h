@@ -26,6 +26,7 @@
 #include "MatroskaFile.h"
 
 #define MAXCLUSTERTIME 1000
+#define MAXCLUSTERSIZE (8 * 1024 * 1024)
 #define MAXBLOCKS 50
 
 #define MatroskaMuxerName L"MPC Matroska Muxer"
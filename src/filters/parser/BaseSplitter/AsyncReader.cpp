@@ -62,6 +62,7 @@ STDMETHODIMP CAsyncFileReader::NonDelegatingQueryInterface(REFIID riid, void** p
         QI(IAsyncReader)
         QI(ISyncReader)
         QI(IFileHandle)
+        QI(IMappedReader)
         __super::NonDelegatingQueryInterface(riid, ppv);
 }
 
@@ -69,6 +70,8 @@ STDMETHODIMP CAsyncFileReader::NonDelegatingQueryInterface(REFIID riid, void** p
 
 STDMETHODIMP CAsyncFileReader::SyncRead(LONGLONG llPosition, LONG lLength, BYTE* pBuffer)
 {
+    CAutoLock cAutoLock(&m_csRead);
+
     do {
         try {
             if ((ULONGLONG)llPosition + lLength > GetLength()) {
@@ -137,6 +140,39 @@ STDMETHODIMP_(LPCTSTR) CAsyncFileReader::GetFileName()
     return m_nCurPart != -1 ? m_strFiles[m_nCurPart] : m_strFiles[0];
 }
 
+// IMappedReader
+
+STDMETHODIMP CAsyncFileReader::MapRange(LONGLONG llPosition, LONG lLength, const BYTE** ppData, LONG* plMapped)
+{
+    CheckPointer(ppData, E_POINTER);
+    CheckPointer(plMapped, E_POINTER);
+
+    if (m_len == ULONGLONG_MAX) {
+        return E_NOTIMPL; // the file is still growing, a mapping would not follow it
+    }
+    if (llPosition < 0 || lLength <= 0 || (ULONGLONG)llPosition >= m_len) {
+        return E_INVALIDARG;
+    }
+
+    CAutoLock cAutoLock(&m_csRead);
+
+    UINT nCount = (UINT)lLength;
+    *ppData = MapView(llPosition, nCount);
+    if (!*ppData) {
+        return E_FAIL;
+    }
+    *plMapped = (LONG)nCount;
+
+    return S_OK;
+}
+
+STDMETHODIMP_(void) CAsyncFileReader::UnmapRange(const BYTE* pData)
+{
+    CAutoLock cAutoLock(&m_csRead);
+
+    UnmapView(pData);
+}
+
 //
 // CAsyncUrlReader
 //
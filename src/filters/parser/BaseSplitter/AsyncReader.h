@@ -41,12 +41,23 @@ interface __declspec(uuid("7D55F67A-826E-40B9-8A7D-3DF0CBBD272D"))
     STDMETHOD_(LPCTSTR, GetFileName)() PURE;
 };
 
-class CAsyncFileReader : public CUnknown, public CMultiFiles, public IAsyncReader, public ISyncReader, public IFileHandle
+interface __declspec(uuid("2F5B3E6A-8C1D-4F0B-9E27-5A41C6D8B37E"))
+    IMappedReader :
+    public IUnknown
+{
+    // Maps up to lLength bytes at llPosition read-only, *plMapped is less when the range reaches the end of a file.
+    // The data can be parsed in place until the pointer is given back to UnmapRange.
+    STDMETHOD(MapRange)(LONGLONG llPosition, LONG lLength, const BYTE** ppData, LONG* plMapped) PURE;
+    STDMETHOD_(void, UnmapRange)(const BYTE* pData) PURE;
+};
+
+class CAsyncFileReader : public CUnknown, public CMultiFiles, public IAsyncReader, public ISyncReader, public IFileHandle, public IMappedReader
 {
 protected:
     ULONGLONG m_len;
     HANDLE m_hBreakEvent;
     LONG m_lOsError; // CFileException::m_lOsError
+    CCritSec m_csRead; // to protect the file position, SyncRead can be called from several threads
 
 public:
     CAsyncFileReader(CString fn, HRESULT& hr);
@@ -84,6 +95,10 @@ public:
     STDMETHODIMP_(HANDLE) GetFileHandle();
     STDMETHODIMP_(LPCTSTR) GetFileName();
 
+    // IMappedReader
+
+    STDMETHODIMP MapRange(LONGLONG llPosition, LONG lLength, const BYTE** ppData, LONG* plMapped);
+    STDMETHODIMP_(void) UnmapRange(const BYTE* pData);
 };
 
 class CAsyncUrlReader : public CAsyncFileReader, protected CAMThread
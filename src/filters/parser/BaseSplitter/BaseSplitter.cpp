@@ -25,13 +25,64 @@
 #include "../../switcher/AudioSwitcher/AudioSwitcher.h"
 #include "BaseSplitter.h"
 #include <algorithm>
+#include <chrono>
+#include <typeinfo>
 
+//
+// CPacketPool
+//
+
+CPacketPool::CPacketPool() : m_size(0)
+{
+}
+
+CAutoPtr<Packet> CPacketPool::Get()
+{
+    {
+        CAutoLock cAutoLock(this);
+
+        if (!m_packets.IsEmpty()) {
+            CAutoPtr<Packet> p(m_packets.RemoveTail().Detach());
+            m_size -= p->GetCount();
+            return p;
+        }
+    }
+
+    CAutoPtr<Packet> p(DEBUG_NEW Packet());
+    return p;
+}
+
+void CPacketPool::Recycle(CAutoPtr<Packet> p)
+{
+    // Derived packets might carry more state than Reset knows about
+    if (!p || typeid(*p) != typeid(Packet)) {
+        return;
+    }
+
+    p->Reset();
+
+    CAutoLock cAutoLock(this);
+
+    if (m_packets.GetCount() < MAXPOOLEDPACKETS && m_size + p->GetCount() <= MAXPOOLEDSIZE) {
+        m_size += p->GetCount();
+        m_packets.AddTail(p);
+    }
+}
+
+void CPacketPool::RemoveAll()
+{
+    CAutoLock cAutoLock(this);
+    m_size = 0;
+    m_packets.RemoveAll();
+}
 
 //
 // CPacketQueue
 //
 
-CPacketQueue::CPacketQueue() : m_size(0)
+CPacketQueue::CPacketQueue(CPacketPool* pPool)
+    : m_size(0)
+    , m_pPool(pPool)
 {
 }
 
@@ -53,6 +104,9 @@ void CPacketQueue::Add(CAutoPtr<Packet> p)
             /*
             GetTail()->Append(*p); // too slow
             */
+            if (m_pPool) {
+                m_pPool->Recycle(p);
+            }
             return;
         }
     }
@@ -75,6 +129,12 @@ void CPacketQueue::RemoveAll()
 {
     CAutoLock cAutoLock(this);
     m_size = 0;
+    if (m_pPool) {
+        while (!IsEmpty()) {
+            CAutoPtr<Packet> p(RemoveHead().Detach());
+            m_pPool->Recycle(p);
+        }
+    }
     __super::RemoveAll();
 }
 
@@ -90,6 +150,25 @@ int CPacketQueue::GetSize()
     return m_size;
 }
 
+REFERENCE_TIME CPacketQueue::GetDuration()
+{
+    CAutoLock cAutoLock(this);
+
+    REFERENCE_TIME rtFirst = Packet::INVALID_TIME, rtLast = Packet::INVALID_TIME;
+    for (POSITION pos = GetHeadPosition(); pos && rtFirst == Packet::INVALID_TIME;) {
+        if (const Packet* p = GetNext(pos)) {
+            rtFirst = p->rtStart;
+        }
+    }
+    for (POSITION pos = GetTailPosition(); pos && rtLast == Packet::INVALID_TIME;) {
+        if (const Packet* p = GetPrev(pos)) {
+            rtLast = p->rtStart;
+        }
+    }
+
+    return rtFirst != Packet::INVALID_TIME && rtLast != Packet::INVALID_TIME ? std::max(rtLast - rtFirst, 0ll) : 0;
+}
+
 //
 // CBaseSplitterInputPin
 //
@@ -192,11 +271,16 @@ STDMETHODIMP CBaseSplitterInputPin::EndFlush()
 
 CBaseSplitterOutputPin::CBaseSplitterOutputPin(CAtlArray<CMediaType>& mts, LPCWSTR pName, CBaseFilter* pFilter, CCritSec* pLock, HRESULT* phr, int nBuffers, int QueueMaxPackets)
     : CBaseOutputPin(NAME("CBaseSplitterOutputPin"), pFilter, pLock, phr, pName)
+    , m_queue(&m_packetPool)
     , m_hrDeliver(S_OK) // just in case it were asked before the worker thread could be created and reset it
     , m_fFlushing(false)
     , m_fFlushed(false)
     , m_eEndFlush(TRUE)
     , m_QueueMaxPackets(QueueMaxPackets)
+    , m_QueueMaxBytes(MAXPACKETSIZE)
+    , m_rtQueueMaxDuration(MAXQUEUEDURATION)
+    , m_rtQueueBlocked(0)
+    , m_nQueueBlocked(0)
     , m_rtStart(0)
 {
     m_mts.Copy(mts);
@@ -205,11 +289,16 @@ CBaseSplitterOutputPin::CBaseSplitterOutputPin(CAtlArray<CMediaType>& mts, LPCWS
 
 CBaseSplitterOutputPin::CBaseSplitterOutputPin(LPCWSTR pName, CBaseFilter* pFilter, CCritSec* pLock, HRESULT* phr, int nBuffers, int QueueMaxPackets)
     : CBaseOutputPin(NAME("CBaseSplitterOutputPin"), pFilter, pLock, phr, pName)
+    , m_queue(&m_packetPool)
     , m_hrDeliver(S_OK) // just in case it were asked before the worker thread could be created and reset it
     , m_fFlushing(false)
     , m_fFlushed(false)
     , m_eEndFlush(TRUE)
     , m_QueueMaxPackets(QueueMaxPackets)
+    , m_QueueMaxBytes(MAXPACKETSIZE)
+    , m_rtQueueMaxDuration(MAXQUEUEDURATION)
+    , m_rtQueueBlocked(0)
+    , m_nQueueBlocked(0)
     , m_rtStart(0)
 {
     m_nBuffers = std::max(nBuffers, 1);
@@ -397,12 +486,28 @@ HRESULT CBaseSplitterOutputPin::QueuePacket(CAutoPtr<Packet> p)
         return S_FALSE;
     }
 
+    CBaseSplitterFilter* pFilter = static_cast<CBaseSplitterFilter*>(m_pFilter);
+    std::chrono::steady_clock::time_point blockStart;
+    bool fBlocked = false;
+
     while (S_OK == m_hrDeliver
-            && ((m_queue.GetCount() > (m_QueueMaxPackets * 2) || m_queue.GetSize() > (MAXPACKETSIZE * 3 / 2))
-                || ((m_queue.GetCount() > m_QueueMaxPackets || m_queue.GetSize() > MAXPACKETSIZE) && !(static_cast<CBaseSplitterFilter*>(m_pFilter))->IsAnyPinDrying()))) {
+            && (IsQueueFull(true)
+                || ((IsQueueFull(false) || pFilter->IsOverQueueBudget()) && !pFilter->IsAnyPinDrying()))) {
+        if (!fBlocked) {
+            blockStart = std::chrono::steady_clock::now();
+            fBlocked = true;
+        }
         Sleep(10);
     }
 
+    if (fBlocked) {
+        std::chrono::duration<double> blockTime = std::chrono::steady_clock::now() - blockStart;
+
+        CAutoLock cAutoLock(&m_queue);
+        m_rtQueueBlocked += REFERENCE_TIME(blockTime.count() * 10000000.0);
+        m_nQueueBlocked++;
+    }
+
     if (S_OK != m_hrDeliver) {
         return m_hrDeliver;
     }
@@ -412,6 +517,50 @@ HRESULT CBaseSplitterOutputPin::QueuePacket(CAutoPtr<Packet> p)
     return m_hrDeliver;
 }
 
+bool CBaseSplitterOutputPin::IsQueueFull(bool fHardLimit)
+{
+    CAutoLock cAutoLock(&m_queue);
+
+    // The hard limits apply even when another stream is about to run dry
+    __int64 nMaxPackets = fHardLimit ? m_QueueMaxPackets * 2ll : m_QueueMaxPackets;
+    __int64 nMaxBytes = fHardLimit ? m_QueueMaxBytes * 3ll / 2 : m_QueueMaxBytes;
+    REFERENCE_TIME rtMaxDuration = fHardLimit ? m_rtQueueMaxDuration * 3 / 2 : m_rtQueueMaxDuration;
+
+    return m_queue.GetCount() > nMaxPackets
+           || (nMaxBytes > 0 && m_queue.GetSize() > nMaxBytes)
+           || (rtMaxDuration > 0 && m_queue.GetDuration() > rtMaxDuration);
+}
+
+void CBaseSplitterOutputPin::SetQueueLimits(int nMaxPackets, int nMaxBytes, REFERENCE_TIME rtMaxDuration)
+{
+    CAutoLock cAutoLock(&m_queue);
+
+    m_QueueMaxPackets = nMaxPackets;
+    m_QueueMaxBytes = nMaxBytes;
+    m_rtQueueMaxDuration = rtMaxDuration;
+}
+
+void CBaseSplitterOutputPin::GetQueueStats(SplitterQueueStats& stats)
+{
+    CAutoLock cAutoLock(&m_queue);
+
+    stats.nPackets = m_queue.GetCount();
+    stats.nBytes = m_queue.GetSize();
+    stats.rtDuration = m_queue.GetDuration();
+
+    __int64 fill = stats.nPackets * 100ll / std::max(m_QueueMaxPackets, 1);
+    if (m_QueueMaxBytes > 0) {
+        fill = std::max(fill, stats.nBytes * 100ll / m_QueueMaxBytes);
+    }
+    if (m_rtQueueMaxDuration > 0) {
+        fill = std::max(fill, stats.rtDuration * 100 / m_rtQueueMaxDuration);
+    }
+    stats.nFillLevel = (int)fill;
+
+    stats.rtBlocked = m_rtQueueBlocked;
+    stats.nBlocked = m_nQueueBlocked;
+}
+
 bool CBaseSplitterOutputPin::IsDiscontinuous()
 {
     return m_mt.majortype    == MEDIATYPE_Text
@@ -514,6 +663,7 @@ HRESULT CBaseSplitterOutputPin::DeliverPacket(CAutoPtr<Packet> p)
     long nBytes = (long)p->GetCount();
 
     if (nBytes == 0) {
+        m_packetPool.Recycle(p);
         return S_OK;
     }
 
@@ -644,6 +794,8 @@ HRESULT CBaseSplitterOutputPin::DeliverPacket(CAutoPtr<Packet> p)
         }
     } while (false);
 
+    m_packetPool.Recycle(p);
+
     return hr;
 }
 
@@ -785,6 +937,10 @@ CBaseSplitterFilter::CBaseSplitterFilter(LPCTSTR pName, LPUNKNOWN pUnk, HRESULT*
     , m_fFlushing(false)
     , m_priority(THREAD_PRIORITY_NORMAL)
     , m_QueueMaxPackets(QueueMaxPackets)
+    , m_QueueMaxBytes(MAXPACKETSIZE)
+    , m_rtQueueMaxDuration(MAXQUEUEDURATION)
+    , m_fQueueLimits(false)
+    , m_nQueueBudget(0)
     , m_rtLastStart(_I64_MIN)
     , m_rtLastStop(_I64_MIN)
 {
@@ -821,6 +977,7 @@ STDMETHODIMP CBaseSplitterFilter::NonDelegatingQueryInterface(REFIID riid, void*
         QI2(IAMExtendedSeeking)
         QI(IKeyFrameInfo)
         QI(IBufferInfo)
+        QI(ISplitterQueue)
         QI(IPropertyBag)
         QI(IPropertyBag2)
         QI(IDSMPropertyBag)
@@ -888,6 +1045,9 @@ HRESULT CBaseSplitterFilter::AddOutputPin(DWORD TrackNum, CAutoPtr<CBaseSplitter
     if (!pPin) {
         return E_INVALIDARG;
     }
+    if (m_fQueueLimits) {
+        pPin->SetQueueLimits(m_QueueMaxPackets, m_QueueMaxBytes, m_rtQueueMaxDuration);
+    }
     m_pPinMap[TrackNum] = pPin;
     m_pOutputs.AddTail(pPin);
     return S_OK;
@@ -1018,6 +1178,18 @@ DWORD CBaseSplitterFilter::ThreadProc()
 #pragma warning(pop)
 }
 
+CAutoPtr<Packet> CBaseSplitterFilter::NewPacket(DWORD TrackNumber)
+{
+    CAutoPtr<Packet> p;
+    if (CBaseSplitterOutputPin* pPin = GetOutputPin(TrackNumber)) {
+        p.Attach(pPin->NewPacket().Detach());
+    } else {
+        p.Attach(DEBUG_NEW Packet());
+    }
+    p->TrackNumber = TrackNumber;
+    return p;
+}
+
 HRESULT CBaseSplitterFilter::DeliverPacket(CAutoPtr<Packet> p)
 {
     HRESULT hr = S_FALSE;
@@ -1106,7 +1278,9 @@ bool CBaseSplitterFilter::IsAnyPinDrying()
         totalsize += size;
     }
 
-    if (m_priority != THREAD_PRIORITY_NORMAL && (totalcount > m_QueueMaxPackets * 2 / 3 || totalsize > MAXPACKETSIZE * 2 / 3)) {
+    int maxsize = m_QueueMaxBytes > 0 ? m_QueueMaxBytes : INT_MAX;
+
+    if (m_priority != THREAD_PRIORITY_NORMAL && (totalcount > m_QueueMaxPackets * 2 / 3 || totalsize > maxsize / 3 * 2)) {
         //      SetThreadPriority(m_hThread, m_priority = THREAD_PRIORITY_NORMAL);
         POSITION pos2 = m_pOutputs.GetHeadPosition();
         while (pos2) {
@@ -1115,13 +1289,30 @@ bool CBaseSplitterFilter::IsAnyPinDrying()
         m_priority = THREAD_PRIORITY_NORMAL;
     }
 
-    if (totalcount < m_QueueMaxPackets && totalsize < MAXPACKETSIZE) {
+    if (totalcount < m_QueueMaxPackets && totalsize < maxsize) {
         return true;
     }
 
     return false;
 }
 
+bool CBaseSplitterFilter::IsOverQueueBudget()
+{
+    __int64 budget = m_nQueueBudget;
+    if (budget <= 0) {
+        return false;
+    }
+
+    __int64 totalsize = 0;
+
+    POSITION pos = m_pActivePins.GetHeadPosition();
+    while (pos) {
+        totalsize += m_pActivePins.GetNext(pos)->QueueSize();
+    }
+
+    return totalsize > budget;
+}
+
 HRESULT CBaseSplitterFilter::BreakConnect(PIN_DIRECTION dir, CBasePin* pPin)
 {
     CheckPointer(pPin, E_POINTER);
@@ -1634,3 +1825,53 @@ STDMETHODIMP_(DWORD) CBaseSplitterFilter::GetPriority()
 {
     return m_priority;
 }
+
+// ISplitterQueue
+
+STDMETHODIMP CBaseSplitterFilter::SetQueueLimits(int nMaxPackets, int nMaxBytes, REFERENCE_TIME rtMaxDuration)
+{
+    if (nMaxPackets <= 0 || nMaxBytes < 0 || rtMaxDuration < 0) {
+        return E_INVALIDARG;
+    }
+
+    CAutoLock cAutoLock(m_pLock);
+    CAutoLock cAutoLockPinMap(&m_csPinMap);
+
+    m_QueueMaxPackets = nMaxPackets;
+    m_QueueMaxBytes = nMaxBytes;
+    m_rtQueueMaxDuration = rtMaxDuration;
+    m_fQueueLimits = true;
+
+    POSITION pos = m_pOutputs.GetHeadPosition();
+    while (pos) {
+        m_pOutputs.GetNext(pos)->SetQueueLimits(nMaxPackets, nMaxBytes, rtMaxDuration);
+    }
+
+    return S_OK;
+}
+
+STDMETHODIMP CBaseSplitterFilter::SetQueueBudget(__int64 nMaxBytes)
+{
+    if (nMaxBytes < 0) {
+        return E_INVALIDARG;
+    }
+
+    m_nQueueBudget = nMaxBytes;
+
+    return S_OK;
+}
+
+STDMETHODIMP CBaseSplitterFilter::GetQueueStats(int i, SplitterQueueStats* pStats)
+{
+    CheckPointer(pStats, E_POINTER);
+
+    CAutoLock cAutoLock(m_pLock);
+
+    if (POSITION pos = m_pOutputs.FindIndex(i)) {
+        CBaseSplitterOutputPin* pPin = m_pOutputs.GetAt(pos);
+        pPin->GetQueueStats(*pStats);
+        return pPin->IsConnected() ? S_OK : S_FALSE;
+    }
+
+    return E_INVALIDARG;
+}
@@ -23,6 +23,7 @@
 
 #include <atlbase.h>
 #include <atlcoll.h>
+#include <atomic>
 #include <qnetwork.h>
 #include "IKeyFrameInfo.h"
 #include "IBufferInfo.h"
@@ -35,6 +36,30 @@
 #define MINPACKETSIZE 256*1024  // Beliyaal: Changed the min packet size to allow Bluray playback over network
 #define MAXPACKETS    2000
 #define MAXPACKETSIZE 128*1024*1024
+#define MAXQUEUEDURATION 0            // No limit on the duration of the queues by default
+#define MAXPOOLEDPACKETS 64          // Upper bounds of the packets kept for reuse by each output pin
+#define MAXPOOLEDSIZE    16*1024*1024
+
+struct SplitterQueueStats {
+    int nPackets;
+    int nBytes;
+    REFERENCE_TIME rtDuration;  // between the first and the last timestamp in the queue
+    int nFillLevel;             // in percent of the nearest limit
+    REFERENCE_TIME rtBlocked;   // total time the demuxer waited for the queue to drain
+    UINT nBlocked;              // how many times it had to wait
+};
+
+interface __declspec(uuid("7BBB4E24-DED5-4B15-B8B6-D0FFCC39007E"))
+    ISplitterQueue :
+    public IUnknown
+{
+    // Limits of the queue of each output pin, 0 means no limit for the bytes and the duration
+    STDMETHOD(SetQueueLimits)(int nMaxPackets, int nMaxBytes, REFERENCE_TIME rtMaxDuration) PURE;
+    // Bytes all the output pins may hold together before the demuxer waits, 0 means no limit.
+    // Like the other limits it is not enforced while a stream is about to run dry.
+    STDMETHOD(SetQueueBudget)(__int64 nMaxBytes) PURE;
+    STDMETHOD(GetQueueStats)(int i, SplitterQueueStats* pStats) PURE;
+};
 
 class Packet : public CAtlArray<BYTE>
 {
@@ -63,6 +88,31 @@ public:
         SetCount(len);
         memcpy(GetData(), ptr, len);
     }
+    // Resets everything but the data, the buffer keeps its capacity
+    void Reset() {
+        TrackNumber = 0;
+        bDiscontinuity = bSyncPoint = bAppendable = FALSE;
+        rtStart = rtStop = 0;
+        if (pmt) {
+            DeleteMediaType(pmt);
+            pmt = nullptr;
+        }
+    }
+};
+
+// Packets given back after delivery, so that demuxing does not allocate once the buffers are large enough
+class CPacketPool
+    : public CCritSec
+{
+    CAutoPtrList<Packet> m_packets;
+    size_t m_size;
+
+public:
+    CPacketPool();
+    // The data of a recycled packet is stale, the caller has to set its size
+    CAutoPtr<Packet> Get();
+    void Recycle(CAutoPtr<Packet> p);
+    void RemoveAll();
 };
 
 class CPacketQueue
@@ -70,13 +120,16 @@ class CPacketQueue
     , protected CAutoPtrList<Packet>
 {
     int m_size;
+    CPacketPool* m_pPool;
 
 public:
-    CPacketQueue();
+    // The packets merged or dropped by the queue are recycled to pPool when given
+    CPacketQueue(CPacketPool* pPool = nullptr);
     void Add(CAutoPtr<Packet> p);
     CAutoPtr<Packet> Remove();
     void RemoveAll();
     int GetCount(), GetSize();
+    REFERENCE_TIME GetDuration();
 };
 
 class CBaseSplitterFilter;
@@ -118,6 +171,7 @@ protected:
     int m_nBuffers;
 
 private:
+    CPacketPool m_packetPool;
     CPacketQueue m_queue;
 
     HRESULT m_hrDeliver;
@@ -145,6 +199,13 @@ private:
     } m_BitRate;
 
     int m_QueueMaxPackets;
+    int m_QueueMaxBytes;
+    REFERENCE_TIME m_rtQueueMaxDuration;
+    // Time spent waiting in QueuePacket
+    REFERENCE_TIME m_rtQueueBlocked;
+    UINT m_nQueueBlocked;
+
+    bool IsQueueFull(bool fHardLimit);
 
 protected:
     REFERENCE_TIME m_rtStart;
@@ -217,8 +278,12 @@ public:
     HRESULT DeliverEndFlush();
     HRESULT DeliverNewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate);
 
+    CAutoPtr<Packet> NewPacket() { return m_packetPool.Get(); }
+
     int QueueCount();
     int QueueSize();
+    void SetQueueLimits(int nMaxPackets, int nMaxBytes, REFERENCE_TIME rtMaxDuration);
+    void GetQueueStats(SplitterQueueStats& stats);
     HRESULT QueueEndOfStream();
     HRESULT QueuePacket(CAutoPtr<Packet> p);
 
@@ -248,6 +313,7 @@ class CBaseSplitterFilter
     , public IAMExtendedSeeking
     , public IKeyFrameInfo
     , public IBufferInfo
+    , public ISplitterQueue
 {
     CCritSec m_csPinMap;
     CAtlMap<DWORD, CBaseSplitterOutputPin*> m_pPinMap;
@@ -288,6 +354,8 @@ protected:
 
     void DeliverBeginFlush();
     void DeliverEndFlush();
+    // Takes the packet from the pool of the output pin of the track when there is one
+    CAutoPtr<Packet> NewPacket(DWORD TrackNumber);
     HRESULT DeliverPacket(CAutoPtr<Packet> p);
 
     int m_priority;
@@ -295,6 +363,10 @@ protected:
     CFontInstaller m_fontinst;
 
     int m_QueueMaxPackets;
+    int m_QueueMaxBytes;
+    REFERENCE_TIME m_rtQueueMaxDuration;
+    bool m_fQueueLimits; // set through SetQueueLimits, also applied to the pins added later
+    std::atomic<__int64> m_nQueueBudget;
 
 protected:
     enum { CMD_EXIT, CMD_SEEK };
@@ -316,6 +388,7 @@ public:
     STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, void** ppv);
 
     bool IsAnyPinDrying();
+    bool IsOverQueueBudget();
 
     HRESULT BreakConnect(PIN_DIRECTION dir, CBasePin* pPin);
     HRESULT CompleteConnect(PIN_DIRECTION dir, CBasePin* pPin);
@@ -413,4 +486,10 @@ public:
     STDMETHODIMP_(int) GetCount();
     STDMETHODIMP GetStatus(int i, int& samples, int& size);
     STDMETHODIMP_(DWORD) GetPriority();
+
+    // ISplitterQueue
+
+    STDMETHODIMP SetQueueLimits(int nMaxPackets, int nMaxBytes, REFERENCE_TIME rtMaxDuration);
+    STDMETHODIMP SetQueueBudget(__int64 nMaxBytes);
+    STDMETHODIMP GetQueueStats(int i, SplitterQueueStats* pStats);
 };
@@ -20,9 +20,26 @@
  */
 
 #include "stdafx.h"
+#include <chrono>
 #include "BaseSplitterFile.h"
 #include "../../../DSUtil/DSUtil.h"
 
+// The read-ahead window is sized to cover this much time at the observed throughput
+#define READ_AHEAD_TIME 0.1
+// Length of the ranges requested from the mapped reader
+#define MAPPED_WINDOW_LENGTH (4 * 1024 * 1024)
+
+// An I/O error on a mapped file raises an exception when the page is accessed
+static bool CopyMapped(BYTE* pDst, const BYTE* pSrc, size_t len)
+{
+    __try {
+        memcpy(pDst, pSrc, len);
+        return true;
+    } __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        return false;
+    }
+}
+
 //
 // CBaseSplitterFile
 //
@@ -32,6 +49,17 @@ CBaseSplitterFile::CBaseSplitterFile(IAsyncReader* pAsyncReader, HRESULT& hr, in
     , m_cachepos(0)
     , m_cachelen(0)
     , m_cachetotal(0)
+    , m_cachemin(0)
+    , m_cachealloc(0)
+    , m_prefetchpos(0)
+    , m_prefetchlen(0)
+    , m_prefetchalloc(0)
+    , m_prefetchState(PREFETCH_IDLE)
+    , m_fPrefetchExit(false)
+    , m_nSequentialMisses(0)
+    , m_pMapped(nullptr)
+    , m_mappedpos(0)
+    , m_mappedlen(0)
     , m_fStreaming(false)
     , m_fRandomAccess(false)
     , m_pos(0)
@@ -64,18 +92,54 @@ CBaseSplitterFile::CBaseSplitterFile(IAsyncReader* pAsyncReader, HRESULT& hr, in
     hr = S_OK;
 }
 
+CBaseSplitterFile::~CBaseSplitterFile()
+{
+    UnmapBytes();
+
+    if (m_prefetchThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_prefetchMutex);
+            m_fPrefetchExit = true;
+        }
+        m_prefetchCond.notify_all();
+        m_prefetchThread.join();
+    }
+
+    if (m_stats.nHits || m_stats.nStalls) {
+        TRACE(_T("CBaseSplitterFile: %I64u hits, %I64u read-ahead hits, %I64u read-ahead waits, %I64u stalls (%.1f ms), %I64d KB window\n"),
+              m_stats.nHits, m_stats.nPrefetchHits, m_stats.nPrefetchWaits, m_stats.nStalls, m_stats.stallTime, m_cachetotal >> 10);
+    }
+}
+
 bool CBaseSplitterFile::SetCacheSize(int cachelen)
 {
+    // The read-ahead buffer cannot be freed while it is being filled
+    WaitForPrefetch();
+    m_pPrefetch.Free();
+    m_prefetchalloc = 0;
+
     m_pCache.Free();
-    m_cachetotal = 0;
+    m_cachetotal = m_cachemin = m_cachealloc = 0;
     if (!m_pCache.Allocate((size_t)cachelen)) {
         return false;
     }
-    m_cachetotal = cachelen;
+    m_cachetotal = m_cachemin = m_cachealloc = cachelen;
     m_cachelen = 0;
+    m_nSequentialMisses = 0;
     return true;
 }
 
+bool CBaseSplitterFile::EnableMappedReads(bool fEnable)
+{
+    UnmapBytes();
+    m_pMappedReader.Release();
+
+    if (fEnable && m_fRandomAccess && !m_fStreaming) {
+        m_pMappedReader = m_pAsyncReader;
+    }
+    return !!m_pMappedReader;
+}
+
 __int64 CBaseSplitterFile::GetPos()
 {
     return m_pos - (m_bitlen >> 3);
@@ -123,36 +187,72 @@ HRESULT CBaseSplitterFile::Read(BYTE* pData, __int64 len)
         }
     }
 
+    if (m_pMappedReader) {
+        MappedRead(pData, len);
+        if (len == 0) {
+            return hr;
+        }
+    }
+
     if (m_cachetotal == 0 || !m_pCache) {
         hr = m_pAsyncReader->SyncRead(m_pos, (long)len, pData);
         m_pos += len;
         return hr;
     }
 
-    BYTE* pCache = m_pCache;
-
     if (m_cachepos <= m_pos && m_pos < m_cachepos + m_cachelen) {
         __int64 minlen = std::min(len, m_cachelen - (m_pos - m_cachepos));
 
-        memcpy(pData, &pCache[m_pos - m_cachepos], (size_t)minlen);
+        memcpy(pData, &m_pCache[m_pos - m_cachepos], (size_t)minlen);
 
         len -= minlen;
         m_pos += minlen;
         pData += minlen;
-    }
 
-    while (len > m_cachetotal) {
-        hr = m_pAsyncReader->SyncRead(m_pos, (long)m_cachetotal, pData);
-        if (S_OK != hr) {
+        if (len == 0) {
+            m_stats.nHits++;
             return hr;
         }
-
-        len -= m_cachetotal;
-        m_pos += m_cachetotal;
-        pData += m_cachetotal;
     }
 
+    bool fMiss = false;
+
     while (len > 0) {
+        fMiss = true;
+
+        if (TakePrefetch()) {
+            __int64 minlen = std::min(len, m_cachelen - (m_pos - m_cachepos));
+
+            memcpy(pData, &m_pCache[m_pos - m_cachepos], (size_t)minlen);
+
+            len -= minlen;
+            m_pos += minlen;
+            pData += minlen;
+            continue;
+        }
+
+        // Reading right after the cache window, or a little further, counts as sequential
+        __int64 cacheend = m_cachepos + m_cachelen;
+        if (m_pos >= cacheend && m_pos - cacheend < m_cachetotal) {
+            m_nSequentialMisses++;
+        } else {
+            // Random access, start over with the initial window
+            m_nSequentialMisses = 0;
+            m_cachetotal = m_cachemin;
+        }
+
+        if (len > m_cachetotal) {
+            hr = TimedSyncRead(m_pos, (long)m_cachetotal, pData);
+            if (S_OK != hr) {
+                return hr;
+            }
+
+            len -= m_cachetotal;
+            m_pos += m_cachetotal;
+            pData += m_cachetotal;
+            continue;
+        }
+
         __int64 tmplen = GetLength();
         __int64 maxlen = std::min(tmplen - m_pos, m_cachetotal);
         __int64 minlen = std::min(len, maxlen);
@@ -160,7 +260,17 @@ HRESULT CBaseSplitterFile::Read(BYTE* pData, __int64 len)
             return S_FALSE;
         }
 
-        hr = m_pAsyncReader->SyncRead(m_pos, (long)maxlen, pCache);
+        if (m_cachealloc < maxlen) {
+            m_pCache.Free();
+            m_cachealloc = 0;
+            if (!m_pCache.Allocate((size_t)m_cachetotal)) {
+                m_cachelen = 0;
+                return E_OUTOFMEMORY;
+            }
+            m_cachealloc = m_cachetotal;
+        }
+
+        hr = TimedSyncRead(m_pos, (long)maxlen, m_pCache);
         if (S_OK != hr) {
             return hr;
         }
@@ -168,16 +278,228 @@ HRESULT CBaseSplitterFile::Read(BYTE* pData, __int64 len)
         m_cachepos = m_pos;
         m_cachelen = maxlen;
 
-        memcpy(pData, pCache, (size_t)minlen);
+        memcpy(pData, m_pCache, (size_t)minlen);
 
         len -= minlen;
         m_pos += minlen;
         pData += minlen;
     }
 
+    if (fMiss && m_nSequentialMisses >= 2) {
+        __int64 cacheend = m_cachepos + m_cachelen;
+        StartPrefetch(m_cachepos <= m_pos && m_pos <= cacheend ? cacheend : m_pos);
+    }
+
+    return hr;
+}
+
+HRESULT CBaseSplitterFile::TimedSyncRead(__int64 pos, long len, BYTE* pData)
+{
+    auto start = std::chrono::steady_clock::now();
+    HRESULT hr = m_pAsyncReader->SyncRead(pos, len, pData);
+    std::chrono::duration<double, std::milli> readTime = std::chrono::steady_clock::now() - start;
+
+    m_stats.nStalls++;
+    m_stats.stallTime += readTime.count();
+    if (hr == S_OK) {
+        std::lock_guard<std::mutex> lock(m_prefetchMutex);
+        UpdateThroughput(len, readTime.count());
+    }
+
     return hr;
 }
 
+void CBaseSplitterFile::UpdateThroughput(__int64 len, double ms)
+{
+    // Called with m_prefetchMutex held
+    double throughput = len * 1000.0 / std::max(ms, 0.001);
+    m_stats.throughput = m_stats.throughput > 0.0 ? (m_stats.throughput * 3.0 + throughput) / 4.0 : throughput;
+}
+
+void CBaseSplitterFile::StartPrefetch(__int64 pos)
+{
+    std::unique_lock<std::mutex> lock(m_prefetchMutex);
+
+    if (m_prefetchState == PREFETCH_PENDING
+            || (m_prefetchState == PREFETCH_READY && m_prefetchpos == pos)) {
+        return;
+    }
+    m_prefetchState = PREFETCH_IDLE;
+
+    // Grow the window with the throughput so that each read amortizes the latency of the source
+    __int64 window = (__int64)(m_stats.throughput * READ_AHEAD_TIME);
+    window = (window + DEFAULT_CACHE_LENGTH - 1) / DEFAULT_CACHE_LENGTH * DEFAULT_CACHE_LENGTH;
+    m_cachetotal = std::min(std::max(window, m_cachemin), std::max(m_cachemin, (__int64)MAX_CACHE_LENGTH));
+
+    __int64 len = std::min(GetLength() - pos, m_cachetotal);
+    if (len <= 0) {
+        return;
+    }
+
+    if (m_prefetchalloc < len) {
+        m_pPrefetch.Free();
+        m_prefetchalloc = 0;
+        if (!m_pPrefetch.Allocate((size_t)m_cachetotal)) {
+            return;
+        }
+        m_prefetchalloc = m_cachetotal;
+    }
+
+    m_prefetchpos = pos;
+    m_prefetchlen = len;
+    m_prefetchState = PREFETCH_PENDING;
+
+    if (!m_prefetchThread.joinable()) {
+        m_prefetchThread = std::thread([this] { PrefetchThreadProc(); });
+    }
+
+    lock.unlock();
+    m_prefetchCond.notify_all();
+}
+
+bool CBaseSplitterFile::TakePrefetch()
+{
+    std::unique_lock<std::mutex> lock(m_prefetchMutex);
+
+    if (m_prefetchState == PREFETCH_IDLE) {
+        return false;
+    }
+
+    if (m_pos < m_prefetchpos || m_pos >= m_prefetchpos + m_prefetchlen) {
+        // Nothing to wait for, a read-ahead in progress is discarded once it is done
+        if (m_prefetchState != PREFETCH_PENDING) {
+            m_prefetchState = PREFETCH_IDLE;
+        }
+        return false;
+    }
+
+    if (m_prefetchState == PREFETCH_PENDING) {
+        auto start = std::chrono::steady_clock::now();
+        m_prefetchCond.wait(lock, [this] { return m_prefetchState != PREFETCH_PENDING; });
+        std::chrono::duration<double, std::milli> waitTime = std::chrono::steady_clock::now() - start;
+
+        m_stats.nPrefetchWaits++;
+        m_stats.stallTime += waitTime.count();
+    }
+
+    bool fReady = m_prefetchState == PREFETCH_READY;
+    m_prefetchState = PREFETCH_IDLE;
+    if (!fReady) {
+        return false;
+    }
+
+    m_stats.nPrefetchHits++;
+
+    // The current window becomes the next read-ahead buffer
+    BYTE* pCache = m_pCache.Detach();
+    m_pCache.Attach(m_pPrefetch.Detach());
+    m_pPrefetch.Attach(pCache);
+    std::swap(m_cachealloc, m_prefetchalloc);
+    m_cachepos = m_prefetchpos;
+    m_cachelen = m_prefetchlen;
+
+    return true;
+}
+
+void CBaseSplitterFile::WaitForPrefetch()
+{
+    std::unique_lock<std::mutex> lock(m_prefetchMutex);
+
+    m_prefetchCond.wait(lock, [this] { return m_prefetchState != PREFETCH_PENDING; });
+    m_prefetchState = PREFETCH_IDLE;
+}
+
+void CBaseSplitterFile::PrefetchThreadProc()
+{
+    SetThreadName(DWORD(-1), "CBaseSplitterFile Read-ahead");
+
+    std::unique_lock<std::mutex> lock(m_prefetchMutex);
+
+    for (;;) {
+        m_prefetchCond.wait(lock, [this] { return m_fPrefetchExit || m_prefetchState == PREFETCH_PENDING; });
+        if (m_fPrefetchExit) {
+            break;
+        }
+
+        __int64 pos = m_prefetchpos;
+        long len = (long)m_prefetchlen;
+        BYTE* pBuffer = m_pPrefetch;
+
+        lock.unlock();
+        auto start = std::chrono::steady_clock::now();
+        HRESULT hr = m_pAsyncReader->SyncRead(pos, len, pBuffer);
+        std::chrono::duration<double, std::milli> readTime = std::chrono::steady_clock::now() - start;
+        lock.lock();
+
+        if (hr == S_OK) {
+            UpdateThroughput(len, readTime.count());
+        }
+        m_prefetchState = hr == S_OK ? PREFETCH_READY : PREFETCH_FAILED;
+        m_prefetchCond.notify_all();
+    }
+}
+
+void CBaseSplitterFile::MappedRead(BYTE*& pData, __int64& len)
+{
+    // Whatever cannot be copied from the mapping is left to the cache
+    while (len > 0) {
+        __int64 minlen = len;
+        const BYTE* pMapped = MapBytes(m_pos, minlen);
+        if (!pMapped) {
+            break;
+        }
+        if (!CopyMapped(pData, pMapped, (size_t)minlen)) {
+            TRACE(_T("CBaseSplitterFile: I/O error on the mapped file, falling back to reading it\n"));
+            EnableMappedReads(false);
+            break;
+        }
+
+        len -= minlen;
+        m_pos += minlen;
+        pData += minlen;
+    }
+}
+
+const BYTE* CBaseSplitterFile::MapBytes(__int64 pos, __int64& len)
+{
+    if (!m_pMappedReader || pos < 0 || len <= 0) {
+        return nullptr;
+    }
+
+    if (!m_pMapped || pos < m_mappedpos || pos >= m_mappedpos + m_mappedlen) {
+        UnmapBytes();
+
+        __int64 maxlen = std::min(GetLength() - pos, (__int64)MAPPED_WINDOW_LENGTH);
+        if (maxlen <= 0) {
+            return nullptr;
+        }
+
+        const BYTE* pMapped = nullptr;
+        LONG mappedlen = 0;
+        if (FAILED(m_pMappedReader->MapRange(pos, (LONG)maxlen, &pMapped, &mappedlen))) {
+            // Not worth trying again for every read
+            m_pMappedReader.Release();
+            return nullptr;
+        }
+
+        m_pMapped = pMapped;
+        m_mappedpos = pos;
+        m_mappedlen = mappedlen;
+    }
+
+    len = std::min(len, m_mappedpos + m_mappedlen - pos);
+    return m_pMapped + (pos - m_mappedpos);
+}
+
+void CBaseSplitterFile::UnmapBytes()
+{
+    if (m_pMapped) {
+        m_pMappedReader->UnmapRange(m_pMapped);
+        m_pMapped = nullptr;
+        m_mappedlen = 0;
+    }
+}
+
 UINT64 CBaseSplitterFile::BitRead(int nBits, bool fPeek)
 {
     ASSERT(nBits >= 0 && nBits <= 64);
@@ -23,20 +23,68 @@
 
 #include <atlcoll.h>
 #include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "AsyncReader.h"
 
 #define DEFAULT_CACHE_LENGTH 64*1024    // Beliyaal: Changed the default cache length to allow Bluray playback over network
+#define MAX_CACHE_LENGTH 4*1024*1024    // Upper bound of the cache window when it grows for sequential reads
 
 class CBaseSplitterFile
 {
+    struct CacheStats {
+        UINT64 nHits = 0;          // reads served by the cache window
+        UINT64 nPrefetchHits = 0;  // misses served by a finished read-ahead
+        UINT64 nPrefetchWaits = 0; // misses waiting for the read-ahead in progress
+        UINT64 nStalls = 0;        // misses read synchronously from the source
+        double stallTime = 0.0;    // time spent waiting for the source, in ms
+        double throughput = 0.0;   // observed throughput of the source, in bytes per second
+    };
+
     CComPtr<IAsyncReader> m_pAsyncReader;
     CAutoVectorPtr<BYTE> m_pCache;
     __int64 m_cachepos, m_cachelen, m_cachetotal;
+    __int64 m_cachemin, m_cachealloc;
+
+    // Read-ahead of the window following the cache, done by m_prefetchThread
+    // once the file is read sequentially. The buffers are swapped when it is used.
+    enum PrefetchState {
+        PREFETCH_IDLE,
+        PREFETCH_PENDING,
+        PREFETCH_READY,
+        PREFETCH_FAILED
+    };
+    CAutoVectorPtr<BYTE> m_pPrefetch;
+    __int64 m_prefetchpos, m_prefetchlen, m_prefetchalloc;
+    PrefetchState m_prefetchState;
+    bool m_fPrefetchExit;
+    std::thread m_prefetchThread;
+    std::mutex m_prefetchMutex; // to protect the read-ahead state and the throughput
+    std::condition_variable m_prefetchCond;
+    int m_nSequentialMisses;
+    CacheStats m_stats;
+
+    // Window of the file mapped in memory, reads are copied from it directly when enabled
+    CComQIPtr<IMappedReader> m_pMappedReader;
+    const BYTE* m_pMapped;
+    __int64 m_mappedpos, m_mappedlen;
 
     bool m_fStreaming, m_fRandomAccess;
     __int64 m_pos, m_len;
 
     virtual HRESULT Read(BYTE* pData, __int64 len); // use ByteRead
 
+    HRESULT TimedSyncRead(__int64 pos, long len, BYTE* pData);
+    void UpdateThroughput(__int64 len, double ms);
+    void StartPrefetch(__int64 pos);
+    bool TakePrefetch();
+    void WaitForPrefetch();
+    void PrefetchThreadProc();
+
+    void MappedRead(BYTE*& pData, __int64& len);
+    void UnmapBytes();
+
 protected:
     UINT64 m_bitbuff;
     int m_bitlen;
@@ -47,9 +95,11 @@ public:
     CBaseSplitterFile(IAsyncReader* pReader, HRESULT& hr,
                       int cachelen = DEFAULT_CACHE_LENGTH,
                       bool fRandomAccess = true, bool fStreaming = false);
-    virtual ~CBaseSplitterFile() {}
+    virtual ~CBaseSplitterFile();
 
     bool SetCacheSize(int cachelen = DEFAULT_CACHE_LENGTH);
+    // Maps the file in memory instead of reading it when the source supports it
+    bool EnableMappedReads(bool fEnable = true);
 
     __int64 GetPos();
     __int64 GetAvailable();
@@ -63,6 +113,9 @@ public:
     UINT64 BitRead(int nBits, bool fPeek = false);
     void BitByteAlign(), BitFlush();
     HRESULT ByteRead(BYTE* pData, __int64 len);
+    // Gives up to len bytes at pos to parse in place, len is reduced to what is mapped.
+    // The pointer is valid until the next read, nullptr means the data has to be read.
+    const BYTE* MapBytes(__int64 pos, __int64& len);
 
     bool IsStreaming() const { return m_fStreaming; }
     bool IsRandomAccess() const { return m_fRandomAccess; }
@@ -22,6 +22,12 @@
 #include "stdafx.h"
 #include "MultiFiles.h"
 
+#ifdef _WIN64
+#define MAPPED_VIEW_SIZE (64 * 1024 * 1024)
+#else
+#define MAPPED_VIEW_SIZE (16 * 1024 * 1024) // the address space is scarce
+#endif
+#define MAX_UNUSED_VIEWS 4
 
 IMPLEMENT_DYNAMIC(CMultiFiles, CObject)
 
@@ -30,6 +36,7 @@ CMultiFiles::CMultiFiles()
     , m_hFile(INVALID_HANDLE_VALUE)
     , m_nCurPart(-1)
     , m_llTotalLength(0)
+    , m_nMapUseCount(0)
 {
 }
 
@@ -156,6 +163,7 @@ UINT CMultiFiles::Read(void* lpBuf, UINT nCount)
 
 void CMultiFiles::Close()
 {
+    CloseMappings();
     ClosePart();
     Reset();
 }
@@ -163,6 +171,160 @@ void CMultiFiles::Close()
 CMultiFiles::~CMultiFiles()
 {
     Close();
+
+    POSITION pos = m_mappedViews.GetHeadPosition();
+    while (pos) {
+        const MappedView& view = m_mappedViews.GetNext(pos);
+        ASSERT(view.nRefs == 0);
+        UnmapViewOfFile(view.pData);
+    }
+    m_mappedViews.RemoveAll();
+}
+
+const BYTE* CMultiFiles::MapView(ULONGLONG llPosition, UINT& nCount)
+{
+    size_t nPart = 0;
+    ULONGLONG llOffset = llPosition, llPartSize;
+    while ((llPartSize = GetPartSize(nPart)) <= llOffset) {
+        llOffset -= llPartSize;
+        if (++nPart >= m_strFiles.GetCount()) {
+            return nullptr;
+        }
+    }
+    nCount = (UINT)std::min<ULONGLONG>(nCount, llPartSize - llOffset);
+
+    POSITION pos = m_mappedViews.GetHeadPosition();
+    while (pos) {
+        MappedView& view = m_mappedViews.GetNext(pos);
+        if (view.nPart == nPart && view.llOffset <= llOffset && llOffset + nCount <= view.llOffset + view.nSize) {
+            view.nRefs++;
+            view.nLastUse = ++m_nMapUseCount;
+            return view.pData + (llOffset - view.llOffset);
+        }
+    }
+
+    if (!OpenMapping(nPart)) {
+        return nullptr;
+    }
+
+    static const ULONGLONG llGranularity = [] {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        return (ULONGLONG)si.dwAllocationGranularity;
+    }();
+
+    MappedView view;
+    view.nPart = nPart;
+    view.llOffset = llOffset / llGranularity * llGranularity;
+    view.nSize = (SIZE_T)std::min(std::max<ULONGLONG>(MAPPED_VIEW_SIZE, llOffset + nCount - view.llOffset), llPartSize - view.llOffset);
+    view.pData = (BYTE*)MapViewOfFile(m_hMappings[nPart], FILE_MAP_READ, DWORD(view.llOffset >> 32), DWORD(view.llOffset), view.nSize);
+    if (!view.pData) {
+        return nullptr;
+    }
+    view.nRefs = 1;
+    view.nLastUse = ++m_nMapUseCount;
+    m_mappedViews.AddHead(view);
+
+    TrimViews();
+
+    return view.pData + (llOffset - view.llOffset);
+}
+
+void CMultiFiles::UnmapView(const BYTE* pData)
+{
+    POSITION pos = m_mappedViews.GetHeadPosition();
+    while (pos) {
+        POSITION cur = pos;
+        MappedView& view = m_mappedViews.GetNext(pos);
+        if (view.pData <= pData && pData < view.pData + view.nSize) {
+            ASSERT(view.nRefs > 0);
+            if (--view.nRefs == 0 && view.nPart == SIZE_T_MAX) {
+                UnmapViewOfFile(view.pData);
+                m_mappedViews.RemoveAt(cur);
+            } else {
+                TrimViews();
+            }
+            return;
+        }
+    }
+    ASSERT(FALSE);
+}
+
+ULONGLONG CMultiFiles::GetPartSize(size_t nPart) const
+{
+    return m_strFiles.GetCount() == 1 ? GetLength() : m_FilesSize[nPart];
+}
+
+bool CMultiFiles::OpenMapping(size_t nPart)
+{
+    if (m_hMappings.GetCount() != m_strFiles.GetCount()) {
+        m_hMappings.SetCount(m_strFiles.GetCount());
+    }
+    if (m_hMappings[nPart]) {
+        return true;
+    }
+
+    // The mapping keeps its own reference to the file so the handle is not needed afterwards
+    HANDLE hFile = CreateFile(m_strFiles[nPart], GENERIC_READ, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    m_hMappings[nPart] = CreateFileMapping(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(hFile);
+
+    return m_hMappings[nPart] != nullptr;
+}
+
+void CMultiFiles::CloseMappings()
+{
+    for (size_t i = 0; i < m_hMappings.GetCount(); i++) {
+        if (m_hMappings[i]) {
+            CloseHandle(m_hMappings[i]);
+        }
+    }
+    m_hMappings.RemoveAll();
+
+    // The views still in use remain valid, they just cannot be found anymore
+    POSITION pos = m_mappedViews.GetHeadPosition();
+    while (pos) {
+        POSITION cur = pos;
+        MappedView& view = m_mappedViews.GetNext(pos);
+        if (view.nRefs > 0) {
+            view.nPart = SIZE_T_MAX;
+        } else {
+            UnmapViewOfFile(view.pData);
+            m_mappedViews.RemoveAt(cur);
+        }
+    }
+}
+
+void CMultiFiles::TrimViews()
+{
+    for (;;) {
+        size_t nUnused = 0;
+        POSITION oldest = nullptr;
+        ULONGLONG nOldestUse = ULONGLONG_MAX;
+
+        POSITION pos = m_mappedViews.GetHeadPosition();
+        while (pos) {
+            POSITION cur = pos;
+            const MappedView& view = m_mappedViews.GetNext(pos);
+            if (view.nRefs == 0) {
+                nUnused++;
+                if (view.nLastUse < nOldestUse) {
+                    nOldestUse = view.nLastUse;
+                    oldest = cur;
+                }
+            }
+        }
+
+        if (nUnused <= MAX_UNUSED_VIEWS) {
+            break;
+        }
+
+        UnmapViewOfFile(m_mappedViews.GetAt(oldest).pData);
+        m_mappedViews.RemoveAt(oldest);
+    }
 }
 
 BOOL CMultiFiles::OpenPart(int nPart)
@@ -81,6 +81,11 @@ public:
     virtual UINT Read(void* lpBuf, UINT nCount);
     virtual void Close();
 
+    // Maps up to nCount bytes read-only, nCount is reduced when the range reaches the end of a part.
+    // The data stays valid until the pointer is given back to UnmapView, even if the file is closed.
+    const BYTE* MapView(ULONGLONG llPosition, UINT& nCount);
+    void UnmapView(const BYTE* pData);
+
     // Implementation
 public:
     virtual ~CMultiFiles();
@@ -94,8 +99,25 @@ protected:
     int m_nCurPart;
     ULONGLONG m_llTotalLength;
 
+    // Windows of the parts mapped in memory, the unused ones are kept around until there are too many
+    struct MappedView {
+        size_t nPart;       // SIZE_T_MAX once the files were closed
+        ULONGLONG llOffset; // in the part
+        SIZE_T nSize;
+        BYTE* pData;
+        int nRefs;
+        ULONGLONG nLastUse;
+    };
+    CAtlArray<HANDLE> m_hMappings;
+    CAtlList<MappedView> m_mappedViews;
+    ULONGLONG m_nMapUseCount;
+
     BOOL OpenPart(int nPart);
     void ClosePart();
+    ULONGLONG GetPartSize(size_t nPart) const;
+    bool OpenMapping(size_t nPart);
+    void CloseMappings();
+    void TrimViews();
     ULONGLONG GetAbsolutePosition(LONGLONG lOff, UINT nFrom);
     void Reset();
 };
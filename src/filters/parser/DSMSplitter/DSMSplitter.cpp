@@ -118,7 +118,7 @@ HRESULT CDSMSplitterFilter::CreateOutputs(IAsyncReader* pAsyncReader)
     HRESULT hr = E_FAIL;
 
     m_pFile.Free();
-    m_pFile.Attach(DEBUG_NEW CDSMSplitterFile(pAsyncReader, hr, *this, *this));
+    m_pFile.Attach(DEBUG_NEW CDSMSplitterFile(pAsyncReader, hr, *this, *this, GetPartFilename(pAsyncReader)));
     if (!m_pFile) {
         return E_OUTOFMEMORY;
     }
@@ -235,7 +235,7 @@ bool CDSMSplitterFilter::DemuxLoop()
         __int64 pos = m_pFile->GetPos();
 
         if (type == DSMP_SAMPLE) {
-            CAutoPtr<Packet> p(DEBUG_NEW Packet());
+            CAutoPtr<Packet> p(NewPacket((DWORD)m_pFile->BitRead(8, true)).Detach());
             if (m_pFile->Read(len, p)) {
                 if (p->rtStart != Packet::INVALID_TIME) {
                     p->rtStart -= m_pFile->m_rtFirst;
@@ -257,6 +257,7 @@ bool CDSMSplitterFilter::DemuxLoop()
 STDMETHODIMP CDSMSplitterFilter::GetKeyFrameCount(UINT& nKFs)
 {
     CheckPointer(m_pFile, E_UNEXPECTED);
+    CAutoLock cAutoLock(&m_pFile->m_csSyncPoints);
     nKFs = (UINT)m_pFile->m_sps.GetCount();
     return S_OK;
 }
@@ -271,8 +272,12 @@ STDMETHODIMP CDSMSplitterFilter::GetKeyFrames(const GUID* pFormat, REFERENCE_TIM
         return E_INVALIDARG;
     }
 
+    CAutoLock cAutoLock(&m_pFile->m_csSyncPoints);
+
     // these aren't really the keyframes, but quicky accessable points in the stream
-    for (nKFs = 0; nKFs < m_pFile->m_sps.GetCount(); nKFs++) {
+    // the index can grow once it is built, so no more than the given count is returned
+    UINT nMaxKFs = nKFs;
+    for (nKFs = 0; nKFs < nMaxKFs && nKFs < m_pFile->m_sps.GetCount(); nKFs++) {
         pKFs[nKFs] = m_pFile->m_sps[nKFs].rt;
     }
 
@@ -24,8 +24,77 @@
 #include "../../../DSUtil/DSUtil.h"
 #include "moreuuids.h"
 
-CDSMSplitterFile::CDSMSplitterFile(IAsyncReader* pReader, HRESULT& hr, IDSMResourceBagImpl& res, IDSMChapterBagImpl& chap)
+#define INDEX_CACHE_MAGIC   0x49445344 // "DSDI"
+#define INDEX_CACHE_VERSION 1
+#define INDEX_CACHE_MAX_FILES 100 // the oldest indexes are deleted above this count
+
+// Header of the cached index, followed by the path of the file and the sync points
+struct IndexCacheHeader {
+    DWORD magic, version;
+    ULONGLONG size, mtime;
+    DWORD nPathLength, nSyncPoints;
+};
+
+// Deletes the oldest indexes of the cache directory so that it doesn't grow forever
+static void PruneIndexCache(LPCTSTR pszCachePath)
+{
+    CString dir = pszCachePath;
+    dir.Truncate(std::max(0, dir.ReverseFind(_T('\\'))));
+
+    struct CacheFile {
+        ULONGLONG mtime;
+        CString fn;
+    };
+    CAtlArray<CacheFile> files;
+
+    WIN32_FIND_DATA fd;
+    HANDLE hFind = FindFirstFile(dir + _T("\\*.idx"), &fd);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            CacheFile& file = files.GetAt(files.Add());
+            file.mtime = ((ULONGLONG)fd.ftLastWriteTime.dwHighDateTime << 32) | fd.ftLastWriteTime.dwLowDateTime;
+            file.fn = fd.cFileName;
+        }
+    } while (FindNextFile(hFind, &fd));
+    FindClose(hFind);
+
+    if (files.GetCount() <= INDEX_CACHE_MAX_FILES) {
+        return;
+    }
+
+    // Newest first
+    std::sort(files.GetData(), files.GetData() + files.GetCount(), [](const CacheFile & a, const CacheFile & b) {
+        return a.mtime > b.mtime;
+    });
+    for (size_t i = INDEX_CACHE_MAX_FILES; i < files.GetCount(); i++) {
+        DeleteFile(dir + _T("\\") + files[i].fn);
+    }
+}
+
+// Shifts the bytes into id until the sync word is found, returns how many were used or -1 on an I/O error
+static __int64 ScanSyncWord(const BYTE* p, __int64 len, UINT64& id)
+{
+    __int64 i = 0;
+    UINT64 tmp = id;
+    __try {
+        while (i < len && (tmp & ((1ui64 << (DSMSW_SIZE << 3)) - 1)) != DSMSW) {
+            tmp = (tmp << 8) | p[i++];
+        }
+    } __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+        return -1;
+    }
+    id = tmp;
+    return i;
+}
+
+CDSMSplitterFile::CDSMSplitterFile(IAsyncReader* pReader, HRESULT& hr, IDSMResourceBagImpl& res, IDSMChapterBagImpl& chap, LPCTSTR pszFileName)
     : CBaseSplitterFile(pReader, hr, DEFAULT_CACHE_LENGTH, false)
+    , m_pReader(pReader)
+    , m_fn(pszFileName)
+    , m_fIndexAbort(false)
     , m_rtFirst(0)
     , m_rtDuration(0)
 {
@@ -33,7 +102,34 @@ CDSMSplitterFile::CDSMSplitterFile(IAsyncReader* pReader, HRESULT& hr, IDSMResou
         return;
     }
 
+    EnableMappedReads();
+
     hr = Init(res, chap);
+
+    // Seeking has to probe the file without an index, build one once and keep it for the next time
+    if (SUCCEEDED(hr) && m_sps.GetCount() <= 1 && IsRandomAccess() && !LoadIndex()) {
+        m_indexThread = std::thread([this] { BuildIndex(); });
+    }
+}
+
+CDSMSplitterFile::CDSMSplitterFile(IAsyncReader* pReader, HRESULT& hr)
+    : CBaseSplitterFile(pReader, hr, DEFAULT_CACHE_LENGTH, false)
+    , m_pReader(pReader)
+    , m_fIndexAbort(false)
+    , m_rtFirst(0)
+    , m_rtDuration(0)
+{
+    if (SUCCEEDED(hr)) {
+        EnableMappedReads();
+    }
+}
+
+CDSMSplitterFile::~CDSMSplitterFile()
+{
+    if (m_indexThread.joinable()) {
+        m_fIndexAbort = true;
+        m_indexThread.join();
+    }
 }
 
 HRESULT CDSMSplitterFile::Init(IDSMResourceBagImpl& res, IDSMChapterBagImpl& chap)
@@ -146,7 +242,25 @@ bool CDSMSplitterFile::Sync(UINT64& syncpos, dsmp_t& type, UINT64& len, __int64
 
     limit += DSMSW_SIZE;
 
-    for (UINT64 id = 0; (id & ((1ui64 << (DSMSW_SIZE << 3)) - 1)) != DSMSW; id = (id << 8) | (BYTE)BitRead(8)) {
+    UINT64 id = 0;
+
+    // Look for the sync word in the mapped file first, the loop below reads whatever is not mapped
+    __int64 pos = GetPos(), end = pos + std::min(limit, GetRemaining() - 2);
+    while (pos < end) {
+        __int64 n = end - pos;
+        const BYTE* p = MapBytes(pos, n);
+        if (!p || (n = ScanSyncWord(p, n, id)) < 0) {
+            break;
+        }
+        pos += n;
+        limit -= n;
+        if ((id & ((1ui64 << (DSMSW_SIZE << 3)) - 1)) == DSMSW) {
+            break;
+        }
+    }
+    Seek(pos);
+
+    for (; (id & ((1ui64 << (DSMSW_SIZE << 3)) - 1)) != DSMSW; id = (id << 8) | (BYTE)BitRead(8)) {
         if (limit-- <= 0 || GetRemaining() <= 2) {
             return false;
         }
@@ -308,9 +422,13 @@ __int64 CDSMSplitterFile::Read(__int64 len, CStringW& str)
 
 __int64 CDSMSplitterFile::FindSyncPoint(REFERENCE_TIME rt)
 {
-    if (/*!m_sps.IsEmpty()*/ m_sps.GetCount() > 1) {
-        size_t i = range_bsearch(m_sps, m_rtFirst + rt);
-        return (i != MAXSIZE_T) ? m_sps[i].fp : 0;
+    {
+        CAutoLock cAutoLock(&m_csSyncPoints);
+
+        if (/*!m_sps.IsEmpty()*/ m_sps.GetCount() > 1) {
+            size_t i = range_bsearch(m_sps, m_rtFirst + rt);
+            return (i != MAXSIZE_T) ? m_sps[i].fp : 0;
+        }
     }
 
     if (m_rtDuration <= 0 || rt <= m_rtFirst) {
@@ -423,3 +541,189 @@ __int64 CDSMSplitterFile::FindSyncPoint(REFERENCE_TIME rt)
 
     return ret;
 }
+
+void CDSMSplitterFile::BuildIndex()
+{
+    SetThreadName(DWORD(-1), "CDSMSplitterFile Indexer");
+    ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+    ULONGLONG size = 0, mtime = 0;
+    CString cachePath = GetIndexCachePath(size, mtime);
+
+    HRESULT hr = S_OK;
+    CDSMSplitterFile file(m_pReader, hr);
+    if (FAILED(hr)) {
+        return;
+    }
+
+    CAtlMap<BYTE, BYTE> ids;
+
+    POSITION pos = m_mts.GetStartPosition();
+    while (pos) {
+        BYTE id;
+        CMediaType mt;
+        m_mts.GetNextAssoc(pos, id, mt);
+        if (mt.majortype != MEDIATYPE_Text && mt.majortype != MEDIATYPE_Subtitle) {
+            ids[id] = 0;
+        }
+    }
+
+    if (ids.IsEmpty()) {
+        return;
+    }
+
+    // Playback can start at a position once every stream but the subtitles has a keyframe after it.
+    // The time of such a sync point is the time of the latest of these keyframes.
+    CAtlMap<BYTE, SyncPoint> keyframes;
+    CAtlArray<SyncPoint> sps;
+
+    dsmp_t type;
+    UINT64 syncpos, len;
+
+    while (!m_fIndexAbort && file.GetRemaining() > 2) {
+        if (!file.Sync(syncpos, type, len)) {
+            continue;
+        }
+
+        __int64 next = file.GetPos() + len;
+
+        if (type == DSMP_SAMPLE) {
+            Packet p;
+            BYTE tmp;
+            if (file.Read(len, &p, false) && p.rtStart != Packet::INVALID_TIME && p.bSyncPoint
+                    && ids.Lookup((BYTE)p.TrackNumber, tmp)) {
+                SyncPoint& kf = keyframes[(BYTE)p.TrackNumber];
+                kf.rt = p.rtStart;
+                kf.fp = (__int64)syncpos;
+
+                if (keyframes.GetCount() == ids.GetCount()) {
+                    SyncPoint sp = {_I64_MIN, _I64_MAX};
+                    POSITION kfpos = keyframes.GetStartPosition();
+                    while (kfpos) {
+                        const SyncPoint& kf2 = keyframes.GetNextValue(kfpos);
+                        sp.rt = std::max(sp.rt, kf2.rt);
+                        sp.fp = std::min(sp.fp, kf2.fp);
+                    }
+
+                    if (sps.IsEmpty() || (sp.rt > sps[sps.GetCount() - 1].rt && sp.fp > sps[sps.GetCount() - 1].fp)) {
+                        sps.Add(sp);
+                    }
+                }
+            }
+        }
+
+        file.Seek(next);
+    }
+
+    if (m_fIndexAbort) {
+        return;
+    }
+
+    TRACE(_T("CDSMSplitterFile: built an index of %Iu sync points\n"), sps.GetCount());
+
+    // A file still being written is not worth caching
+    if (!cachePath.IsEmpty() && size == (ULONGLONG)file.GetLength(true)) {
+        SaveIndex(cachePath, sps, size, mtime);
+    }
+
+    CAutoLock cAutoLock(&m_csSyncPoints);
+    m_sps.Copy(sps);
+}
+
+CString CDSMSplitterFile::GetIndexCachePath(ULONGLONG& size, ULONGLONG& mtime)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    TCHAR path[MAX_PATH];
+    if (m_fn.IsEmpty() || !GetFileAttributesEx(m_fn, GetFileExInfoStandard, &fad) || !GetTempPath(MAX_PATH, path)) {
+        return _T("");
+    }
+
+    size = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    mtime = ((ULONGLONG)fad.ftLastWriteTime.dwHighDateTime << 32) | fad.ftLastWriteTime.dwLowDateTime;
+
+    CString dir = CString(path) + _T("mpc-hc_dsmidx");
+    CreateDirectory(dir, nullptr);
+
+    // Named after the path of the file, which is stored in the cache too since the hash can collide
+    CString fn = m_fn;
+    fn.MakeLower();
+
+    CString cachePath;
+    cachePath.Format(_T("%s\\%08lx.idx"), dir.GetString(), CStringElementTraits<CString>::Hash(fn));
+    return cachePath;
+}
+
+bool CDSMSplitterFile::LoadIndex()
+{
+    ULONGLONG size = 0, mtime = 0;
+    CString cachePath = GetIndexCachePath(size, mtime);
+
+    CFile f;
+    if (cachePath.IsEmpty() || !f.Open(cachePath, CFile::modeRead | CFile::shareDenyWrite | CFile::typeBinary)) {
+        return false;
+    }
+
+    try {
+        IndexCacheHeader h;
+        if (f.Read(&h, sizeof(h)) != sizeof(h)
+                || h.magic != INDEX_CACHE_MAGIC || h.version != INDEX_CACHE_VERSION
+                || h.size != size || h.mtime != mtime
+                || h.nPathLength != (DWORD)m_fn.GetLength()
+                || f.GetLength() != sizeof(h) + h.nPathLength * sizeof(TCHAR) + (ULONGLONG)h.nSyncPoints * sizeof(SyncPoint)) {
+            return false;
+        }
+
+        CString fn;
+        UINT nBytes = (UINT)(h.nPathLength * sizeof(TCHAR));
+        UINT nRead = f.Read(fn.GetBuffer(h.nPathLength), nBytes);
+        fn.ReleaseBuffer(h.nPathLength);
+        if (nRead != nBytes || fn.CompareNoCase(m_fn)) {
+            return false;
+        }
+
+        CAtlArray<SyncPoint> sps;
+        nBytes = (UINT)(h.nSyncPoints * sizeof(SyncPoint));
+        if (!sps.SetCount(h.nSyncPoints) || f.Read(sps.GetData(), nBytes) != nBytes) {
+            return false;
+        }
+
+        CAutoLock cAutoLock(&m_csSyncPoints);
+        m_sps.Copy(sps);
+        return true;
+    } catch (CFileException* e) {
+        e->Delete();
+    }
+
+    return false;
+}
+
+void CDSMSplitterFile::SaveIndex(LPCTSTR pszCachePath, const CAtlArray<SyncPoint>& sps, ULONGLONG size, ULONGLONG mtime)
+{
+    // Written under another name first so that an incomplete index is never loaded
+    CString tmpPath = CString(pszCachePath) + _T(".tmp");
+
+    CFile f;
+    if (!f.Open(tmpPath, CFile::modeCreate | CFile::modeWrite | CFile::shareExclusive | CFile::typeBinary)) {
+        return;
+    }
+
+    try {
+        IndexCacheHeader h = {INDEX_CACHE_MAGIC, INDEX_CACHE_VERSION, size, mtime, (DWORD)m_fn.GetLength(), (DWORD)sps.GetCount()};
+        f.Write(&h, sizeof(h));
+        f.Write(m_fn.GetString(), (UINT)(m_fn.GetLength() * sizeof(TCHAR)));
+        f.Write(sps.GetData(), (UINT)(sps.GetCount() * sizeof(SyncPoint)));
+        f.Close();
+    } catch (CFileException* e) {
+        e->Delete();
+        f.Abort();
+        DeleteFile(tmpPath);
+        return;
+    }
+
+    if (!MoveFileEx(tmpPath, pszCachePath, MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFile(tmpPath);
+        return;
+    }
+
+    PruneIndexCache(pszCachePath);
+}
@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <thread>
 #include "../BaseSplitter/BaseSplitter.h"
 #include "../BaseSplitter/BaseSplitterFile.h"
 #include "dsm/dsm.h"
@@ -30,10 +32,21 @@
 
 class CDSMSplitterFile : public CBaseSplitterFile
 {
+    CComPtr<IAsyncReader> m_pReader;
+    CString m_fn;
+
+    // Index built in the background when the file has none
+    std::thread m_indexThread;
+    std::atomic<bool> m_fIndexAbort;
+
     HRESULT Init(IDSMResourceBagImpl& res, IDSMChapterBagImpl& chap);
 
+    // Only reads the packets, for building the index
+    CDSMSplitterFile(IAsyncReader* pReader, HRESULT& hr);
+
 public:
-    CDSMSplitterFile(IAsyncReader* pReader, HRESULT& hr, IDSMResourceBagImpl& res, IDSMChapterBagImpl& chap);
+    CDSMSplitterFile(IAsyncReader* pReader, HRESULT& hr, IDSMResourceBagImpl& res, IDSMChapterBagImpl& chap, LPCTSTR pszFileName = nullptr);
+    virtual ~CDSMSplitterFile();
 
     CAtlMap<BYTE, CMediaType> m_mts;
     REFERENCE_TIME m_rtFirst, m_rtDuration;
@@ -43,6 +56,7 @@ public:
         __int64 fp;
     };
     CAtlArray<SyncPoint> m_sps;
+    CCritSec m_csSyncPoints; // to protect m_sps, it is replaced when the index is built in the background
 
     typedef CAtlMap<CStringA, CStringW, CStringElementTraits<CStringA>, CStringElementTraits<CStringW>> CStreamInfoMap;
     CStreamInfoMap m_fim;
@@ -59,4 +73,10 @@ public:
     __int64 Read(__int64 len, CStringW& str);
 
     __int64 FindSyncPoint(REFERENCE_TIME rt);
+
+private:
+    void BuildIndex();
+    CString GetIndexCachePath(ULONGLONG& size, ULONGLONG& mtime);
+    bool LoadIndex();
+    void SaveIndex(LPCTSTR pszCachePath, const CAtlArray<SyncPoint>& sps, ULONGLONG size, ULONGLONG mtime);
 };
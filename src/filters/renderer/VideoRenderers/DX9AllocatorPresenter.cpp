@@ -1986,10 +1986,13 @@ void CDX9AllocatorPresenter::DrawStats()
             int nSubPic = 0;
             REFERENCE_TIME rtQueueStart = 0;
             REFERENCE_TIME rtQueueEnd = 0;
+            REFERENCE_TIME rtLastLookup = 0;
+            REFERENCE_TIME rtMaxLookup = 0;
 
             if (m_pSubPicQueue) {
                 REFERENCE_TIME rtQueueNow = 0;
                 m_pSubPicQueue->GetStats(nSubPic, rtQueueNow, rtQueueStart, rtQueueEnd);
+                m_pSubPicQueue->GetLookupStats(rtLastLookup, rtMaxLookup);
             }
 
             pAlloc->GetStats(nFree, nAlloc);
@@ -1997,6 +2000,10 @@ void CDX9AllocatorPresenter::DrawStats()
                            nFree, nAlloc, nSubPic, (double(rtQueueStart) / 10000000.0),
                            (double(rtQueueEnd) / 10000000.0));
             drawText(rc, strText);
+
+            strText.Format(_T("Sub. lookup  : Last %7.3f ms   Max %7.3f ms"),
+                           (double(rtLastLookup) / 10000.0), (double(rtMaxLookup) / 10000.0));
+            drawText(rc, strText);
         }
 
         if (iDetailedStats > 1) {
@@ -203,6 +203,13 @@ void CDirectVobSubFilter::PrintMessages(BYTE* pOut)
         }
     }
 
+    if (m_pSubPicAllocator) {
+        size_t nCurrentBytes = 0, nPeakBytes = 0, nPooledBytes = 0;
+        m_pSubPicAllocator->GetMemoryStats(nCurrentBytes, nPeakBytes, nPooledBytes);
+        msg.AppendFormat(_T("subpic memory: %Iu KB (peak %Iu KB, pooled %Iu KB)\n"),
+                         nCurrentBytes / 1024, nPeakBytes / 1024, nPooledBytes / 1024);
+    }
+
     HANDLE hOldBitmap = SelectObject(m_hdc, m_hbm);
     HANDLE hOldFont = SelectObject(m_hdc, m_hfont);
 
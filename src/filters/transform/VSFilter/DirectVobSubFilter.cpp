@@ -29,7 +29,6 @@
 #include "Systray.h"
 #include "../../../DSUtil/FileVersionInfo.h"
 #include "../../../DSUtil/MediaTypes.h"
-#include "../../../SubPic/MemSubPic.h"
 #include "../../../SubPic/SubPicQueueImpl.h"
 #include "../../../Subtitles/RLECodedSubtitle.h"
 #include "../../../Subtitles/PGSSub.h"
@@ -106,6 +105,7 @@ CDirectVobSubFilter::~CDirectVobSubFilter()
         m_pSubPicQueue->Invalidate();
     }
     m_pSubPicQueue = nullptr;
+    m_pSubPicAllocator = nullptr;
 
     if (m_hfont) {
         DeleteObject(m_hfont);
@@ -480,6 +480,7 @@ HRESULT CDirectVobSubFilter::BreakConnect(PIN_DIRECTION dir)
         // not really needed, but may free up a little memory
         CAutoLock cAutoLock(&m_csQueueLock);
         m_pSubPicQueue = nullptr;
+        m_pSubPicAllocator = nullptr;
     }
 
     return __super::BreakConnect(dir);
@@ -527,6 +528,7 @@ void CDirectVobSubFilter::InitSubPicQueue()
     CAutoLock cAutoLock(&m_csQueueLock);
 
     m_pSubPicQueue = nullptr;
+    m_pSubPicAllocator = nullptr;
 
     m_pTempPicBuff.Free();
     if (!m_pTempPicBuff.Allocate(4 * m_w * m_h)) {
@@ -560,7 +562,8 @@ void CDirectVobSubFilter::InitSubPicQueue()
     m_spd.pitch = m_spd.w * m_spd.bpp >> 3;
     m_spd.bits = m_pTempPicBuff;
 
-    CComPtr<ISubPicAllocator> pSubPicAllocator = DEBUG_NEW CMemSubPicAllocator(m_spd.type, CSize(m_w, m_h));
+    CComPtr<CMemSubPicAllocator> pSubPicAllocator = DEBUG_NEW CMemSubPicAllocator(m_spd.type, CSize(m_w, m_h));
+    pSubPicAllocator->SetMemoryLimit(size_t(m_subPicQueueSettings.nMemoryLimit) * 1024 * 1024);
 
     CSize video(bihIn.biWidth, bihIn.biHeight), window = video;
     if (AdjustFrameSize(window)) {
@@ -579,6 +582,8 @@ void CDirectVobSubFilter::InitSubPicQueue()
 
     if (FAILED(hr)) {
         m_pSubPicQueue = nullptr;
+    } else {
+        m_pSubPicAllocator = pSubPicAllocator;
     }
 
     UpdateSubtitle();
@@ -24,6 +24,7 @@
 #include <atlsync.h>
 #include "DirectVobSub.h"
 #include "../BaseVideoFilter/BaseVideoFilter.h"
+#include "../../../SubPic/MemSubPic.h"
 #include "../../../Subtitles/VobSubFile.h"
 #include "../../../Subtitles/RTS.h"
 
@@ -48,6 +49,7 @@ class __declspec(uuid("93A22E7A-5091-45ef-BA61-6DA26156A5D0"))
 
     CCritSec m_csQueueLock;
     CComPtr<ISubPicQueue> m_pSubPicQueue;
+    CComPtr<CMemSubPicAllocator> m_pSubPicAllocator; // the allocator of m_pSubPicQueue, for its memory stats
     void InitSubPicQueue();
     SubPicDesc m_spd;
 
@@ -88,7 +88,7 @@ namespace Plugin
                 CComPtr<ISubPicAllocator> pAllocator = DEBUG_NEW CMemSubPicAllocator(dst.type, size);
 
                 HRESULT hr = E_FAIL;
-                if (!(m_pSubPicQueue = DEBUG_NEW CSubPicQueueNoThread(SubPicQueueSettings(0, 0, false, 50, 100, false), pAllocator, &hr)) || FAILED(hr)) {
+                if (!(m_pSubPicQueue = DEBUG_NEW CSubPicQueueNoThread(SubPicQueueSettings(0, 0, false, 50, 100, false, 1, 0), pAllocator, &hr)) || FAILED(hr)) {
                     m_pSubPicQueue = nullptr;
                     return false;
                 }
@@ -596,6 +596,7 @@ public:
     bool            fOverridePlacement;
     int             nHorPos, nVerPos;
     bool            bSubtitleARCompensation;
+    int             nSubtitleRenderingThreads;
     int             nSubDelayStep;
 
     // Default Style
@@ -13781,6 +13781,7 @@ void CMainFrame::SetSubtitle(const SubtitleInput& subInput)
 
                 pRTS->SetOverride(s.fUseDefaultSubtitlesStyle, s.subtitlesDefStyle);
                 pRTS->SetAlignment(s.fOverridePlacement, s.nHorPos, s.nVerPos);
+                pRTS->SetRenderingThreads(s.nSubtitleRenderingThreads);
                 pRTS->Deinit();
             }
 
@@ -126,12 +126,14 @@
 #define IDS_RS_SPHORPOS                     _T("SPHorPos")
 #define IDS_RS_SPVERPOS                     _T("SPVerPos")
 #define IDS_RS_SUBTITLEARCOMPENSATION       _T("SubtitleARCompensation")
+#define IDS_RS_SUBTITLERENDERINGTHREADS     _T("SubtitleRenderingThreads")
 #define IDS_RS_SPCSIZE                      _T("SPCSize")
 #define IDS_RS_SPCMAXRES                    _T("SPCMaxRes")
 #define IDS_RS_DISABLE_SUBTITLE_ANIMATION   _T("DisableSubtitleAnimation")
 #define IDS_RS_RENDER_AT_WHEN_ANIM_DISABLED _T("RenderAtWhenSubtitleAnimationIsDisabled")
 #define IDS_RS_SUBTITLE_ANIMATION_RATE      _T("SubtitleAnimationRate")
 #define IDS_RS_ALLOW_DROPPING_SUBPIC        _T("AllowDroppingSubpic")
+#define IDS_RS_SPCRENDERTHREADS             _T("SPCRenderThreads")
 #define IDS_RS_INTREALMEDIA                 _T("IntRealMedia")
 #define IDS_RS_EXITFULLSCREENATTHEEND       _T("ExitFullscreenAtTheEnd")
 #define IDS_RS_REMEMBERWINDOWPOS            _T("RememberWindowPos")